@@ -1,97 +1,381 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <math.h>
+#include <time.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
+#include "../src/imu_shm.h"
+#include "../src/backend.h"
+#include "../src/metrics.h"
+#include "../src/tracepoint.h"
 
 #define MPU_ADDR      0x68
+#define SMPLRT_DIV    0x19
+#define MPU_CONFIG    0x1A
+#define FIFO_EN       0x23
+#define INT_ENABLE    0x38
+#define INT_STATUS    0x3A
+#define MPU_OUT_H    0x3B
+#define USER_CTRL     0x6A
 #define PWR_MGMT_1    0x6B
-#define MPU_OUT_H    0x3B 
+#define FIFO_COUNTH   0x72
+#define FIFO_R_W      0x74
 
-int mpu_wake_up(int file) {
-    uint8_t data[14] = {PWR_MGMT_1, 0};
+#define FIFO_EN_TEMP_GYRO_ACCEL 0xF8   /* same 14-byte layout as the 0x3B burst */
+#define USER_CTRL_FIFO_EN       0x40
+#define USER_CTRL_FIFO_RESET    0x04
+#define INT_FIFO_OFLOW          0x10
+#define MPU_FIFO_SIZE           1024
+#define MPU_SAMPLE_BYTES        14
+/* Per-message read length kept small enough for common I2C adapters. */
+#define FIFO_CHUNK_SAMPLES      18
+#define MAX_BATCH_SAMPLES       (MPU_FIFO_SIZE / MPU_SAMPLE_BYTES)
+
+#define STATS_PERIOD_NS 5000000000ULL
+
+/* -a: a second MPU on the bus answers at 0x69 (AD0 high) */
+uint16_t mpu_addr = MPU_ADDR;
+
+typedef struct {
+    int fifo;           /* 0: one register burst per period, 1: drain the on-chip FIFO */
+    int rate_hz;        /* sample rate, set on the chip in FIFO mode */
+    int dlpf;           /* CONFIG.DLPF_CFG, 1..6 give a 1 kHz gyro output rate */
+    int drain_ms;       /* FIFO drain period */
+    int verbose;
+} acq_config;
+
+typedef struct {
+    uint64_t samples;
+    uint64_t overruns;
+    uint64_t i2c_errors;
+    uint64_t notify_dropped;
+} acq_stats;
+
+/* -p: Prometheus text on a socket path or localhost port, see metrics.h */
+typedef struct {
+    metrics m;
+    metrics_shard *shard;
+    int samples, overruns, i2c_errors, notify_dropped, batch, read, late;
+} acq_metrics;
+
+static void acq_metrics_setup(acq_metrics *am, int motor) {
+    char l[32];
+
+    snprintf(l, sizeof(l), "motor=\"%d\"", motor);
+    metrics_init(&am->m);
+    am->samples = metrics_counter(&am->m, "imu_samples_total", "Samples published.", l);
+    am->overruns = metrics_counter(&am->m, "imu_fifo_overruns_total", "MPU FIFO overflows, batch discarded.", l);
+    am->i2c_errors = metrics_counter(&am->m, "imu_i2c_errors_total", "Failed I2C transactions.", l);
+    am->notify_dropped = metrics_counter(&am->m, "imu_notify_dropped_total", "Wake-ups dropped on a full notify FIFO.", l);
+    am->batch = metrics_gauge(&am->m, "imu_batch_samples", "Samples read in the last period.", l);
+    am->read = metrics_histogram(&am->m, "imu_read_seconds", "I2C time per period (burst or FIFO drain).", l);
+    am->late = metrics_histogram(&am->m, "imu_wake_lateness_seconds", "Wake-up past the period deadline.", l);
+    am->shard = metrics_thread(&am->m);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int mpu_write_reg(int file, uint8_t reg, uint8_t value) {
+    uint8_t data[2] = {reg, value};
     if(write(file, data, 2)!=2){
         return -1;
     }
     return 0;
 }
 
-void mpu_data(int file, int16_t* segmented_data) {
-    uint8_t reg[1] = {MPU_OUT_H};
-    write(file, reg, 1);
-    uint8_t data[14] = {0};
-    read(file, data, 14);
+int mpu_wake_up(int file) {
+    return mpu_write_reg(file, PWR_MGMT_1, 0);
+}
+
+/* Register read as one combined write+read transaction (repeated start). */
+int mpu_read_regs(int file, uint8_t reg, uint8_t *buf, uint16_t len) {
+    struct i2c_msg msgs[2] = {
+        { .addr = mpu_addr, .flags = 0, .len = 1, .buf = &reg },
+        { .addr = mpu_addr, .flags = I2C_M_RD, .len = len, .buf = buf },
+    };
+    struct i2c_rdwr_ioctl_data xfer = { .msgs = msgs, .nmsgs = 2 };
+    return ioctl(file, I2C_RDWR, &xfer) == 2 ? 0 : -1;
+}
+
+void mpu_decode(const uint8_t *data, int16_t* segmented_data) {
     for (int i = 0; i < 7; i++)
     {
         segmented_data[i]= (int16_t)((data[i*2] << 8) | data[i*2+1]);
     }
 }
 
-int main() {
+int mpu_data(int file, int16_t* segmented_data) {
+    uint8_t data[MPU_SAMPLE_BYTES] = {0};
+    if (mpu_read_regs(file, MPU_OUT_H, data, sizeof(data)) < 0) return -1;
+    mpu_decode(data, segmented_data);
+    return 0;
+}
+
+int mpu_fifo_reset(int file) {
+    if (mpu_write_reg(file, USER_CTRL, USER_CTRL_FIFO_RESET) < 0) return -1;
+    return mpu_write_reg(file, USER_CTRL, USER_CTRL_FIFO_EN);
+}
+
+/* Programs the sample rate nearest cfg->rate_hz the divider can give and
+   returns the chip's actual sample period in *sample_ns. */
+int mpu_fifo_setup(int file, const acq_config *cfg, uint64_t *sample_ns) {
+    int gyro_rate = (cfg->dlpf >= 1 && cfg->dlpf <= 6) ? 1000 : 8000;
+    int div = gyro_rate / cfg->rate_hz - 1;
+    if (div < 0) div = 0;
+    if (div > 255) div = 255;
+
+    if (mpu_write_reg(file, MPU_CONFIG, cfg->dlpf & 0x07) < 0) return -1;
+    if (mpu_write_reg(file, SMPLRT_DIV, div) < 0) return -1;
+    if (mpu_write_reg(file, FIFO_EN, FIFO_EN_TEMP_GYRO_ACCEL) < 0) return -1;
+    if (mpu_write_reg(file, INT_ENABLE, INT_FIFO_OFLOW) < 0) return -1;
+    if (mpu_fifo_reset(file) < 0) return -1;
+    *sample_ns = 1000000000ULL * (div + 1) / gyro_rate;
+    printf("FIFO mode: %d Hz (div %d, dlpf %d), drain every %d ms\n",
+           gyro_rate / (div + 1), div, cfg->dlpf, cfg->drain_ms);
+    return 0;
+}
+
+/*
+ * Reads whole samples out of the FIFO. Status and count come in one
+ * I2C_RDWR ioctl, the samples in a second one carrying all chunks.
+ * Returns the number of samples, -1 on I2C error.
+ */
+int mpu_fifo_drain(int file, int16_t (*samples)[7], acq_stats *stats) {
+    uint8_t status, count_buf[2];
+    uint8_t reg_status = INT_STATUS, reg_count = FIFO_COUNTH, reg_fifo = FIFO_R_W;
+    struct i2c_msg msgs[2 * (MAX_BATCH_SAMPLES / FIFO_CHUNK_SAMPLES + 1)] = {
+        { .addr = mpu_addr, .flags = 0, .len = 1, .buf = &reg_status },
+        { .addr = mpu_addr, .flags = I2C_M_RD, .len = 1, .buf = &status },
+        { .addr = mpu_addr, .flags = 0, .len = 1, .buf = &reg_count },
+        { .addr = mpu_addr, .flags = I2C_M_RD, .len = 2, .buf = count_buf },
+    };
+    struct i2c_rdwr_ioctl_data xfer = { .msgs = msgs, .nmsgs = 4 };
+    static uint8_t data[MAX_BATCH_SAMPLES * MPU_SAMPLE_BYTES];
+
+    if (ioctl(file, I2C_RDWR, &xfer) != 4) return -1;
+
+    if (status & INT_FIFO_OFLOW) {
+        /* FIFO wrapped: its contents are no longer sample-aligned */
+        stats->overruns++;
+        return mpu_fifo_reset(file) < 0 ? -1 : 0;
+    }
+
+    int n = ((count_buf[0] << 8) | count_buf[1]) / MPU_SAMPLE_BYTES;
+    if (n > MAX_BATCH_SAMPLES) n = MAX_BATCH_SAMPLES;
+    if (n == 0) return 0;
+
+    int nmsgs = 0;
+    for (int done = 0; done < n; done += FIFO_CHUNK_SAMPLES) {
+        int chunk = n - done < FIFO_CHUNK_SAMPLES ? n - done : FIFO_CHUNK_SAMPLES;
+        msgs[nmsgs++] = (struct i2c_msg){ .addr = mpu_addr, .flags = 0, .len = 1, .buf = &reg_fifo };
+        msgs[nmsgs++] = (struct i2c_msg){ .addr = mpu_addr, .flags = I2C_M_RD,
+            .len = chunk * MPU_SAMPLE_BYTES, .buf = data + done * MPU_SAMPLE_BYTES };
+    }
+    xfer.nmsgs = nmsgs;
+    if (ioctl(file, I2C_RDWR, &xfer) != nmsgs) return -1;
+
+    for (int i = 0; i < n; i++) mpu_decode(data + i * MPU_SAMPLE_BYTES, samples[i]);
+    return n;
+}
+
+void mpu_convert(const int16_t *data, imu_record *rec) {
+    float acc_data[3], gyro_data[3];
+
+    for (int i = 0; i < 3; i++) {
+        acc_data[i] = data[i] / 16384.0;
+        gyro_data[i] = data[i + 4] / 131.0;
+    }
+    rec->temp = (data[3] / 340.0) + 36.53;
+    rec->acc = sqrt(acc_data[0]* acc_data[0]+acc_data[1]* acc_data[1]+acc_data[2]* acc_data[2]);
+    rec->acc = fabs(rec->acc - 1.0);
+    rec->gyro = sqrt(gyro_data[0]* gyro_data[0]+gyro_data[1]* gyro_data[1]+gyro_data[2]* gyro_data[2]);
+    memcpy(rec->raw, data, sizeof(rec->raw));
+}
+
+static void print_stats(const acq_stats *stats, uint64_t *last_t, uint64_t *last_samples, double *last_cpu) {
+    struct rusage ru;
+    uint64_t t = now_ns();
+    getrusage(RUSAGE_SELF, &ru);
+    double cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+    double wall = (t - *last_t) * 1e-9;
+
+    fprintf(stderr, "imu: %.1f Hz, cpu %.1f%%, overruns %llu, i2c errors %llu\n",
+            (stats->samples - *last_samples) / wall, 100.0 * (cpu - *last_cpu) / wall,
+            (unsigned long long)stats->overruns, (unsigned long long)stats->i2c_errors);
+    *last_t = t;
+    *last_samples = stats->samples;
+    *last_cpu = cpu;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-f] [-r rate_hz] [-d dlpf] [-i drain_ms] [-m motor] [-a i2c_addr] [-p metrics] [-v]\n"
+                    "  -f  drain the on-chip FIFO instead of one burst read per period\n"
+                    "  -m  publish for motor n: /imu_data<n>, /tmp/imu_notify<n>, /tmp/imu_data<n>.csv\n"
+                    "  -p  serve Prometheus metrics on a Unix socket path or a localhost port\n", prog);
+}
+
+int main(int argc, char **argv) {
+    acq_config cfg = { .fifo = 0, .rate_hz = 2, .dlpf = 3, .drain_ms = 10, .verbose = 0 };
+    acq_stats stats = {0};
+    int opt, motor = 0;
+    char notify_path[64], log_path[64];
+    const char *metrics_addr = NULL;
+    static acq_metrics am;
+
+    while ((opt = getopt(argc, argv, "fr:d:i:m:a:p:v")) != -1) {
+        switch (opt) {
+        case 'f': cfg.fifo = 1; break;
+        case 'r': cfg.rate_hz = atoi(optarg); break;
+        case 'd': cfg.dlpf = atoi(optarg); break;
+        case 'i': cfg.drain_ms = atoi(optarg); break;
+        case 'm': motor = atoi(optarg); break;
+        case 'a': mpu_addr = (uint16_t)strtol(optarg, NULL, 0); break;
+        case 'p': metrics_addr = optarg; break;
+        case 'v': cfg.verbose = 1; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (cfg.rate_hz <= 0 || cfg.drain_ms <= 0 || motor < 0) { usage(argv[0]); return 1; }
+    if (motor == 0) {
+        snprintf(notify_path, sizeof(notify_path), "%s", IMU_NOTIFY_PATH);
+        snprintf(log_path, sizeof(log_path), "/tmp/imu_data.csv");
+    } else {
+        snprintf(notify_path, sizeof(notify_path), "%s%d", IMU_NOTIFY_PATH, motor);
+        snprintf(log_path, sizeof(log_path), "/tmp/imu_data%d.csv", motor);
+    }
+
     int file;
     file = open("/dev/i2c-1", O_RDWR);
     if (file < 0) {
         printf("Error opening bus!\n");
         return 1;
     }
-    FILE *log_file = fopen("/tmp/imu_data.csv", "w");
-    
+    FILE *log_file = fopen(log_path, "w");
+
     if (log_file == NULL) {
         perror("Error opening log file");
         return 1;
     }
 
-    ioctl(file, I2C_SLAVE, MPU_ADDR);
+    /* Consumers poll() this FIFO instead of sleeping a fixed period. O_RDWR
+       keeps the open from failing while no consumer is attached; once the
+       pipe is full, writes fail with EAGAIN and are dropped. */
+    if (mkfifo(notify_path, 0666) < 0 && errno != EEXIST) {
+        perror("Error creating notify fifo");
+    }
+    int notify_fd = open(notify_path, O_RDWR | O_NONBLOCK);
+    imu_shm *shm = imu_shm_create(motor);
+    if (shm == NULL) {
+        perror("Error creating shared memory");
+    }
+
+    if (ioctl(file, I2C_SLAVE, mpu_addr) < 0) {
+        perror("Error selecting MPU");
+        return 1;
+    }
 
     if (mpu_wake_up(file) == -1)
     {
         return 1;
     }
+    /* FIFO records are back-dated by the chip's period, which the divider
+       rounds: -r 300 samples at 333 Hz */
+    uint64_t sample_ns = 1000000000ULL / cfg.rate_hz;
+    if (cfg.fifo && mpu_fifo_setup(file, &cfg, &sample_ns) < 0) {
+        perror("Error configuring FIFO");
+        return 1;
+    }
     printf("Sensor is awake! Reading data...\n");
-    float temp, acc_vibration, gyro_vibration;
-    float acc_data[3];
-    float gyro_data[3];
-    int j;
-    int16_t data[7] = {0};
+    acq_metrics_setup(&am, motor);
+    TP_START("imu-trace");
+    TP_THREAD("imu");
+    if (metrics_addr && metrics_serve(&am.m, metrics_addr) < 0) {
+        fprintf(stderr, "No metrics endpoint on %s\n", metrics_addr);
+    }
+
+    static int16_t batch[MAX_BATCH_SAMPLES][7];
+    imu_record rec;
+    uint64_t period_ns = cfg.fifo ? cfg.drain_ms * 1000000ULL : 1000000000ULL / cfg.rate_hz;
+    uint64_t stats_t = now_ns(), stats_samples = 0;
+    double stats_cpu = 0;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
     while (1) {
-        j = 0;
-        mpu_data(file, data);
-        for (int i = 0; i < 7; i++)
-        {
-            if (i < 3)
-            {
-                acc_data[j] = data[i]/16384.0;
-                printf("%.2f \n ", acc_data[j]);
-                j++;
+        int n;
+        uint64_t t = now_ns();
+        uint64_t deadline_ns = (uint64_t)deadline.tv_sec * 1000000000ULL + deadline.tv_nsec;
+
+        TP_BEGIN("i2c_read");
+        if (cfg.fifo) {
+            n = mpu_fifo_drain(file, batch, &stats);
+        } else {
+            n = mpu_data(file, batch[0]) < 0 ? -1 : 1;
+        }
+        TP_END("i2c_read");
+        metrics_observe_ns(am.shard, am.read, now_ns() - t);
+        metrics_observe_ns(am.shard, am.late, t > deadline_ns ? t - deadline_ns : 0);
+
+        if (n < 0) {
+            stats.i2c_errors++;
+        } else if (n > 0) {
+            /* FIFO samples are evenly spaced and the last one is the newest */
+            TP_BEGIN("publish");
+            for (int k = 0; k < n; k++) {
+                mpu_convert(batch[k], &rec);
+                rec.t_ns = t - (uint64_t)(n - 1 - k) * sample_ns;
+                if (shm) imu_shm_publish(shm, &rec);
             }
-            else if (i>3)
-            {
-                gyro_data[j] = data[i]/131.0;
-                j++;
-                printf("%.2f \n ", gyro_data[j-1]);
+            TP_END("publish");
+            stats.samples += n;
+            if (cfg.verbose) {
+                printf("acc %6d %6d %6d  gyro %6d %6d %6d  temp %.2f\n",
+                       batch[n-1][0], batch[n-1][1], batch[n-1][2],
+                       batch[n-1][4], batch[n-1][5], batch[n-1][6], rec.temp);
+            }
+
+            TP_BEGIN("log_write");
+            rewind(log_file);
+            ftruncate(fileno(log_file), 0);
+            fprintf(log_file, "%.2f|%.2f|%.2f\n", rec.acc, rec.gyro, rec.temp);
+            fflush(log_file);
+            TP_END("log_write");
+            if (notify_fd >= 0) {
+                char tick = 1;
+                if (write(notify_fd, &tick, 1) < 0) {
+                    if (errno == EAGAIN) stats.notify_dropped++;
+                    else perror("notify");
+                }
             }
-            else
-            {
-                temp = (data[i]/ 340.0) + 36.53;
-                j = 0;
-                printf("%.2f \n ", temp);
-            }        
         }
-        acc_vibration = sqrt(acc_data[0]* acc_data[0]+acc_data[1]* acc_data[1]+acc_data[2]* acc_data[2]);
-        acc_vibration = fabs (acc_vibration - 1.0);
 
-        gyro_vibration = sqrt(gyro_data[0]* gyro_data[0]+gyro_data[1]* gyro_data[1]+gyro_data[2]* gyro_data[2]);
+        metrics_set(am.shard, am.samples, stats.samples);
+        metrics_set(am.shard, am.overruns, stats.overruns);
+        metrics_set(am.shard, am.i2c_errors, stats.i2c_errors);
+        metrics_set(am.shard, am.notify_dropped, stats.notify_dropped);
+        metrics_set(am.shard, am.batch, n > 0 ? n : 0);
 
-        rewind(log_file);
-        ftruncate(fileno(log_file), 0);
-        fprintf(log_file, "%.2f|%.2f|%.2f\n", acc_vibration, gyro_vibration, temp);
-        fflush(log_file);
-        usleep(500000);
+        if (t - stats_t >= STATS_PERIOD_NS) print_stats(&stats, &stats_t, &stats_samples, &stats_cpu);
+
+        deadline.tv_nsec += period_ns % 1000000000ULL;
+        deadline.tv_sec += period_ns / 1000000000ULL + deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
     }
 
     close(file);
     return 0;
-}
\ No newline at end of file
+}
@@ -5,18 +5,213 @@
 #include <linux/hrtimer.h>
 #include <linux/ktime.h>
 #include <linux/slab.h>
-
+#include <linux/spinlock.h>
+#include <linux/kref.h>
+#include <linux/math64.h>
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include "motor_ioctl.h"
+#include "speed_hook.h"
+
+/*
+ * One per device-tree node; "slend,motor-id = <n>" names the char device
+ * /dev/motor<n>, motor 0 keeps /dev/motor.
+ *
+ * Open /dev/motor files can outlive an unbind, so the struct is refcounted:
+ * the device holds one reference, every open file another. Once unbound it
+ * is marked gone and never touches the (devm) GPIOs again.
+ */
 struct motor_data {
+    struct kref ref;
+    u32 id;
     struct gpio_desc *front;
     struct gpio_desc *back;
     struct gpio_desc *move;
     char last_command;
-    int current_speed;   
+    int current_speed;
     struct hrtimer pwm_timer;
-    bool pwm_pin_high; 
+    bool pwm_pin_high;
+
+    /* Everything below is shared with the hrtimer callback under lock. */
+    spinlock_t lock;
+    bool gone;              /* unbound: timers stop, file operations fail */
+    bool timer_running;
+    u32 duty;               /* 1/1000 % */
+    u8 profile;
+    u16 target;
+    bool ramping;
+    u32 ramp_from, ramp_to;
+    u64 ramp_start_ns, ramp_len_ns;
+    char pending_dir;       /* direction to take once a reversal ramp hits 0 */
+    u32 pending_rate;
+
+    /* guard, see struct motor_guard; also under lock */
+    struct file *guard_owner;
+    struct motor_guard guard;
+    struct hrtimer guard_timer;
+    bool guard_running;
+    u32 trip;
+    u64 last_kick_ns;
+    u64 setpoint_ns;        /* last setpoint change, for the underspeed grace */
+    u64 rpm, last_pulse_ns;
+    u32 overspeed_pulses;   /* consecutive pulses above max_rpm */
+    int (*hook_set)(u32 id, speed_hook_fn fn, void *ctx);  /* NULL without speed_driver */
+
+    struct device *dev;
+    struct miscdevice misc;
 };
 
-#define PWM_PERIOD_NS 10000000 
+#define PWM_PERIOD_NS 10000000
+/* watchdog and underspeed resolution */
+#define GUARD_TICK_NS 1000000
+/* no pulse for this long counts as standing still (30 rpm with 20 holes) */
+#define GUARD_PULSE_TIMEOUT_NS 100000000ULL
+
+static const char *const trip_names[] = { "none", "watchdog", "overspeed", "underspeed" };
+
+static void motor_set_dir(struct motor_data *data, char dir)
+{
+    if (dir == 'f') {
+        gpiod_set_value(data->front, 1);
+        gpiod_set_value(data->back, 0);
+    } else if (dir == 'b') {
+        gpiod_set_value(data->front, 0);
+        gpiod_set_value(data->back, 1);
+    } else {
+        gpiod_set_value(data->front, 0);
+        gpiod_set_value(data->back, 0);
+        dir = 's';
+    }
+    data->last_command = dir;
+}
+
+/* Called with lock held. rate is in % per second. */
+static void motor_start_ramp(struct motor_data *data, u32 to, u32 rate, u64 now)
+{
+    u32 span = to > data->duty ? to - data->duty : data->duty - to;
+
+    data->ramp_from = data->duty;
+    data->ramp_to = to;
+    data->ramp_start_ns = now;
+    data->ramp_len_ns = rate ? div_u64((u64)span * NSEC_PER_SEC, rate * 1000) : 0;
+    data->ramping = data->ramp_len_ns > 0;
+    if (!data->ramping)
+        data->duty = to;
+}
+
+/* Advances the ramp to time now; called with lock held at each period start. */
+static void motor_ramp_update(struct motor_data *data, u64 now)
+{
+    u64 elapsed = now - data->ramp_start_ns;
+    u64 p;
+    s64 span;
+
+    if (!data->ramping)
+        return;
+
+    if (elapsed >= data->ramp_len_ns) {
+        data->duty = data->ramp_to;
+        data->ramping = false;
+        if (data->pending_dir) {
+            motor_set_dir(data, data->pending_dir);
+            data->pending_dir = 0;
+            if (data->last_command != 's')
+                motor_start_ramp(data, data->target * 1000, data->pending_rate, now);
+        }
+        return;
+    }
+
+    p = div64_u64(elapsed << 16, data->ramp_len_ns);
+    if (data->profile == MOTOR_RAMP_SCURVE)
+        p = (((p * p) >> 16) * (3 * 65536 - 2 * p)) >> 16;
+    span = (s64)data->ramp_to - data->ramp_from;
+    data->duty = data->ramp_from + (s32)div_s64(span * (s64)p, 65536);
+}
+
+/*
+ * Cuts the H-bridge and latches the reason; called with lock held from the
+ * guard timer, the speed IRQ or the ioctl path. The PWM timer sees duty 0
+ * and stops on its own.
+ */
+static void motor_trip(struct motor_data *data, u32 reason)
+{
+    if (data->trip)
+        return;
+    data->trip = reason;
+    data->target = 0;
+    data->pending_dir = 0;
+    data->ramping = false;
+    data->duty = 0;
+    data->current_speed = 0;
+    gpiod_set_value(data->move, 0);
+    data->pwm_pin_high = false;
+    motor_set_dir(data, 's');
+    dev_warn(data->dev, "%s trip, motor stopped\n", trip_names[reason]);
+}
+
+static void motor_data_free(struct kref *ref)
+{
+    struct motor_data *data = container_of(ref, struct motor_data, ref);
+
+    /* a setpoint racing the unbind may have restarted a timer */
+    hrtimer_cancel(&data->guard_timer);
+    hrtimer_cancel(&data->pwm_timer);
+    kfree(data);
+}
+
+static bool motor_driven(const struct motor_data *data)
+{
+    return data->last_command != 's' || data->pending_dir;
+}
+
+static enum hrtimer_restart guard_timer_callback(struct hrtimer *timer)
+{
+    struct motor_data *data = container_of(timer, struct motor_data, guard_timer);
+    ktime_t kt = hrtimer_cb_get_time(timer);
+    u64 now = ktime_to_ns(kt);
+    const struct motor_guard *g = &data->guard;
+    u64 rpm;
+
+    spin_lock(&data->lock);
+    if (!data->guard_owner || data->gone) {
+        data->guard_running = false;
+        spin_unlock(&data->lock);
+        return HRTIMER_NORESTART;
+    }
+    if (!data->trip && motor_driven(data)) {
+        if (g->wdt_ms && now - data->last_kick_ns > (u64)g->wdt_ms * NSEC_PER_MSEC) {
+            motor_trip(data, MOTOR_TRIP_WATCHDOG);
+        } else if (g->min_rpm && data->hook_set && data->duty >= g->min_duty * 1000u &&
+                   now - data->setpoint_ns >= (u64)g->grace_ms * NSEC_PER_MSEC) {
+            rpm = now - data->last_pulse_ns > GUARD_PULSE_TIMEOUT_NS ? 0 : data->rpm;
+            if (rpm < g->min_rpm)
+                motor_trip(data, MOTOR_TRIP_UNDERSPEED);
+        }
+    }
+    spin_unlock(&data->lock);
+
+    hrtimer_forward(timer, kt, ns_to_ktime(GUARD_TICK_NS));
+    return HRTIMER_RESTART;
+}
+
+/* speed_driver IRQ: overspeed trips right here, on the last pulse of the run. */
+static void motor_speed_hook(void *ctx, u64 rpm, u64 t_ns)
+{
+    struct motor_data *data = ctx;
+    unsigned long flags;
+
+    spin_lock_irqsave(&data->lock, flags);
+    data->rpm = rpm;
+    data->last_pulse_ns = t_ns;
+    if (data->guard_owner && data->guard.max_rpm && rpm > data->guard.max_rpm && motor_driven(data)) {
+        if (++data->overspeed_pulses >= MOTOR_OVERSPEED_PULSES)
+            motor_trip(data, MOTOR_TRIP_OVERSPEED);
+    } else {
+        data->overspeed_pulses = 0;
+    }
+    spin_unlock_irqrestore(&data->lock, flags);
+}
 
 static enum hrtimer_restart pwm_timer_callback(struct hrtimer *timer)
 {
@@ -26,16 +221,30 @@ static enum hrtimer_restart pwm_timer_callback(struct hrtimer *timer)
 
     now = hrtimer_cb_get_time(timer);
 
-    if (data->current_speed == 0) {
-        gpiod_set_value(data->move, 0);
+    spin_lock(&data->lock);
+    if (data->gone) {
+        data->timer_running = false;
+        spin_unlock(&data->lock);
         return HRTIMER_NORESTART;
     }
-    if (data->current_speed >= 100) {
-        gpiod_set_value(data->move, 1);
-        return HRTIMER_NORESTART;
+    if (!data->pwm_pin_high)
+        motor_ramp_update(data, ktime_to_ns(now));
+    data->current_speed = data->duty / 1000;
+
+    if (data->duty == 0 || data->duty >= MOTOR_DUTY_MAX) {
+        gpiod_set_value(data->move, data->duty ? 1 : 0);
+        data->pwm_pin_high = false;
+        if (!data->ramping) {
+            data->timer_running = false;
+            spin_unlock(&data->lock);
+            return HRTIMER_NORESTART;
+        }
+        hrtimer_forward(timer, now, ns_to_ktime(PWM_PERIOD_NS));
+        spin_unlock(&data->lock);
+        return HRTIMER_RESTART;
     }
 
-    on_time_ns = (PWM_PERIOD_NS * data->current_speed) / 100;
+    on_time_ns = div_u64((u64)PWM_PERIOD_NS * data->duty, MOTOR_DUTY_MAX);
     off_time_ns = PWM_PERIOD_NS - on_time_ns;
 
     if (data->pwm_pin_high) {
@@ -47,16 +256,93 @@ static enum hrtimer_restart pwm_timer_callback(struct hrtimer *timer)
         data->pwm_pin_high = true;
         hrtimer_forward(timer, now, ns_to_ktime(on_time_ns));
     }
+    spin_unlock(&data->lock);
 
     return HRTIMER_RESTART;
 }
 
+/*
+ * Common path of the sysfs and ioctl interfaces. A reversal while the motor
+ * is driven ramps to 0 first, then flips the H-bridge and ramps up again.
+ */
+static int motor_apply(struct motor_data *data, char dir, int speed, u8 profile, u32 rate)
+{
+    unsigned long flags;
+    u64 now = ktime_get_ns();
+    bool start_timer = false;
+
+    if (speed > 100) speed = 100;
+    if (speed < 0) speed = 0;
+    if (dir != 'f' && dir != 'b') {
+        dir = 's';
+        speed = 0;
+    }
+    if (profile > MOTOR_RAMP_SCURVE) profile = MOTOR_RAMP_LINEAR;
+    if (profile == MOTOR_RAMP_STEP) rate = 0;
+
+    spin_lock_irqsave(&data->lock, flags);
+    if (data->gone) {
+        spin_unlock_irqrestore(&data->lock, flags);
+        return -ENODEV;
+    }
+    data->last_kick_ns = now;
+    if (data->trip) {
+        if (dir != 's') {
+            spin_unlock_irqrestore(&data->lock, flags);
+            return -EIO;
+        }
+        data->trip = MOTOR_TRIP_NONE;
+    }
+    /* the app re-sends its setpoint every loop; do not restart a running ramp */
+    if (dir == (data->pending_dir ? data->pending_dir : data->last_command) &&
+        speed == data->target && profile == data->profile) {
+        spin_unlock_irqrestore(&data->lock, flags);
+        return 0;
+    }
+    data->setpoint_ns = now;
+
+    data->profile = profile;
+    data->target = speed;
+    data->pending_dir = 0;
+    if (dir != data->last_command && data->duty > 0 && rate > 0) {
+        data->pending_dir = dir;
+        data->pending_rate = rate;
+        motor_start_ramp(data, 0, rate, now);
+    } else {
+        if (dir != data->last_command)
+            motor_set_dir(data, dir);
+        motor_start_ramp(data, speed * 1000, rate, now);
+    }
+
+    if (data->duty == 0 && !data->ramping) {
+        /* stop immediately rather than at the next period */
+        gpiod_set_value(data->move, 0);
+        data->pwm_pin_high = false;
+    }
+    data->current_speed = data->duty / 1000;
+    if (!data->timer_running && (data->ramping || (data->duty > 0 && data->duty < MOTOR_DUTY_MAX))) {
+        data->timer_running = true;
+        start_timer = true;
+    } else if (!data->timer_running && data->duty >= MOTOR_DUTY_MAX) {
+        gpiod_set_value(data->move, 1);
+    }
+    spin_unlock_irqrestore(&data->lock, flags);
+
+    if (start_timer) {
+        data->pwm_pin_high = false;
+        hrtimer_start(&data->pwm_timer, 0, HRTIMER_MODE_REL);
+    }
+    return 0;
+}
+
 static ssize_t motor_set_show(struct device *dev, struct device_attribute *attr, char *buf)
 {
     struct motor_data *data = dev_get_drvdata(dev);
-    return sprintf(buf, "Status -> Dir: %c, Speed: %d%%\n", 
-                   data->last_command ? data->last_command : 's', 
-                   data->current_speed);
+    return sprintf(buf, "Status -> Dir: %c, Speed: %d%%, Target: %d%%%s%s%s\n",
+                   data->last_command ? data->last_command : 's',
+                   data->current_speed, data->target,
+                   data->ramping ? " (ramping)" : "",
+                   data->trip ? ", Trip: " : "", data->trip ? trip_names[data->trip] : "");
 }
 
 static ssize_t motor_set_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
@@ -66,48 +352,137 @@ static ssize_t motor_set_store(struct device *dev, struct device_attribute *attr
     int speed;
     int ret;
 
-    if (count < 4) return -EINVAL; 
+    if (count < 4) return -EINVAL;
 
     dir = buf[0];
     ret = sscanf(buf + 1, "%3d", &speed);
     if (ret != 1) return -EINVAL;
 
-    if (speed > 100) speed = 100;
-    if (speed < 0) speed = 0;    
+    ret = motor_apply(data, dir, speed, MOTOR_RAMP_STEP, 0);
 
-    hrtimer_cancel(&data->pwm_timer);
+    return ret ? ret : count;
+}
 
-    if (dir == 'f') {
-        gpiod_set_value(data->front, 1);
-        gpiod_set_value(data->back, 0);
-    } else if (dir == 'b') {
-        gpiod_set_value(data->front, 0);
-        gpiod_set_value(data->back, 1);
-    } else {
-        gpiod_set_value(data->front, 0);
-        gpiod_set_value(data->back, 0);
-        speed = 0;
-        dir = 's';
+static DEVICE_ATTR_RW(motor_set);
+
+/* Arms the guard for this file, or disarms it when every check is 0. */
+static int motor_set_guard(struct motor_data *data, struct file *file, const struct motor_guard *g)
+{
+    bool on = g->wdt_ms || g->max_rpm || g->min_rpm;
+    bool start_timer = false;
+    unsigned long flags;
+
+    spin_lock_irqsave(&data->lock, flags);
+    if (data->gone) {
+        spin_unlock_irqrestore(&data->lock, flags);
+        return -ENODEV;
     }
+    if (data->guard_owner && data->guard_owner != file) {
+        spin_unlock_irqrestore(&data->lock, flags);
+        return -EBUSY;
+    }
+    data->guard = *g;
+    data->guard_owner = on ? file : NULL;
+    data->last_kick_ns = ktime_get_ns();
+    data->overspeed_pulses = 0;
+    if (on && !data->guard_running) {
+        data->guard_running = true;
+        start_timer = true;
+    }
+    spin_unlock_irqrestore(&data->lock, flags);
 
-    data->last_command = dir;
-    data->current_speed = speed;
+    if (start_timer)
+        hrtimer_start(&data->guard_timer, ns_to_ktime(GUARD_TICK_NS), HRTIMER_MODE_REL);
+    if (on && (g->max_rpm || g->min_rpm) && !data->hook_set)
+        dev_warn(data->dev, "speed_driver not loaded, no speed trip\n");
+    return 0;
+}
 
-    if (speed > 0 && speed < 100) {
-        data->pwm_pin_high = true; 
-        gpiod_set_value(data->move, 1);
-        u64 first_period = (PWM_PERIOD_NS * speed) / 100;
-        hrtimer_start(&data->pwm_timer, ns_to_ktime(first_period), HRTIMER_MODE_REL);
-    } else if (speed >= 100) {
-        gpiod_set_value(data->move, 1);
-    } else {
-        gpiod_set_value(data->move, 0);
+static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct motor_data *data = container_of(file->private_data, struct motor_data, misc);
+    struct motor_cmd mc;
+    struct motor_state st;
+    struct motor_guard g;
+    unsigned long flags;
+    u64 elapsed;
+
+    if (READ_ONCE(data->gone))
+        return -ENODEV;
+    switch (cmd) {
+    case MOTOR_IOC_SET:
+        if (copy_from_user(&mc, (void __user *)arg, sizeof(mc)))
+            return -EFAULT;
+        return motor_apply(data, mc.dir, mc.target, mc.profile, mc.rate);
+    case MOTOR_IOC_GUARD:
+        if (copy_from_user(&g, (void __user *)arg, sizeof(g)))
+            return -EFAULT;
+        return motor_set_guard(data, file, &g);
+    case MOTOR_IOC_KICK:
+        spin_lock_irqsave(&data->lock, flags);
+        data->last_kick_ns = ktime_get_ns();
+        spin_unlock_irqrestore(&data->lock, flags);
+        return 0;
+    case MOTOR_IOC_GET:
+        memset(&st, 0, sizeof(st));
+        spin_lock_irqsave(&data->lock, flags);
+        st.dir = data->pending_dir ? data->pending_dir : (data->last_command ? data->last_command : 's');
+        st.profile = data->profile;
+        st.target = data->target;
+        st.duty = data->duty;
+        st.ramping = data->ramping || data->pending_dir;
+        st.trip = data->trip;
+        st.rpm = (u32)data->rpm;
+        if (data->ramping) {
+            elapsed = ktime_get_ns() - data->ramp_start_ns;
+            st.progress = elapsed >= data->ramp_len_ns ? 1000 :
+                          (u32)div64_u64(elapsed * 1000, data->ramp_len_ns);
+        } else {
+            st.progress = 1000;
+        }
+        spin_unlock_irqrestore(&data->lock, flags);
+        return copy_to_user((void __user *)arg, &st, sizeof(st)) ? -EFAULT : 0;
+    default:
+        return -ENOTTY;
     }
+}
+
+/* misc calls open under the lock misc_deregister() takes, so the device
+   still holds its reference here. */
+static int motor_open(struct inode *inode, struct file *file)
+{
+    struct motor_data *data = container_of(file->private_data, struct motor_data, misc);
 
-    return count; 
+    kref_get(&data->ref);
+    return 0;
 }
 
-static DEVICE_ATTR_RW(motor_set);
+/* The guard owner going away, crash included, stops the motor. */
+static int motor_release(struct inode *inode, struct file *file)
+{
+    struct motor_data *data = container_of(file->private_data, struct motor_data, misc);
+    unsigned long flags;
+    bool owner;
+
+    spin_lock_irqsave(&data->lock, flags);
+    owner = data->guard_owner == file;
+    if (owner)
+        data->guard_owner = NULL;
+    spin_unlock_irqrestore(&data->lock, flags);
+
+    if (owner)
+        motor_apply(data, 's', 0, MOTOR_RAMP_STEP, 0);
+    kref_put(&data->ref, motor_data_free);
+    return 0;
+}
+
+static const struct file_operations motor_fops = {
+    .owner = THIS_MODULE,
+    .open = motor_open,
+    .release = motor_release,
+    .unlocked_ioctl = motor_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+};
 
 static int motor_probe(struct platform_device *pdev)
 {
@@ -116,46 +491,97 @@ static int motor_probe(struct platform_device *pdev)
 
     dev_info(&pdev->dev, "Probe function called!\n");
 
-    data = devm_kzalloc(&pdev->dev, sizeof(struct motor_data), GFP_KERNEL);
+    /* not devm: open files may hold it past the unbind */
+    data = kzalloc(sizeof(struct motor_data), GFP_KERNEL);
     if (!data) return -ENOMEM;
+    kref_init(&data->ref);
+    hrtimer_init(&data->pwm_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    data->pwm_timer.function = pwm_timer_callback;
+    hrtimer_init(&data->guard_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    data->guard_timer.function = guard_timer_callback;
 
     data->front = devm_gpiod_get(&pdev->dev, "front", GPIOD_OUT_LOW);
-    if (IS_ERR(data->front)) return PTR_ERR(data->front);
+    ret = PTR_ERR_OR_ZERO(data->front);
+    if (ret) goto err_put;
 
     data->back = devm_gpiod_get(&pdev->dev, "back", GPIOD_OUT_LOW);
-    if (IS_ERR(data->back)) return PTR_ERR(data->back);
+    ret = PTR_ERR_OR_ZERO(data->back);
+    if (ret) goto err_put;
 
     data->move = devm_gpiod_get(&pdev->dev, "move", GPIOD_OUT_LOW);
-    if (IS_ERR(data->move)) return PTR_ERR(data->move);
+    ret = PTR_ERR_OR_ZERO(data->move);
+    if (ret) goto err_put;
 
+    of_property_read_u32(pdev->dev.of_node, "slend,motor-id", &data->id);
+    spin_lock_init(&data->lock);
+    data->last_command = 's';
+    data->dev = &pdev->dev;
     platform_set_drvdata(pdev, data);
 
-    hrtimer_init(&data->pwm_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
-    data->pwm_timer.function = pwm_timer_callback;
-
     ret = device_create_file(&pdev->dev, &dev_attr_motor_set);
     if (ret) {
         dev_err(&pdev->dev, "Failed to create sysfs file\n");
-        return ret;
+        goto err_put;
+    }
+
+    data->misc.minor = MISC_DYNAMIC_MINOR;
+    data->misc.name = data->id ? devm_kasprintf(&pdev->dev, GFP_KERNEL, "motor%u", data->id) : "motor";
+    if (!data->misc.name) {
+        ret = -ENOMEM;
+        goto err_file;
+    }
+    data->misc.fops = &motor_fops;
+    data->misc.parent = &pdev->dev;
+    ret = misc_register(&data->misc);
+    if (ret) {
+        dev_err(&pdev->dev, "Failed to register /dev/%s\n", data->misc.name);
+        goto err_file;
+    }
+
+    /* optional: without speed_driver there is no overspeed/underspeed feed */
+    data->hook_set = symbol_get(speed_hook_set);
+    if (data->hook_set && data->hook_set(data->id, motor_speed_hook, data) < 0) {
+        dev_warn(&pdev->dev, "speed hook for motor %u taken, no speed trip\n", data->id);
+        symbol_put(speed_hook_set);
+        data->hook_set = NULL;
     }
 
     dev_info(&pdev->dev, "All systems GREEN.\n");
     return 0;
+
+err_file:
+    device_remove_file(&pdev->dev, &dev_attr_motor_set);
+err_put:
+    kref_put(&data->ref, motor_data_free);
+    return ret;
 }
 
 static void motor_remove(struct platform_device *pdev)
 {
     struct motor_data *data = platform_get_drvdata(pdev);
+    unsigned long flags;
 
+    misc_deregister(&data->misc);
+    if (data->hook_set) {
+        data->hook_set(data->id, NULL, data);
+        symbol_put(speed_hook_set);
+    }
+    device_remove_file(&pdev->dev, &dev_attr_motor_set);
+
+    /* from here on open files get -ENODEV and the timers stop on their own */
+    spin_lock_irqsave(&data->lock, flags);
+    data->gone = true;
+    data->guard_owner = NULL;
+    spin_unlock_irqrestore(&data->lock, flags);
+    hrtimer_cancel(&data->guard_timer);
     hrtimer_cancel(&data->pwm_timer);
-    
-    if (data->front) gpiod_set_value(data->front, 0);
-    if (data->back) gpiod_set_value(data->back, 0);
-    if (data->move) gpiod_set_value(data->move, 0);
 
-    device_remove_file(&pdev->dev, &dev_attr_motor_set);
+    gpiod_set_value(data->front, 0);
+    gpiod_set_value(data->back, 0);
+    gpiod_set_value(data->move, 0);
 
     dev_info(&pdev->dev, "Driver removed.\n");
+    kref_put(&data->ref, motor_data_free);
 }
 
 static const struct of_device_id motor_dt_ids[] = {
@@ -167,6 +593,7 @@ MODULE_DEVICE_TABLE(of, motor_dt_ids);
 static struct platform_driver motor_driver = {
     .probe = motor_probe,
     .remove = motor_remove,
+    .driver = {
         .name = "my_motor_test_driver",
         .of_match_table = motor_dt_ids,
     },
@@ -176,4 +603,4 @@ module_platform_driver(motor_driver);
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Slend");
-MODULE_DESCRIPTION("Soft PWM Motor Driver");        
\ No newline at end of file
+MODULE_DESCRIPTION("Soft PWM Motor Driver");
@@ -0,0 +1,73 @@
+#ifndef MOTOR_IOCTL_H
+#define MOTOR_IOCTL_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* Binary command interface of motor_driver, shared with userspace. */
+#define MOTOR_DEV "/dev/motor"
+
+#define MOTOR_DUTY_MAX 100000   /* duty is in 1/1000 % */
+
+enum motor_ramp_profile {
+    MOTOR_RAMP_STEP = 0,        /* jump to the target on the next PWM period */
+    MOTOR_RAMP_LINEAR = 1,      /* constant rate */
+    MOTOR_RAMP_SCURVE = 2,      /* smoothstep, same duration as linear */
+};
+
+struct motor_cmd {
+    __u8 dir;                   /* 'f', 'b' or 's' */
+    __u8 profile;               /* enum motor_ramp_profile */
+    __u16 target;               /* duty, 0..100 % */
+    __u32 rate;                 /* average ramp rate in % per second */
+};
+
+enum motor_trip {
+    MOTOR_TRIP_NONE = 0,
+    MOTOR_TRIP_WATCHDOG = 1,    /* no command or kick within wdt_ms */
+    MOTOR_TRIP_OVERSPEED = 2,   /* speed_driver reported more than max_rpm */
+    MOTOR_TRIP_UNDERSPEED = 3,  /* driven at min_duty or more, slower than min_rpm */
+};
+
+struct motor_state {
+    __u8 dir;                   /* direction currently driven */
+    __u8 profile;
+    __u16 target;               /* setpoint of the last command, % */
+    __u32 duty;                 /* duty applied this PWM period, 1/1000 % */
+    __u32 progress;             /* ramp progress, 0..1000 permille */
+    __u32 ramping;              /* 1 while a ramp is running */
+    __u32 trip;                 /* enum motor_trip latched, cleared by a stop */
+    __u32 rpm;                  /* last speed seen by the trip, 0 without speed_driver */
+};
+
+/*
+ * In-kernel guard, armed by the file that sets it and disarmed (with a stop)
+ * when that file is closed, so a crashed app stops the motor at once and a
+ * hung one within wdt_ms. Every MOTOR_IOC_SET is a heartbeat, MOTOR_IOC_KICK
+ * is one without a command. A trip cuts the H-bridge and latches: drive
+ * commands fail with EIO until a stop command. 0 disables a check.
+ *
+ * speed_driver reports one rpm per encoder hole, from a single pulse
+ * interval, so one bounced or noisy edge reads as a burst of speed. An
+ * overspeed trip therefore takes MOTOR_OVERSPEED_PULSES pulses in a row
+ * above max_rpm: 3 ms at 3000 rpm with 20 holes, well inside a real
+ * runaway. Underspeed is checked against the newest pulse on the 1 ms
+ * guard tick, past grace_ms, and only at min_duty or above.
+ */
+#define MOTOR_OVERSPEED_PULSES 3
+
+struct motor_guard {
+    __u32 wdt_ms;
+    __u32 max_rpm;              /* MOTOR_OVERSPEED_PULSES consecutive pulses above */
+    __u32 min_rpm;              /* newest pulse below, or none for 100 ms */
+    __u16 min_duty;             /* %, underspeed is only checked at or above */
+    __u16 grace_ms;             /* after a setpoint change, before underspeed counts */
+};
+
+#define MOTOR_IOC_MAGIC 'M'
+#define MOTOR_IOC_SET   _IOW(MOTOR_IOC_MAGIC, 1, struct motor_cmd)
+#define MOTOR_IOC_GET   _IOR(MOTOR_IOC_MAGIC, 2, struct motor_state)
+#define MOTOR_IOC_GUARD _IOW(MOTOR_IOC_MAGIC, 3, struct motor_guard)
+#define MOTOR_IOC_KICK  _IO(MOTOR_IOC_MAGIC, 4)
+
+#endif
@@ -6,85 +6,376 @@
     #include <linux/interrupt.h>
     #include <linux/ktime.h>
     #include <linux/math64.h>
+    #include <linux/kernfs.h>
+    #include <linux/miscdevice.h>
+    #include <linux/fs.h>
+    #include <linux/poll.h>
+    #include <linux/wait.h>
+    #include <linux/vmalloc.h>
+    #include <linux/mm.h>
+    #include <linux/slab.h>
+    #include <linux/spinlock.h>
+    #include <linux/kref.h>
+    #include "speed_pulses.h"
+    #include "speed_hook.h"
+
+    /* poll() wake-ups on the speed attribute are capped at one per 100 ms */
+    #define SPEED_NOTIFY_NS 100000000ULL
 
     const short int holes = 20;
-    u64 pulse_count = 0;
+
+    #define SPEED_MAX_HOOKS 8
+
+    /* speed_hook_set() table, read by every IRQ under hook_lock */
+    struct speed_hook
+    {
+        u32 id;
+        speed_hook_fn fn;
+        void *ctx;
+    };
+
+    static DEFINE_SPINLOCK(hook_lock);
+    static struct speed_hook hooks[SPEED_MAX_HOOKS];
+
+    /*
+     * One per device-tree node. Instance "slend,motor-id = <n>" exposes
+     * /sys/kernel/speed<n> and /dev/speed_pulses<n>; motor 0 keeps the
+     * unsuffixed names.
+     *
+     * Open /dev/speed_pulses files (and their mappings, which hold the file)
+     * can outlive an unbind, so the struct and the ring are refcounted: the
+     * device holds one reference, every open file another, and the last
+     * put frees both.
+     */
     struct speed_data
     {
+        struct kref ref;
+        bool gone;                  /* unbound: readers get -ENODEV */
+        u32 id;
         u64 last_time;
         u64 rpm;
+        u64 pulse_count;
         int irq;
+        u64 last_notify;
+        struct kernfs_node *kn;
+        struct kobj_attribute attr;
+        bool attr_created;
+
+        /* Raw edge timestamps for /dev/speed_pulses, written only by the IRQ */
+        struct speed_pulse_ring *pulse_ring;
+        wait_queue_head_t pulse_wq;
+        struct miscdevice misc;
+        bool pulses_registered;
+    };
+
+    /* Per open file of /dev/speed_pulses */
+    struct pulse_reader
+    {
+        struct speed_data *data;
+        u64 cursor;
     };
 
-    struct speed_data sensor_state= {0, 0, 0};
+    int speed_hook_set(u32 id, speed_hook_fn fn, void *ctx)
+    {
+        struct speed_hook *free_slot = NULL;
+        unsigned long flags;
+        int i, ret = 0;
+
+        spin_lock_irqsave(&hook_lock, flags);
+        for (i = 0; i < SPEED_MAX_HOOKS; i++) {
+            if (hooks[i].fn && hooks[i].id == id)
+                break;
+            if (!hooks[i].fn && !free_slot)
+                free_slot = &hooks[i];
+        }
+        if (i < SPEED_MAX_HOOKS) {
+            if (hooks[i].ctx != ctx)
+                ret = -EBUSY;
+            else {
+                hooks[i].fn = fn;
+                hooks[i].ctx = ctx;
+            }
+        } else if (fn) {
+            if (free_slot) {
+                free_slot->id = id;
+                free_slot->fn = fn;
+                free_slot->ctx = ctx;
+            } else {
+                ret = -ENOSPC;
+            }
+        }
+        spin_unlock_irqrestore(&hook_lock, flags);
+        return ret;
+    }
+    EXPORT_SYMBOL_GPL(speed_hook_set);
+
+    static void speed_call_hook(u32 id, u64 rpm, u64 t_ns)
+    {
+        int i;
+
+        spin_lock(&hook_lock);
+        for (i = 0; i < SPEED_MAX_HOOKS; i++) {
+            if (hooks[i].fn && hooks[i].id == id) {
+                hooks[i].fn(hooks[i].ctx, rpm, t_ns);
+                break;
+            }
+        }
+        spin_unlock(&hook_lock);
+    }
+
+    static void speed_data_free(struct kref *ref)
+    {
+        struct speed_data *data = container_of(ref, struct speed_data, ref);
+
+        vfree(data->pulse_ring);
+        kfree(data);
+    }
 
     static irqreturn_t speed_irq_handler(int irq, void *dev_id)
     {
+        struct speed_data *data = dev_id;
+        struct speed_pulse_ring *ring = data->pulse_ring;
+        struct kernfs_node *kn;
         u64 start;
         u64 delta;
 
         start = ktime_to_ns(ktime_get());
-        if (sensor_state.last_time !=0){
-            delta = start - sensor_state.last_time;
+        if (data->last_time !=0){
+            delta = start - data->last_time;
             if (delta > 1000){
-                sensor_state.rpm = div64_u64(60000000000ULL, delta * holes);
+                data->rpm = div64_u64(60000000000ULL, delta * holes);
             }
         }
-        sensor_state.last_time = start;
+        data->last_time = start;
+        data->pulse_count++;
+        speed_call_hook(data->id, data->rpm, start);
+
+        if (ring) {
+            u64 head = ring->head;
+            ring->ts[head & (SPEED_RING_SIZE - 1)] = start;
+            smp_store_release(&ring->head, head + 1);
+            wake_up_interruptible(&data->pulse_wq);
+        }
+
+        /* sysfs_notify() takes a mutex; kernfs_notify() is safe from hard IRQ */
+        kn = READ_ONCE(data->kn);
+        if (kn && start - data->last_notify >= SPEED_NOTIFY_NS) {
+            data->last_notify = start;
+            kernfs_notify(kn);
+        }
 
         return IRQ_HANDLED;
     }
 
     static ssize_t show_speed(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
     {
+        struct speed_data *data = container_of(attr, struct speed_data, attr);
         u64 now = ktime_to_ns(ktime_get());
-        u64 time_diff = now - sensor_state.last_time;
+        u64 time_diff = now - data->last_time;
 
         if (time_diff > 500000000ULL) {
-            sensor_state.rpm = 0;
+            data->rpm = 0;
         }
         
-        return sprintf(buf, "%llu\n", sensor_state.rpm);
+        return sprintf(buf, "%llu\n", data->rpm);
+    }
+
+    /*
+     * Each reader gets its own cursor and starts at the newest pulse. misc
+     * calls open under the lock misc_deregister() takes, so data is still
+     * registered, and referenced by the device, while we take our reference.
+     */
+    static int pulses_open(struct inode *inode, struct file *file)
+    {
+        struct speed_data *data = container_of(file->private_data, struct speed_data, misc);
+        struct pulse_reader *reader = kmalloc(sizeof(*reader), GFP_KERNEL);
+        if (!reader)
+            return -ENOMEM;
+        kref_get(&data->ref);
+        reader->data = data;
+        reader->cursor = smp_load_acquire(&data->pulse_ring->head);
+        file->private_data = reader;
+        return stream_open(inode, file);
     }
 
-    static struct kobj_attribute speed_attr = __ATTR(speed, 0444, show_speed, NULL);
+    static int pulses_release(struct inode *inode, struct file *file)
+    {
+        struct pulse_reader *reader = file->private_data;
+
+        kref_put(&reader->data->ref, speed_data_free);
+        kfree(reader);
+        return 0;
+    }
+
+    static ssize_t pulses_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+    {
+        struct pulse_reader *reader = file->private_data;
+        struct speed_data *data = reader->data;
+        struct speed_pulse_ring *ring = data->pulse_ring;
+        u64 *cursor = &reader->cursor;
+        u64 head, n, i;
+
+        if (count < sizeof(u64))
+            return -EINVAL;
+        if (READ_ONCE(data->gone))
+            return -ENODEV;
+        if (file->f_flags & O_NONBLOCK) {
+            if (smp_load_acquire(&ring->head) == *cursor)
+                return -EAGAIN;
+        } else if (wait_event_interruptible(data->pulse_wq, smp_load_acquire(&ring->head) != *cursor ||
+                                                            READ_ONCE(data->gone))) {
+            return -ERESTARTSYS;
+        }
+        if (READ_ONCE(data->gone))
+            return -ENODEV;
+
+        head = smp_load_acquire(&ring->head);
+        if (head - *cursor > SPEED_RING_SIZE)
+            *cursor = head - SPEED_RING_SIZE;
+        n = min_t(u64, head - *cursor, count / sizeof(u64));
+        for (i = 0; i < n; i++) {
+            u64 ts = ring->ts[(*cursor + i) & (SPEED_RING_SIZE - 1)];
+            if (put_user(ts, (u64 __user *)buf + i))
+                return -EFAULT;
+        }
+        *cursor += n;
+        return n * sizeof(u64);
+    }
+
+    static __poll_t pulses_poll(struct file *file, poll_table *wait)
+    {
+        struct pulse_reader *reader = file->private_data;
+
+        poll_wait(file, &reader->data->pulse_wq, wait);
+        if (READ_ONCE(reader->data->gone))
+            return EPOLLHUP | EPOLLERR;
+        if (smp_load_acquire(&reader->data->pulse_ring->head) != reader->cursor)
+            return EPOLLIN | EPOLLRDNORM;
+        return 0;
+    }
+
+    static int pulses_mmap(struct file *file, struct vm_area_struct *vma)
+    {
+        struct pulse_reader *reader = file->private_data;
+
+        if (vma->vm_flags & VM_WRITE)
+            return -EPERM;
+        vm_flags_clear(vma, VM_MAYWRITE);
+        return remap_vmalloc_range(vma, reader->data->pulse_ring, vma->vm_pgoff);
+    }
+
+    static const struct file_operations pulses_fops = {
+        .owner = THIS_MODULE,
+        .open = pulses_open,
+        .release = pulses_release,
+        .read = pulses_read,
+        .poll = pulses_poll,
+        .mmap = pulses_mmap,
+    };
+
+    /* "<base>" for motor 0, "<base><id>" otherwise */
+    static const char *speed_name(struct device *dev, u32 id, const char *base)
+    {
+        if (id == 0)
+            return base;
+        return devm_kasprintf(dev, GFP_KERNEL, "%s%u", base, id);
+    }
 
     static int speed_probe(struct platform_device *pdev)
     {
+        struct speed_data *data;
         struct gpio_desc *speed_status;
         int ret;
         int irq;
-        sensor_state.last_time = 0;
-        sensor_state.rpm = 0;
 
         printk(KERN_INFO "SPEED_TEST: Probe function called! I matched with Device Tree!\n");
 
+        data = kzalloc(sizeof(*data), GFP_KERNEL);
+        if (!data)
+            return -ENOMEM;
+        kref_init(&data->ref);
+        of_property_read_u32(pdev->dev.of_node, "slend,motor-id", &data->id);
+        init_waitqueue_head(&data->pulse_wq);
+
         speed_status = devm_gpiod_get(&pdev->dev, "speed", GPIOD_IN);
         if (IS_ERR(speed_status)) {
             printk(KERN_ERR "SPEED_TEST: Error! Could not find 'speed' GPIO.\n");
-            return PTR_ERR(speed_status);
+            ret = PTR_ERR(speed_status);
+            goto err_put;
         }
         printk(KERN_INFO "SPEED_TEST: Speed GPIO found successfully.\n");
 
         irq = gpiod_to_irq(speed_status);
         if (irq < 0) {
             printk(KERN_ERR "SPEED_TEST: Error! Could not get IRQ number for 'speed' GPIO.\n");
-            return irq;
+            ret = irq;
+            goto err_put;
         }
-        
+
+        sysfs_attr_init(&data->attr.attr);
+        data->attr.attr.name = speed_name(&pdev->dev, data->id, "speed");
+        data->attr.attr.mode = 0444;
+        data->attr.show = show_speed;
+        data->misc.minor = MISC_DYNAMIC_MINOR;
+        data->misc.name = speed_name(&pdev->dev, data->id, "speed_pulses");
+        data->misc.fops = &pulses_fops;
+        data->misc.mode = 0444;
+        data->misc.parent = &pdev->dev;
+        ret = -ENOMEM;
+        if (!data->attr.attr.name || !data->misc.name)
+            goto err_put;
+
+        data->pulse_ring = vmalloc_user(PAGE_ALIGN(sizeof(*data->pulse_ring)));
+        if (!data->pulse_ring)
+            goto err_put;
+        platform_set_drvdata(pdev, data);
+
         printk(KERN_INFO "SPEED_TEST: All systems GREEN. Ready for logic.\n");
 
-        ret = devm_request_irq(&pdev->dev, irq, speed_irq_handler, IRQF_TRIGGER_RISING , "my_speed_irq", NULL);
+        data->irq = irq;
+        /* not devm: it must be gone before remove drops the device's reference */
+        ret = request_irq(irq, speed_irq_handler, IRQF_TRIGGER_RISING, dev_name(&pdev->dev), data);
+        if (ret)
+            goto err_put;
+
+        ret = sysfs_create_file(kernel_kobj, &data->attr.attr);
+        if (ret == 0) {
+            data->attr_created = true;
+            WRITE_ONCE(data->kn, sysfs_get_dirent(kernel_kobj->sd, data->attr.attr.name));
+        }
 
-        ret = sysfs_create_file(kernel_kobj, &speed_attr.attr);
+        ret = misc_register(&data->misc);
+        if (ret)
+            printk(KERN_ERR "SPEED_TEST: Could not register /dev/%s.\n", data->misc.name);
+        data->pulses_registered = (ret == 0);
 
         return 0;
+
+    err_put:
+        kref_put(&data->ref, speed_data_free);
+        return ret;
     }
 
     static void speed_remove(struct platform_device *pdev)
     {
+        struct speed_data *data = platform_get_drvdata(pdev);
+
         printk(KERN_INFO "SPEED_TEST: Driver removed. Goodbye!\n");
-        sysfs_remove_file(kernel_kobj, &speed_attr.attr);
+        /* free_irq() waits for a running handler, which may be in kernfs_notify(kn) */
+        free_irq(data->irq, data);
+        if (data->kn) {
+            sysfs_put(data->kn);
+            WRITE_ONCE(data->kn, NULL);
+        }
+        if (data->attr_created)
+            sysfs_remove_file(kernel_kobj, &data->attr.attr);
+        if (data->pulses_registered)
+            misc_deregister(&data->misc);
+        data->pulses_registered = false;
+        /* open files keep data and the ring; wake their readers to see -ENODEV */
+        WRITE_ONCE(data->gone, true);
+        wake_up_interruptible_all(&data->pulse_wq);
+        kref_put(&data->ref, speed_data_free);
     }
 
     static const struct of_device_id speed_dt_ids[] = {
@@ -0,0 +1,17 @@
+#ifndef SPEED_HOOK_H
+#define SPEED_HOOK_H
+
+#include <linux/types.h>
+
+/*
+ * In-kernel speed feed from speed_driver to motor_driver's trip. fn runs in
+ * the speed IRQ after every pulse with the rpm of the last interval; the
+ * hook is keyed by slend,motor-id, so it can be set before the speed node
+ * probes. motor_driver takes it with symbol_get(), so each module still
+ * loads without the other. fn == NULL removes the hook.
+ */
+typedef void (*speed_hook_fn)(void *ctx, u64 rpm, u64 t_ns);
+
+int speed_hook_set(u32 id, speed_hook_fn fn, void *ctx);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef SPEED_PULSES_H
+#define SPEED_PULSES_H
+
+#include <linux/types.h>
+
+/*
+ * Layout of the pulse ring behind /dev/speed_pulses, shared with userspace.
+ * read() returns __u64 timestamps, mmap() maps this struct read-only.
+ */
+#define SPEED_PULSES_DEV "/dev/speed_pulses"
+#define SPEED_RING_SIZE  4096   /* power of two */
+
+struct speed_pulse_ring {
+    __u64 head;                  /* pulses ever recorded, entry i is ts[i % SPEED_RING_SIZE] */
+    __u64 ts[SPEED_RING_SIZE];   /* CLOCK_MONOTONIC ns of each rising edge */
+};
+
+#endif
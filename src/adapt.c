@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "adapt.h"
+#include "tracepoint.h"
+
+#define ADAPT_WRITE_BATCH 64
+#define ADAPT_IDLE_US 20000
+
+static uint32_t record_crc(const adapt_record *r) {
+    return calib_crc32(r, offsetof(adapt_record, crc));
+}
+
+/* Keeps e within reach of the calibrated b. Returns 1 if it had to. */
+static int clamp_entry(const calib_table *base, const calib_entry *b, calib_entry *e) {
+    int hit = 0;
+
+    for (int c = 0; c < CALIB_CHANNELS; c++) {
+        float s = b->std[c] > base->std_floor[c] ? b->std[c] : base->std_floor[c];
+        float lo = b->mean[c] - ADAPT_MAX_SHIFT * s, hi = b->mean[c] + ADAPT_MAX_SHIFT * s;
+        if (e->mean[c] < lo) { e->mean[c] = lo; hit = 1; }
+        if (e->mean[c] > hi) { e->mean[c] = hi; hit = 1; }
+        if (e->std[c] < ADAPT_STD_MIN * s) { e->std[c] = ADAPT_STD_MIN * s; hit = 1; }
+        if (e->std[c] > ADAPT_STD_MAX * s) { e->std[c] = ADAPT_STD_MAX * s; hit = 1; }
+    }
+    return hit;
+}
+
+static void apply(adapt *a, int d, int p, const float mean[CALIB_CHANNELS], const float std[CALIB_CHANNELS]) {
+    calib_entry *e = &a->cur->entry[d][p];
+    memcpy(e->mean, mean, sizeof(e->mean));
+    memcpy(e->std, std, sizeof(e->std));
+    clamp_entry(a->base, &a->base->entry[d][p], e);
+}
+
+/* adapt.bin of the same calib.bin, if any */
+static void load_table(adapt *a) {
+    if (access(a->table_path, R_OK) < 0) return;
+    const calib_table *t = calib_table_map(a->table_path);
+    if (t == NULL) return;
+    if (t->base_crc == a->base->crc) {
+        for (int d = 0; d < 2; d++)
+            for (int p = 0; p < CALIB_STEPS; p++) apply(a, d, p, t->entry[d][p].mean, t->entry[d][p].std);
+    } else {
+        fprintf(stderr, "%s: from another calibration, starting over\n", a->table_path);
+    }
+    calib_table_unmap(t);
+}
+
+/* Records flushed after the last compaction. A torn tail ends the replay. */
+static void replay_journal(adapt *a) {
+    adapt_record r;
+    int fd = open(a->journal_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    while (read(fd, &r, sizeof(r)) == (ssize_t)sizeof(r)) {
+        if (r.magic != ADAPT_JOURNAL_MAGIC || r.crc != record_crc(&r)) break;
+        if (r.base_crc != a->base->crc || r.dir > 1 || r.pwm >= CALIB_STEPS) continue;
+        apply(a, r.dir, r.pwm, r.mean, r.std);
+        a->replayed++;
+    }
+    close(fd);
+}
+
+static void *adapt_writer(void *arg);
+
+int adapt_open(adapt *a, const calib_table *base, const float warn_z[3], const float err_z[3],
+               const char *table_path, const char *journal_path) {
+    memset(a, 0, sizeof(*a));
+    a->fd = -1;
+    a->base = base;
+    snprintf(a->table_path, sizeof(a->table_path), "%s", table_path);
+    snprintf(a->journal_path, sizeof(a->journal_path), "%s", journal_path);
+    a->cur = malloc(sizeof(*a->cur));
+    a->disk = malloc(sizeof(*a->disk));
+    if (a->cur == NULL || a->disk == NULL) goto fail;
+    *a->cur = *base;
+    memcpy(a->cur->warn_z, warn_z, 3 * sizeof(float));
+    memcpy(a->cur->err_z, err_z, 3 * sizeof(float));
+
+    load_table(a);
+    replay_journal(a);
+    calib_table_finish(a->cur);
+    *a->disk = *a->cur;
+    a->disk->base_crc = base->crc;
+    if (adapt_compact(a) < 0) goto fail;
+    if (pthread_create(&a->thread, NULL, adapt_writer, a) != 0) {
+        perror("adapt writer");
+        goto fail;
+    }
+    a->running = 1;
+    return 0;
+
+fail:
+    if (a->fd >= 0) close(a->fd);
+    a->fd = -1;
+    free(a->cur);
+    free(a->disk);
+    a->cur = a->disk = NULL;
+    return -1;
+}
+
+int adapt_sample(adapt *a, const float x[CALIB_CHANNELS], int dir, int pwm, uint64_t now_ns) {
+    double dt = a->last_ns ? (double)(now_ns - a->last_ns) / 1e9 : 0.0;
+    a->last_ns = now_ns;
+    if (dt <= 0) return 0;
+    /* a gap since the last healthy sample counts as one */
+    if (dt > 1.0) dt = 1.0;
+
+    float alpha = dt / ADAPT_TAU_S;
+    calib_entry *e = &a->cur->entry[dir][pwm];
+    for (int c = 0; c < CALIB_CHANNELS; c++) {
+        float diff = x[c] - e->mean[c], incr = alpha * diff;
+        e->mean[c] += incr;
+        e->std[c] = sqrtf((1 - alpha) * (e->std[c] * e->std[c] + diff * incr));
+    }
+    if (clamp_entry(a->base, &a->base->entry[dir][pwm], e)) a->clamped++;
+    calib_entry_finish(a->cur, e);
+    a->dirty[dir][pwm] = 1;
+    a->updates++;
+    return 1;
+}
+
+/* The writer's side: appends, syncs, and keeps a->disk in step. */
+static void write_records(adapt *a, const adapt_record *r, int n) {
+    ssize_t len = n * (ssize_t)sizeof(*r);
+
+    for (int k = 0; k < n; k++) {
+        calib_entry *e = &a->disk->entry[r[k].dir][r[k].pwm];
+        memcpy(e->mean, r[k].mean, sizeof(e->mean));
+        memcpy(e->std, r[k].std, sizeof(e->std));
+        calib_entry_finish(a->disk, e);
+    }
+    if (write(a->fd, r, len) != len || fdatasync(a->fd) < 0) {
+        a->write_errors++;
+        return;
+    }
+    a->journal_records += n;
+    a->flushed += n;
+}
+
+static void *adapt_writer(void *arg) {
+    adapt *a = arg;
+    adapt_record batch[ADAPT_WRITE_BATCH];
+
+    TP_THREAD("adapt");
+    for (;;) {
+        uint64_t tail = atomic_load_explicit(&a->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&a->head, memory_order_acquire);
+        size_t n = head - tail;
+
+        if (n == 0) {
+            if (atomic_load(&a->stop)) break;
+            usleep(ADAPT_IDLE_US);
+            continue;
+        }
+        if (n > ADAPT_WRITE_BATCH) n = ADAPT_WRITE_BATCH;
+        for (size_t k = 0; k < n; k++) batch[k] = a->ring[(tail + k) & (ADAPT_RING - 1)];
+        atomic_store_explicit(&a->tail, tail + n, memory_order_release);
+
+        TP_BEGIN("adapt_write");
+        write_records(a, batch, n);
+        if (a->journal_records >= ADAPT_COMPACT_RECORDS) adapt_compact(a);
+        TP_END("adapt_write");
+        atomic_store(&a->synced, tail + n);
+    }
+    return NULL;
+}
+
+/* Moves dirty steps into the ring. Returns 0 if it filled up first. */
+static int queue_dirty(adapt *a) {
+    uint64_t head = atomic_load_explicit(&a->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&a->tail, memory_order_acquire);
+    int all = 1;
+
+    for (int d = 0; d < 2 && all; d++) {
+        for (int p = 0; p < CALIB_STEPS; p++) {
+            if (!a->dirty[d][p]) continue;
+            if (head - tail == ADAPT_RING) {
+                all = 0;
+                break;
+            }
+            const calib_entry *e = &a->cur->entry[d][p];
+            adapt_record *r = &a->ring[head++ & (ADAPT_RING - 1)];
+            memset(r, 0, sizeof(*r));
+            r->magic = ADAPT_JOURNAL_MAGIC;
+            r->base_crc = a->base->crc;
+            r->dir = d;
+            r->pwm = p;
+            memcpy(r->mean, e->mean, sizeof(r->mean));
+            memcpy(r->std, e->std, sizeof(r->std));
+            r->crc = record_crc(r);
+            a->dirty[d][p] = 0;
+        }
+    }
+    atomic_store_explicit(&a->head, head, memory_order_release);
+    return all;
+}
+
+static void wait_synced(adapt *a) {
+    uint64_t head = atomic_load_explicit(&a->head, memory_order_relaxed);
+    while (atomic_load(&a->synced) < head) usleep(ADAPT_IDLE_US / 4);
+}
+
+void adapt_flush(adapt *a, uint64_t now_ns, int force) {
+    if (!a->running || (!force && now_ns - a->last_flush_ns < ADAPT_FLUSH_NS)) return;
+    a->last_flush_ns = now_ns;
+    if (!force) {
+        queue_dirty(a);
+        return;
+    }
+    while (!queue_dirty(a)) wait_synced(a);
+    wait_synced(a);
+}
+
+/* Table first: a crash before the truncation replays records the table
+   already holds, which sets the same values again. */
+int adapt_compact(adapt *a) {
+    a->disk->crc = calib_crc32(a->disk->entry, sizeof(a->disk->entry));
+    if (calib_table_write(a->disk, a->table_path) < 0) {
+        a->write_errors++;
+        return -1;
+    }
+    if (a->fd < 0) {
+        a->fd = open(a->journal_path, O_WRONLY | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (a->fd < 0) {
+            perror("File Error adapt.journal");
+            return -1;
+        }
+    } else if (ftruncate(a->fd, 0) < 0) {
+        perror("File Error adapt.journal");
+        a->write_errors++;
+        return -1;
+    }
+    a->journal_records = 0;
+    a->compactions++;
+    return 0;
+}
+
+void adapt_close(adapt *a) {
+    if (a->cur == NULL) return;
+    adapt_flush(a, a->last_ns, 1);
+    atomic_store(&a->stop, 1);
+    pthread_join(a->thread, NULL);
+    a->running = 0;
+    adapt_compact(a);
+    if (a->fd >= 0) close(a->fd);
+    a->fd = -1;
+    free(a->cur);
+    free(a->disk);
+    a->cur = a->disk = NULL;
+}
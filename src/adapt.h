@@ -0,0 +1,87 @@
+#ifndef ADAPT_H
+#define ADAPT_H
+
+/*
+ * Opt-in online baselines (main --adapt). While the detector calls a sample
+ * healthy, the calibration step the motor sits at follows it with an
+ * exponentially weighted mean and variance, so slow drift from warm-up,
+ * load or wear does not need a new calib sweep. Each step stays within
+ * ADAPT_MAX_SHIFT stds of calib.bin and its std within ADAPT_STD_MIN..MAX
+ * times the calibrated one, so a fault that develops slowly can shift the
+ * baseline only so far before it is flagged against it.
+ *
+ * Every ADAPT_FLUSH_NS the changed steps are handed to a writer thread
+ * through an SPSC ring; the loop makes no syscalls for them. The writer
+ * appends them to adapt.journal and fdatasyncs it. When the journal grows
+ * past ADAPT_COMPACT_RECORDS, and on open and close, it is folded into
+ * adapt.bin (a calib.bin-format table, synced before its rename) and
+ * truncated. Both carry the CRC of the calib.bin they adapt; a new
+ * calibration starts over.
+ */
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "calib_table.h"
+
+#define ADAPT_TAU_S             600.0   /* EW time constant while at a step */
+#define ADAPT_MAX_SHIFT         2.0f    /* calibrated stds the mean may move */
+#define ADAPT_STD_MIN           0.5f    /* of the calibrated std */
+#define ADAPT_STD_MAX           2.0f
+#define ADAPT_BIN_TOL           0.25f   /* duty this close to a step feeds it */
+#define ADAPT_FLUSH_NS          5000000000ULL
+#define ADAPT_COMPACT_RECORDS   4096
+#define ADAPT_RING              256     /* records in flight, power of two */
+#define ADAPT_JOURNAL_MAGIC     0x314A4441u     /* "ADJ1" */
+
+/* One journal record: the new mean/std of one step. */
+typedef struct {
+    uint32_t magic;
+    uint32_t base_crc;                  /* of the calib.bin adapted */
+    uint8_t dir, pwm;
+    uint16_t reserved;
+    float mean[CALIB_CHANNELS];
+    float std[CALIB_CHANNELS];
+    uint32_t crc;                       /* CRC-32 of the fields above */
+} adapt_record;
+
+typedef struct {
+    const calib_table *base;
+    calib_table *cur;                   /* adapted, with the detector's sigmas */
+    char table_path[256], journal_path[256];
+    uint8_t dirty[2][CALIB_STEPS];
+    uint64_t last_ns, last_flush_ns;
+    uint64_t updates, clamped, replayed;
+
+    /* loop -> writer */
+    adapt_record ring[ADAPT_RING];
+    _Atomic uint64_t head, tail, synced; /* synced: records on disk */
+    pthread_t thread;
+    atomic_bool stop;
+    int running;
+
+    /* the writer's own */
+    calib_table *disk;                  /* what adapt.bin plus the journal hold */
+    int fd;                             /* journal, O_APPEND */
+    uint32_t journal_records;
+    _Atomic uint64_t flushed, compactions, write_errors;
+} adapt;
+
+/* Loads adapt.bin and replays adapt.journal over base, compacts and starts
+   the writer. warn_z/err_z are the detector's speed, acc, gyro sigmas. */
+int adapt_open(adapt *a, const calib_table *base, const float warn_z[3], const float err_z[3],
+               const char *table_path, const char *journal_path);
+/* One healthy sample at step [dir][pwm]. Returns 1 if the step changed,
+   so the caller reloads it from a->cur. */
+int adapt_sample(adapt *a, const float x[CALIB_CHANNELS], int dir, int pwm, uint64_t now_ns);
+/* Queues the changed steps for the journal once ADAPT_FLUSH_NS have passed.
+   With force always, and waits until the writer has synced them. A step
+   that finds the ring full stays dirty for the next flush. */
+void adapt_flush(adapt *a, uint64_t now_ns, int force);
+/* Writes adapt.bin from a->disk and truncates the journal. Only on the
+   writer, or while it is not running. */
+int adapt_compact(adapt *a);
+/* Flushes, stops the writer, compacts and frees. */
+void adapt_close(adapt *a);
+
+#endif
@@ -5,27 +5,24 @@
 #include <stdatomic.h>  
 #include <stdbool.h>
 #include <string.h>
-#include <fcntl.h>
 #include <termios.h>
 #include <math.h>
+#include <sys/stat.h>
+#include "backend.h"
+#include "rt_sched.h"
+#include "stats.h"
+#include "calib_table.h"
+#include "render.h"
+#include "telemetry.h"
+#include "detector.h"
+#include "motor_ctx.h"
+#include "input.h"
+#include "metrics.h"
+#include "tracepoint.h"
 
-#define HIDE_CURSOR()  printf("\033[?25l")
 #define SHOW_CURSOR()  printf("\033[?25h")
-#define COLOR_RED    "\033[31m"
-#define COLOR_GREEN  "\033[32m"
-#define COLOR_YELLOW "\033[33m"
-#define COLOR_RESET  "\033[0m"
-#define MOTOR_PATH "/home/slend/robot_data/motor"
-#define IMU_PATH   "/home/slend/robot_data/imu"
-#define SPEED_PATH "/home/slend/robot_data/speed"
-#define CALIB_PATH "/home/slend/robot_data/calib.csv"
-
-typedef enum {
-    MOTOR_IDLE = 0,
-    MOTOR_OK = 1,
-    MOTOR_WARNING = 2,
-    MOTOR_ERROR = 3
-} MotorStatus;
+#define SCREEN_ROWS 48
+#define SCREEN_COLS 120
 
 _Atomic MotorStatus motor_status;
 atomic_bool is_running = true;
@@ -35,109 +32,227 @@ typedef struct {
 } Frames;
 
 typedef struct {
-    int pwm;   
-    float speed_mean;
-    float speed_std;
-    float acc_mean;
-    float acc_std;
-    float gyro_mean;
-    float gyro_std;
-    float temp_mean;
-    float temp_std;
-} motor;
-
-motor calib_up[101];
-motor calib_down[101];
-MotorStatus last_sent_status = MOTOR_IDLE;
-pthread_mutex_t print_mutex = PTHREAD_MUTEX_INITIALIZER;
-int start_pwm = 25, grace_period = 20;
+    int speed, power;
+    float grace;                /* seconds left */
+    float acc, gyro, temp;
+    uint8_t speed_attr, acc_attr, gyro_attr, temp_attr;
+    uint8_t status;
+    int speed_mode;
+    float target_rpm, ff, trim;
+    int bands;                  /* 0: no bands.bin, 1: waiting for a window, 2: valid */
+    float band[SPEC_BANDS];
+    uint8_t band_attr;
+    int joint;                  /* cov.bin loaded */
+    float d2;
+    uint8_t d2_attr;
+} ui_motor;
+
+/*
+ * What the renderer shows, published by the control loop once per
+ * iteration through a seqlock: the loop never waits for the terminal.
+ */
+typedef struct {
+    int n_motors, selected;
+    ui_motor m[MAX_MOTORS];
+    int fixed_rate;
+    float loop_ms, late_us;
+    unsigned long long p99_us, misses;
+    float win_mean_ms, win_p99_ms, win_max_ms;
+    unsigned long long log_records, log_dropped;
+    unsigned long long keys, keys_dropped;
+    float key_mean_ms, key_p99_ms, key_max_ms;
+    char msg[64];
+} ui_metrics;
+
+_Atomic unsigned ui_seq;
+ui_metrics ui_snap;
+screen scr;
+
+/* One loop drives all motors; time comes from the first one's backend. */
+motor_ctx motors[MAX_MOTORS];
+int n_motors = 1, selected = 0;
+telemetry tlm[MAX_MOTORS];
+/* Setpoint changes are S-curve ramps at this many %/s in the driver; 0 steps. */
+int ramp_rate = 25;
+/* --rate=<hz> switches the loop from data-driven wake-ups to fixed deadlines */
+int loop_rate = 0, rt_prio = 0, rt_cpu = -1, rt_mlock = 0;
+/* binary telemetry, see log2csv */
+const char *log_dir = ".";
+unsigned log_max_mb = 64, log_rotate_s = 3600;
+int log_compress = 0;
+/* --speed: arrows move an rpm setpoint by --rpm-step instead of the PWM */
+int speed_mode = 0, rpm_step = 10;
+/* driver-side heartbeat timeout (0 = off) and --speed-trip limits */
+unsigned watchdog_ms = 1000;
+int speed_trip = 0;
+/* --adapt: baselines follow healthy running, see adapt.h */
+int adapt_mode = 0;
+/* --metrics=<socket path | port>: Prometheus text, see metrics.h */
+const char *metrics_addr = NULL;
 char current_msg[64] = "";
 
-void send_msg(const char* msg, MotorStatus current_status) {
-    if (current_status != last_sent_status) {
-        last_sent_status = current_status;
-        pthread_mutex_lock(&print_mutex);
-        strncpy(current_msg, msg, sizeof(current_msg) - 1);
-        pthread_mutex_unlock(&print_mutex);
+/* keyboard thread; the stop key is acted on there, not in the loop */
+input kbd;
+atomic_bool stop_requested = false;
+_Atomic uint64_t stop_latency_ns;
+/* key read to set_motor_ramp, per motor the oldest key not yet applied */
+uint64_t key_pending_ns[MAX_MOTORS];
+stats key_lat;
+p2_quantile key_p99;
+
+/* Metric ids. Registered before any thread starts; the loop, the keyboard
+   and the render thread each update their own shard. */
+metrics mx;
+enum { MX_CHANNELS = CALIB_CHANNELS + 1 + SPEC_BANDS };
+static const char *const mx_channel[MX_CHANNELS] = {
+    "speed", "acc", "gyro", "temp", "joint", "band_1x", "band_2x", "band_3_5x", "band_high",
+};
+static const struct { const char *msg, *label; } mx_stop_reason[] = {
+    {"CRITICAL SENSOR FAILURE", "detector"}, {"IMU DATA LOST!", "imu_lost"},
+    {"DRIVER STOPPED THE MOTOR", "driver"}, {"WATCHDOG TRIP", "watchdog"},
+    {"OVERSPEED TRIP", "overspeed"}, {"UNDERSPEED TRIP", "underspeed"},
+};
+#define MX_STOP_REASONS (int)(sizeof(mx_stop_reason) / sizeof(mx_stop_reason[0]))
+typedef struct {
+    int status, speed, duty, d2, sensor, imu_age, grace, grace_s;
+    int anomalies[MX_CHANNELS][2];
+    int stops[MX_STOP_REASONS];
+} mx_motor;
+struct {
+    int period, late, iterations, misses, log_records, log_dropped;
+    int key_latency, keys_dropped, stop_keys, frames, frame_bytes;
+    mx_motor m[MAX_MOTORS];
+} mx_id;
+metrics_shard *mx_loop;
+
+static void metrics_setup(void) {
+    char l[64];
+
+    metrics_init(&mx);
+    mx_id.period = metrics_histogram(&mx, "slenderball_loop_period_seconds", "Control loop wake-to-wake time.", NULL);
+    mx_id.late = metrics_histogram(&mx, "slenderball_loop_lateness_seconds", "Wake-up past the deadline, --rate loops only.", NULL);
+    mx_id.iterations = metrics_counter(&mx, "slenderball_loop_iterations_total", "Control loop iterations.", NULL);
+    mx_id.misses = metrics_counter(&mx, "slenderball_loop_deadline_misses_total", "Periods skipped because an iteration overran.", NULL);
+    mx_id.log_records = metrics_counter(&mx, "slenderball_telemetry_records_total", "Telemetry records pushed.", NULL);
+    mx_id.log_dropped = metrics_counter(&mx, "slenderball_telemetry_dropped_total", "Telemetry records dropped on a full ring.", NULL);
+    mx_id.key_latency = metrics_histogram(&mx, "slenderball_key_latency_seconds", "Key read to setpoint sent.", NULL);
+    mx_id.keys_dropped = metrics_counter(&mx, "slenderball_keys_dropped_total", "Keys dropped on a full input ring.", NULL);
+    mx_id.stop_keys = metrics_counter(&mx, "slenderball_stop_keys_total", "Stop key presses.", NULL);
+    mx_id.frames = metrics_counter(&mx, "slenderball_ui_frames_total", "Terminal frames drawn.", NULL);
+    mx_id.frame_bytes = metrics_counter(&mx, "slenderball_ui_bytes_total", "Bytes written to the terminal.", NULL);
+    for (int k = 0; k < n_motors; k++) {
+        mx_motor *id = &mx_id.m[k];
+        snprintf(l, sizeof(l), "motor=\"%d\"", k);
+        id->status = metrics_gauge(&mx, "slenderball_motor_status", "0 idle, 1 ok, 2 warning, 3 error.", l);
+        id->speed = metrics_gauge(&mx, "slenderball_motor_speed_rpm", "Encoder speed.", l);
+        id->duty = metrics_gauge(&mx, "slenderball_motor_duty_percent", "Duty the driver applies.", l);
+        id->d2 = metrics_gauge(&mx, "slenderball_motor_joint_d2", "Squared Mahalanobis distance, 0 without cov.bin.", l);
+        id->sensor = metrics_histogram(&mx, "slenderball_sensor_read_seconds", "Time reading speed and IMU per iteration.", l);
+        id->imu_age = metrics_gauge(&mx, "slenderball_imu_sample_age_seconds", "Age of the IMU sample scored, -1 if unknown.", l);
+        id->grace = metrics_gauge(&mx, "slenderball_grace_remaining_seconds", "Time left in the grace period.", l);
+        id->grace_s = metrics_counter(&mx, "slenderball_grace_seconds_total", "Time spent in grace periods.", l);
+        for (int c = 0; c < MX_CHANNELS; c++) {
+            snprintf(l, sizeof(l), "motor=\"%d\",channel=\"%s\",level=\"warning\"", k, mx_channel[c]);
+            id->anomalies[c][0] = metrics_counter(&mx, "slenderball_anomalies_total",
+                                                  "Scored iterations at warning or error level.", l);
+            snprintf(l, sizeof(l), "motor=\"%d\",channel=\"%s\",level=\"error\"", k, mx_channel[c]);
+            id->anomalies[c][1] = metrics_counter(&mx, "slenderball_anomalies_total",
+                                                  "Scored iterations at warning or error level.", l);
+        }
+        for (int r = 0; r < MX_STOP_REASONS; r++) {
+            snprintf(l, sizeof(l), "motor=\"%d\",reason=\"%s\"", k, mx_stop_reason[r].label);
+            id->stops[r] = metrics_counter(&mx, "slenderball_emergency_stops_total", "Emergency stops by cause.", l);
+        }
     }
 }
 
-void update_sensor_status(float index, float warn_thresh, float error_thresh, int* error_counter, MotorStatus* out_status, const char** color, const char* warn_msg, const char* error_msg) {
-    if (fabs(index) >= error_thresh) {
-        (*error_counter)++;
-        *out_status = MOTOR_ERROR;
-        *color = COLOR_RED;
-        send_msg(error_msg, MOTOR_ERROR);
-    } else if (fabs(index) >= warn_thresh) {
-        *error_counter = 0;
-        *out_status = MOTOR_WARNING;
-        *color = COLOR_YELLOW;
-        send_msg(warn_msg, MOTOR_WARNING);
-    } else {
-        *error_counter = 0;
-        *out_status = MOTOR_OK;
-        *color = COLOR_RESET;
-        send_msg("                                          ", MOTOR_OK);
-    }
+static void metrics_motor(const motor_ctx *m, double period_s) {
+    const mx_motor *id = &mx_id.m[m->id];
+
+    metrics_set(mx_loop, id->status, m->status);
+    metrics_set(mx_loop, id->speed, m->speed);
+    metrics_set(mx_loop, id->duty, m->duty);
+    metrics_set(mx_loop, id->d2, m->out.d2);
+    metrics_observe_ns(mx_loop, id->sensor, m->sensor_ns);
+    metrics_set(mx_loop, id->imu_age, m->imu_age_ns < 0 ? -1.0 : m->imu_age_ns / 1e9);
+    metrics_set(mx_loop, id->grace, m->det.grace > 0 ? m->det.grace : 0);
+    if (m->det.grace > 0) metrics_add(mx_loop, id->grace_s, period_s);
+    /* out.msg is only set when the detector scored this iteration */
+    if (m->out.msg == NULL || m->trip) return;
+    for (int c = 0; c < CALIB_CHANNELS; c++)
+        if (m->out.level[c]) metrics_add(mx_loop, id->anomalies[c][m->out.level[c] - 1], 1);
+    if (m->out.joint_level) metrics_add(mx_loop, id->anomalies[CALIB_CHANNELS][m->out.joint_level - 1], 1);
+    for (int b = 0; b < SPEC_BANDS; b++)
+        if (m->out.band_level[b])
+            metrics_add(mx_loop, id->anomalies[CALIB_CHANNELS + 1 + b][m->out.band_level[b] - 1], 1);
 }
 
-void emergency_stop(FILE *f_motor, const char *reason) {
-    motor_status = MOTOR_ERROR;
-    send_msg(reason, MOTOR_ERROR);
-    fprintf(f_motor, "s000");
-    fflush(f_motor);
+/* Only the control thread writes current_msg; the renderer sees it via ui_snap. */
+void motor_msg(const motor_ctx *m, const char *msg) {
+    if (n_motors > 1) snprintf(current_msg, sizeof(current_msg), "M%d: %s", m->id, msg);
+    else snprintf(current_msg, sizeof(current_msg), "%s", msg);
 }
 
-void read_calibration(){
-    FILE *f_calib = fopen(CALIB_PATH, "r");
-    if (!f_calib) { perror("File Error Calib"); return; }
-    char line[128], dir[8];
-    int pwm;
-    fgets(line, sizeof(line), f_calib);
-    fgets(line, sizeof(line), f_calib);
-    while (fgets(line, sizeof(line), f_calib) != NULL) {
-        motor m;
-        sscanf(line, "%d,%7[^,],%f,%f,%f,%f,%f,%f,%f,%f",
-            &pwm, dir,
-            &m.speed_mean, &m.speed_std,
-            &m.acc_mean,   &m.acc_std,
-            &m.gyro_mean,  &m.gyro_std,
-            &m.temp_mean,  &m.temp_std);
-        m.pwm = pwm;
-        if (strcmp(dir, "up") == 0)
-            calib_up[pwm] = m;
-        else if (strcmp(dir, "down") == 0)
-            calib_down[pwm] = m;
-    }
-    fclose(f_calib);
-    FILE *f_meta = fopen("/home/slend/robot_data/motor_meta.csv", "r");
-    if (f_meta) {
-        fscanf(f_meta, "start_pwm,%d", &start_pwm);
-        fclose(f_meta);
-    }
+void ui_publish(ui_metrics *m) {
+    unsigned seq = atomic_load_explicit(&ui_seq, memory_order_relaxed);
+    strncpy(m->msg, current_msg, sizeof(m->msg) - 1);
+    m->msg[sizeof(m->msg) - 1] = '\0';
+    m->n_motors = n_motors;
+    m->selected = selected;
+    for (int k = 0; k < n_motors; k++)
+        m->m[k].grace = motors[k].det.grace > 0 ? motors[k].det.grace : 0;
+    atomic_store_explicit(&ui_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&ui_snap, m, sizeof(*m));
+    atomic_store_explicit(&ui_seq, seq + 2, memory_order_release);
 }
 
-int kbhit(void) {
-    struct termios oldt, newt;
-    int ch, oldf;
-
-    tcgetattr(STDIN_FILENO, &oldt);
-    newt = oldt;
-    newt.c_lflag &= ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-    oldf = fcntl(STDIN_FILENO, F_GETFL, 0);
-    fcntl(STDIN_FILENO, F_SETFL, oldf | O_NONBLOCK);
-    ch = getchar();
+static void ui_read(ui_metrics *out) {
+    unsigned s1, s2;
+    do {
+        s1 = atomic_load_explicit(&ui_seq, memory_order_acquire);
+        memcpy(out, (const void *)&ui_snap, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        s2 = atomic_load_explicit(&ui_seq, memory_order_relaxed);
+    } while ((s1 & 1) || s1 != s2);
+}
 
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-    fcntl(STDIN_FILENO, F_SETFL, oldf);
+static const uint8_t level_attr[3] = {ATTR_DEFAULT, ATTR_YELLOW, ATTR_RED};
 
-    if(ch != EOF) {
-        ungetc(ch, stdin);
-        return 1;
-    }
+/* A failure on one motor stops all of them. */
+void emergency_stop(motor_ctx *failed, const char *reason) {
+    for (int r = 0; r < MX_STOP_REASONS; r++)
+        if (strcmp(reason, mx_stop_reason[r].msg) == 0) metrics_add(mx_loop, mx_id.m[failed->id].stops[r], 1);
+    motor_status = MOTOR_ERROR;
+    for (int k = 0; k < n_motors; k++)
+        motor_ctx_stop(&motors[k], &motors[k] == failed ? MOTOR_ERROR : MOTOR_IDLE, reason);
+    motor_msg(failed, reason);
+}
 
-    return 0;
+static void ui_fill_motor(ui_motor *u, const motor_ctx *m) {
+    u->speed = m->speed;
+    u->power = m->pwm;
+    u->acc = m->out.filtered_acc;
+    u->gyro = m->out.filtered_gyro;
+    u->temp = m->temp;
+    u->speed_attr = level_attr[m->out.level[CAL_SPEED]];
+    u->acc_attr = level_attr[m->out.level[CAL_ACC]];
+    u->gyro_attr = level_attr[m->out.level[CAL_GYRO]];
+    u->temp_attr = level_attr[m->out.level[CAL_TEMP]];
+    u->status = m->status;
+    u->speed_mode = m->speed_mode;
+    u->target_rpm = m->target_rpm;
+    u->ff = m->ctl.ff;
+    u->trim = m->ctl.trim;
+    u->bands = m->bands == NULL ? 0 : m->spec.valid ? 2 : 1;
+    memcpy(u->band, m->spec.band, sizeof(u->band));
+    int worst = 0;
+    for (int b = 0; b < SPEC_BANDS; b++)
+        if (m->out.band_level[b] > worst) worst = m->out.band_level[b];
+    u->band_attr = level_attr[worst];
+    u->joint = m->cov != NULL;
+    u->d2 = m->out.d2;
+    u->d2_attr = level_attr[m->out.joint_level];
 }
 
 char* load_frame_to_ram(const char* filename) {
@@ -155,331 +270,439 @@ char* load_frame_to_ram(const char* filename) {
     return buffer;
 }
 
-void smart_update(const char *old_frame, const char *new_frame, const char* color) {
-    int row = 1, col = 1;
-    for (int i = 0; new_frame[i] != '\0' && old_frame[i] != '\0'; i++) {
-        if (new_frame[i] == '\n') {
-            row++; col = 1; continue;
+/* Input thread: latch a stop on every motor before the loop sees the key. */
+static void on_stop_key(void *arg, uint64_t t_ns) {
+    static metrics_shard *shard;
+    (void)arg;
+    if (shard == NULL) shard = metrics_thread(&mx);
+    metrics_add(shard, mx_id.stop_keys, 1);
+    for (int k = 0; k < n_motors; k++) backend_emergency_stop(motors[k].be);
+    atomic_store(&stop_latency_ns, input_now_ns() - t_ns);
+    atomic_store(&stop_requested, true);
+}
+
+/* Applies queued keys; returns 1 once the stop key came through. */
+static int apply_keys(void) {
+    input_cmd c;
+
+    while (input_pop(&kbd, &c)) {
+        motor_ctx *m = &motors[selected];
+        switch (c.type) {
+        case INPUT_STOP:
+            return 1;
+        case INPUT_SELECT:
+            if (c.arg < n_motors) selected = c.arg;
+            break;
+        case INPUT_NEXT:
+            selected = (selected + 1) % n_motors;
+            break;
+        case INPUT_UP:
+        case INPUT_DOWN: {
+            int sign = c.type == INPUT_UP ? 1 : -1;
+            if (speed_mode) motor_ctx_set_speed(m, m->target_rpm + sign * rpm_step);
+            else motor_ctx_change(m, sign * 5);
+            if (key_pending_ns[selected] == 0) key_pending_ns[selected] = c.t_ns;
+            break;
         }
-        if (new_frame[i] != old_frame[i]) {
-            printf("\033[%d;%dH%s%c%s", row, col, color, new_frame[i], COLOR_RESET);
         }
-        col++;
     }
+    return atomic_load(&stop_requested);
 }
 
+static uint8_t status_attr(MotorStatus status) {
+    if (status == MOTOR_OK) return ATTR_GREEN;
+    if (status == MOTOR_WARNING) return ATTR_YELLOW;
+    if (status == MOTOR_ERROR) return ATTR_RED;
+    return ATTR_DEFAULT;
+}
 
-void* animation_thread(void* arg) {
+/* The only thread that writes to the terminal while the loop runs. */
+void* render_thread(void* arg) {
     Frames* frames = (Frames*)arg;
-    const char *color = COLOR_GREEN, *last_color = color;
-    int i = 0;
+    ui_metrics m;
+    int tick = 0;
+    metrics_shard *shard = metrics_thread(&mx);
 
-    printf("\033[2J");
-    HIDE_CURSOR(); 
-    printf("\033[H%s%s%s", color, frames->f1, COLOR_RESET);
-    fflush(stdout);
+    TP_THREAD("render");
 
+    if (screen_init(&scr, STDOUT_FILENO, SCREEN_ROWS, SCREEN_COLS) < 0) return NULL;
     while (atomic_load(&is_running)) {
-        pthread_mutex_lock(&print_mutex);
-        MotorStatus current_status = atomic_load(&motor_status);
-        if (current_status == MOTOR_IDLE) color = COLOR_RESET;
-        else if (current_status == MOTOR_OK) color = COLOR_GREEN;
-        else if (current_status == MOTOR_WARNING) color = COLOR_YELLOW;
-        else if (current_status == MOTOR_ERROR) color = COLOR_RED;
-
-        if (color != last_color) {
-            printf("\033[H%s%s%s", color, (i % 2 == 0) ? frames->f1 : frames->f2, COLOR_RESET);
-            last_color = color;
-        } else {
-            if (i % 2 == 0) smart_update(frames->f2, frames->f1, color);
-            else smart_update(frames->f1, frames->f2, color);
-        }
         MotorStatus status = atomic_load(&motor_status);
-        const char *msg_color;
-        if (status == MOTOR_WARNING) msg_color = COLOR_YELLOW;
-        else if (status == MOTOR_ERROR) msg_color = COLOR_RED;
-        else msg_color = COLOR_RESET;
-        
-        printf("\033[44;70H\033[K\033[1m%s[ GRACE PERIOD: %-3d ]%s\033[0m", msg_color, grace_period > 0 ? grace_period : 0, COLOR_RESET);
-        printf("\033[45;70H\033[K\033[1m%s[ MESSAGE     ]%s\033[0m", msg_color, COLOR_RESET);
-        printf("\033[46;70H\033[K\033[1m%s%-42s%s\033[0m", msg_color, current_msg, COLOR_RESET);
-        
-        fflush(stdout);
-        i++;
-        pthread_mutex_unlock(&print_mutex);
-        usleep(500000);
+        uint8_t msg_attr = ATTR_BOLD | (status == MOTOR_WARNING ? ATTR_YELLOW : status == MOTOR_ERROR ? ATTR_RED : ATTR_DEFAULT);
+
+        TP_BEGIN("compose");
+        ui_read(&m);
+        const ui_motor *sel = &m.m[m.selected];
+        screen_clear(&scr);
+        /* the art alternates every 500 ms, the rest refreshes at 10 Hz */
+        screen_put(&scr, 1, 1, status_attr(status), (tick / 5) % 2 == 0 ? frames->f1 : frames->f2);
+
+        if (m.n_motors > 1)
+            screen_printf(&scr, 10, 50, ATTR_BOLD, "[ SYSTEM METRICS: MOTOR %d/%d ]", m.selected, m.n_motors);
+        else
+            screen_put(&scr, 10, 50, ATTR_BOLD, "[ SYSTEM METRICS ]");
+        screen_printf(&scr, 12, 50, ATTR_BOLD | sel->speed_attr, "SPEED     : %d", sel->speed);
+        screen_printf(&scr, 14, 50, ATTR_BOLD | sel->acc_attr, "VIB ACCEL : %.4f", sel->acc);
+        screen_printf(&scr, 15, 50, ATTR_BOLD | sel->gyro_attr, "VIB GYRO  : %.4f", sel->gyro);
+        if (sel->bands == 2)
+            screen_printf(&scr, 16, 50, ATTR_BOLD | sel->band_attr, "BANDS (g) : 1x %.4f 2x %.4f 3-5x %.4f hi %.4f",
+                          sel->band[BAND_1X], sel->band[BAND_2X], sel->band[BAND_HARM], sel->band[BAND_HIGH]);
+        else if (sel->bands == 1)
+            screen_put(&scr, 16, 50, ATTR_DEFAULT, "BANDS (g) : waiting for a window");
+        screen_printf(&scr, 17, 50, ATTR_BOLD | sel->temp_attr, "TEMP      : %.2f °C", sel->temp);
+        if (sel->joint)
+            screen_printf(&scr, 18, 50, ATTR_BOLD | sel->d2_attr, "JOINT D2  : %.1f", sel->d2);
+        if (sel->speed_mode)
+            screen_printf(&scr, 19, 50, ATTR_DEFAULT, "POWER: %d  TARGET: %.0f rpm (ff %.1f, trim %+.1f)",
+                          sel->power, sel->target_rpm, sel->ff, sel->trim);
+        else
+            screen_printf(&scr, 19, 50, ATTR_DEFAULT, "POWER: %d", sel->power);
+        if (m.fixed_rate)
+            screen_printf(&scr, 21, 50, ATTR_DEFAULT, "LOOP : %.1f ms, late %.0f us (p99 < %llu us), miss %llu",
+                          m.loop_ms, m.late_us, m.p99_us, m.misses);
+        else
+            screen_printf(&scr, 21, 50, ATTR_DEFAULT, "LOOP : %.1f ms (1 s: mean %.1f, p99 %.1f, max %.1f)",
+                          m.loop_ms, m.win_mean_ms, m.win_p99_ms, m.win_max_ms);
+        screen_printf(&scr, 23, 50, ATTR_DEFAULT, "TERM : %zu B last frame, %.0f B/frame avg",
+                      scr.last_bytes, scr.frames ? (double)scr.bytes / scr.frames : 0.0);
+        screen_printf(&scr, 24, 50, m.log_dropped ? ATTR_YELLOW : ATTR_DEFAULT, "LOG  : %llu records, %llu dropped",
+                      m.log_records, m.log_dropped);
+        screen_printf(&scr, 25, 50, m.keys_dropped ? ATTR_YELLOW : ATTR_DEFAULT,
+                      "KEYS : %llu, to motor mean %.2f ms, p99 %.2f, max %.2f, %llu dropped",
+                      m.keys, m.key_mean_ms, m.key_p99_ms, m.key_max_ms, m.keys_dropped);
+
+        /* one row per motor; digits or Tab pick the one the arrows drive */
+        if (m.n_motors > 1) {
+            screen_put(&scr, 26, 50, ATTR_BOLD, "   MOTOR  POWER  SPEED  ACCEL   GYRO    TEMP");
+            for (int k = 0; k < m.n_motors; k++) {
+                const ui_motor *u = &m.m[k];
+                screen_printf(&scr, 27 + k, 50, status_attr(u->status) | (k == m.selected ? ATTR_BOLD : 0),
+                              "%s %5d  %5d  %5d  %.3f  %5.2f  %6.2f", k == m.selected ? ">" : " ",
+                              k, u->power, u->speed, u->acc, u->gyro, u->temp);
+            }
+        }
+
+        screen_printf(&scr, 44, 70, msg_attr, "[ GRACE PERIOD: %4.1f s ]", sel->grace);
+        screen_put(&scr, 45, 70, msg_attr, "[ MESSAGE     ]");
+        screen_printf(&scr, 46, 70, msg_attr, "%-42s", m.msg);
+
+        TP_END("compose");
+        TP_BEGIN("flush");
+        screen_flush(&scr);
+        TP_END("flush");
+        metrics_set(shard, mx_id.frames, scr.frames);
+        metrics_set(shard, mx_id.frame_bytes, scr.bytes);
+        tick++;
+        usleep(100000);
     }
     return NULL;
 }
 
-int main() {
+/* Starts one telemetry writer per motor; motor n > 0 logs to <dir>/motor<n>. */
+static void start_logs(void) {
+    static char dirs[MAX_MOTORS][256];
+
+    for (int k = 0; k < n_motors; k++) {
+        if (k == 0) snprintf(dirs[k], sizeof(dirs[k]), "%s", log_dir);
+        else {
+            snprintf(dirs[k], sizeof(dirs[k]), "%s/motor%d", log_dir, k);
+            mkdir(dirs[k], 0755);
+        }
+        telemetry_start(&tlm[k], dirs[k], (uint64_t)log_max_mb << 20, log_rotate_s, log_compress);
+    }
+}
+
+/* Brings every follower's clock up to the first motor's. */
+static void sync_motors(void) {
+    uint64_t now = backend_now_ns(motors[0].be);
+    for (int k = 1; k < n_motors; k++) backend_sync_ns(motors[k].be, now);
+}
+
+int main(int argc, char **argv) {
     struct termios orig_termios, new_termios;
     tcgetattr(STDIN_FILENO, &orig_termios);
     new_termios = orig_termios;
     new_termios.c_lflag &= ~(ICANON | ECHO);
     tcsetattr(STDIN_FILENO, TCSANOW, &new_termios);
 
+    for (int a = 1; a < argc; a++) {
+        if (strncmp(argv[a], "--ramp=", 7) == 0) ramp_rate = atoi(argv[a] + 7);
+        else if (strncmp(argv[a], "--rate=", 7) == 0) loop_rate = atoi(argv[a] + 7);
+        else if (strncmp(argv[a], "--rt-prio=", 10) == 0) rt_prio = atoi(argv[a] + 10);
+        else if (strncmp(argv[a], "--cpu=", 6) == 0) rt_cpu = atoi(argv[a] + 6);
+        else if (strcmp(argv[a], "--mlock") == 0) rt_mlock = 1;
+        else if (strncmp(argv[a], "--log-dir=", 10) == 0) log_dir = argv[a] + 10;
+        else if (strncmp(argv[a], "--log-max-mb=", 13) == 0) log_max_mb = atoi(argv[a] + 13);
+        else if (strncmp(argv[a], "--log-rotate=", 13) == 0) log_rotate_s = atoi(argv[a] + 13);
+        else if (strcmp(argv[a], "--log-compress") == 0) log_compress = 1;
+        else if (strncmp(argv[a], "--motors=", 9) == 0) n_motors = atoi(argv[a] + 9);
+        else if (strcmp(argv[a], "--speed") == 0) speed_mode = 1;
+        else if (strncmp(argv[a], "--rpm-step=", 11) == 0) rpm_step = atoi(argv[a] + 11);
+        else if (strncmp(argv[a], "--watchdog=", 11) == 0) watchdog_ms = atoi(argv[a] + 11);
+        else if (strcmp(argv[a], "--speed-trip") == 0) speed_trip = 1;
+        else if (strcmp(argv[a], "--adapt") == 0) adapt_mode = 1;
+        else if (strncmp(argv[a], "--metrics=", 10) == 0) metrics_addr = argv[a] + 10;
+    }
+    if (n_motors < 1 || n_motors > MAX_MOTORS) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &orig_termios);
+        fprintf(stderr, "--motors must be 1..%d\n", MAX_MOTORS);
+        return 1;
+    }
+
+    metrics_setup();
+    mx_loop = metrics_thread(&mx);
+    TP_START("main-trace");
+    TP_THREAD("loop");
     Frames frames;
     frames.f1 = load_frame_to_ram("art_1.txt");
     frames.f2 = load_frame_to_ram("art_2.txt");
-    FILE *f_log = fopen("log.csv", "a");
-    MotorStatus local_status = MOTOR_IDLE;
     if (!frames.f1 || !frames.f2) return 1;
     pthread_t ui_thread_id;
-    if (pthread_create(&ui_thread_id, NULL, animation_thread, &frames) != 0) {
+    if (pthread_create(&ui_thread_id, NULL, render_thread, &frames) != 0) {
         printf("Thread creation error!\n");
         return 1;
     }
-    read_calibration();
-    
-    float acc_vib, gyro_vib, temp, speed_index = 0.0, acc_index = 0.0, gyro_index = 0.0, temp_index = 0.0,
-        ambient_acc = 0.0, ambient_gyro = 0.0, ambient_data[3] = {0.0, 0.0, 0.0};
-    int speed, i=0, temp_error_time = 0, gyro_error_time = 0, acc_error_time = 0, speed_error_time = 0;
-    char dir = 's', command_buffer[16], line_buffer[128];
-    static bool going_up = true, motor_running = false;
-    FILE *f_motor = fopen(MOTOR_PATH, "w");
-    const char *speed_color = COLOR_RESET, *acc_vib_color = COLOR_RESET, 
-        *gyro_vib_color = COLOR_RESET, *temp_color = COLOR_RESET;
-    MotorStatus temp_status = MOTOR_OK;
-    
-    if (f_motor == NULL) {
-        perror("File Error Motor");
-        return 1;
+    detector_params params;
+    detector_default_params(&params);
+    for (int k = 0; k < n_motors; k++) {
+        backend *mb = backend_from_args(argc, argv, k);
+        if (mb == NULL || motor_ctx_open(&motors[k], k, mb, &params) < 0) {
+            if (mb) backend_close(mb);
+            while (k-- > 0) {
+                backend_close(motors[k].be);
+                motor_ctx_close(&motors[k]);
+            }
+            atomic_store(&is_running, false);
+            pthread_join(ui_thread_id, NULL);
+            tcsetattr(STDIN_FILENO, TCSANOW, &orig_termios);
+            SHOW_CURSOR();
+            return 1;
+        }
     }
+    for (int k = 0; k < n_motors; k++) {
+        motors[k].speed_mode = speed_mode;
+        if ((watchdog_ms || speed_trip) && motor_ctx_guard(&motors[k], watchdog_ms, speed_trip) < 0)
+            motor_msg(&motors[k], "No driver watchdog, using the loop only");
+        if (adapt_mode && motor_ctx_adapt(&motors[k]) < 0)
+            motor_msg(&motors[k], "No adaptive baselines, using calib.bin");
+    }
+    if (metrics_addr && metrics_serve(&mx, metrics_addr) < 0)
+        snprintf(current_msg, sizeof(current_msg), "No metrics endpoint on %s", metrics_addr);
+    backend *be = motors[0].be, *bes[MAX_MOTORS];
+    for (int k = 0; k < n_motors; k++) bes[k] = motors[k].be;
+    start_logs();
+    stats_reset(&key_lat);
+    p2_init(&key_p99, 0.99);
+    if (input_start(&kbd, STDIN_FILENO, on_stop_key, NULL) < 0)
+        snprintf(current_msg, sizeof(current_msg), "No keyboard thread, 's' will not work");
+    
+    ui_metrics ui = {0};
+    stats loop_win;
+    p2_quantile loop_p99;
+    rt_sched rs;
+    uint64_t last_iter_ns, loop_period_ns = 0;
     
-    usleep(1000000);
+    backend_sleep_us(be, 1000000);
+    sync_motors();
     motor_status = MOTOR_OK;
     
-    for (int i = 0; i < 50; i++)
+    for (int i = 0; i < 50 && !atomic_load(&stop_requested); i++)
     {
-        FILE *f_imu = fopen(IMU_PATH, "r");
-        if (f_imu) {
-            char temp_buf[128];
-            line_buffer[0] = '\0';
-            while(fgets(temp_buf, sizeof(temp_buf), f_imu) != NULL) {
-                 if(strlen(temp_buf) > 5) {
-                    strncpy(line_buffer, temp_buf, sizeof(line_buffer) - 1);
-                    line_buffer[sizeof(line_buffer) - 1] = '\0';
-                 }
-            }
-            if (strlen(line_buffer) == 0) {
-                acc_vib = gyro_vib = temp = 0;
-            }
-            line_buffer[strcspn(line_buffer, "\n")] = 0;
-            int items = sscanf(line_buffer, "%f|%f|%f", &acc_vib, &gyro_vib, &temp);
-            if (items < 3) {
-                acc_vib = 0; gyro_vib = 0; temp = 0;
-            }
-            ambient_data[0] +=acc_vib;
-            ambient_data[1] +=gyro_vib;
-            ambient_data[2] +=temp;
-            fclose(f_imu);
-            usleep(100000);
-            if (i%10==0)
-            {
-                printf("Calibrating IMU... %d%%\n", 5-(i+1)/10);
-                fflush(stdout);
+        int lost = 0;
+        for (int k = 0; k < n_motors; k++) {
+            if (motor_ctx_ambient(&motors[k]) < 0) {
+                motor_status = MOTOR_ERROR;
+                motor_msg(&motors[k], "IMU DATA LOST!");
+                lost = 1;
             }
-            
-        }else {
-            motor_status = MOTOR_ERROR;
-            send_msg("IMU DATA LOST!\n", MOTOR_ERROR);
+        }
+        if (lost) {
+            ui_publish(&ui);
             continue;
         }
+        backend_sleep_us(be, 100000);
+        sync_motors();
+        if (i%10==0)
+        {
+            snprintf(current_msg, sizeof(current_msg), "Calibrating IMU... %d s", 5-(i+1)/10);
+            ui_publish(&ui);
+        }
     } 
-    ambient_acc = ambient_data[0]/50.0;
-    ambient_gyro = ambient_data[1]/50.0;
-    printf("Entering main loop\n");
-    fflush(stdout);
+    for (int k = 0; k < n_motors; k++) motor_ctx_ambient_done(&motors[k]);
+    snprintf(current_msg, sizeof(current_msg), "Entering main loop");
+    ui_publish(&ui);
+    if ((rt_prio > 0 || rt_cpu >= 0 || rt_mlock) && rt_setup(rt_prio, rt_cpu, rt_mlock) < 0) {
+        snprintf(current_msg, sizeof(current_msg), "RT setup refused, running best effort");
+    }
+    rt_sched_init(&rs, be, loop_rate);
+    last_iter_ns = backend_now_ns(be);
+    /* loop period statistics over the current 1 s window */
+    stats_reset(&loop_win);
+    p2_init(&loop_p99, 0.99);
+    uint64_t win_start_ns = last_iter_ns;
+    double win_mean_ms = 0, win_max_ms = 0, win_p99_ms = 0;
 
     while (1)
     {   
-        if (i<0) i=0;
-        if (i>100) i=100;
-
-        if (i==0){
-            motor_running = false;
-        }
-        else if(i>0 && !motor_running) {
-            if (i < start_pwm) i = start_pwm;
-            if (speed > 5) motor_running = true;
-        }
-        else if (motor_running && !going_up && i < start_pwm) {
-            i = 0;
-            motor_running = false;
-            rewind(f_motor);
-            
-            fprintf(f_motor, "s000");
-            fflush(f_motor);
+        motor_ctx *stopped = NULL;
+        MotorStatus worst = MOTOR_IDLE;
+        int quit = 0;
+
+        TP_BEGIN("iteration");
+        TP_BEGIN("apply_keys");
+        int stop_key = apply_keys();
+        TP_END("apply_keys");
+        if (stop_key) {
+            motor_status = MOTOR_IDLE;
+            break;
         }
-       
-        motor *active_calib = going_up ? calib_up : calib_down;
-        if (i>0) dir = 'f';
-        else dir = 's';
-        snprintf(command_buffer, sizeof(command_buffer), "%c%03d", dir, i);
-        rewind(f_motor);
-        fprintf(f_motor, "%s", command_buffer);
-        fflush(f_motor);
-
-        FILE *f_speed = fopen(SPEED_PATH, "r");
-        if (f_speed) {
-            if (fgets(line_buffer, sizeof(line_buffer), f_speed) != NULL) {
-                speed = (int)strtol(line_buffer, NULL, 10);
+        for (int k = 0; k < n_motors; k++) {
+            motor_ctx *m = &motors[k];
+            TP_BEGIN("motor_step");
+            int r = motor_ctx_step(m, ramp_rate);
+            TP_END("motor_step");
+
+            if (key_pending_ns[k]) {
+                uint64_t ns = input_now_ns() - key_pending_ns[k];
+                double ms = ns / 1e6;
+                metrics_observe_ns(mx_loop, mx_id.key_latency, ns);
+                stats_add(&key_lat, ms);
+                p2_add(&key_p99, ms);
+                key_pending_ns[k] = 0;
             }
-            fclose(f_speed);
-        } else {
-            speed = 0;
-        }
 
-        FILE *f_imu = fopen(IMU_PATH, "r");
-        if (f_imu) {
-            char temp_buf[128];
-            line_buffer[0] = '\0';
-            while(fgets(temp_buf, sizeof(temp_buf), f_imu) != NULL) {
-                 if(strlen(temp_buf) > 5) {
-                    strncpy(line_buffer, temp_buf, sizeof(line_buffer) - 1);
-                    line_buffer[sizeof(line_buffer) - 1] = '\0';
-                 }
-            }
-            if (strlen(line_buffer) == 0) {
-                acc_vib = gyro_vib = temp = 0;
-            }
-            
-            line_buffer[strcspn(line_buffer, "\n")] = 0;
-            int items = sscanf(line_buffer, "%f|%f|%f", &acc_vib, &gyro_vib, &temp);
-            acc_vib -= ambient_acc;
-            gyro_vib -= ambient_gyro;
-            if (items < 3) {
-                acc_vib = 0; gyro_vib = 0; temp = 0;
+            if (r < 0) {
+                emergency_stop(m, "IMU DATA LOST!");
+                quit = 1;
+                break;
             }
-            fclose(f_imu);
+            if (m->event) motor_msg(m, m->event);
+            if (r > 0 && stopped == NULL) stopped = m;
+            if (m->status > worst) worst = m->status;
+            ui_fill_motor(&ui.m[k], m);
+            metrics_motor(m, loop_period_ns / 1e9);
         }
-        else {
-            emergency_stop(f_motor, "IMU DATA LOST!");
-            break;
+        if (quit) break;
+        motor_status = worst;
+
+        ui.fixed_rate = loop_rate > 0;
+        ui.loop_ms = loop_period_ns / 1e6;
+        ui.late_us = rs.last_late_ns / 1e3;
+        ui.p99_us = (unsigned long long)rt_sched_percentile(&rs, 0.99) / 1000;
+        ui.misses = rs.misses;
+        ui.win_mean_ms = win_mean_ms;
+        ui.win_p99_ms = win_p99_ms;
+        ui.win_max_ms = win_max_ms;
+        ui.keys = key_lat.n;
+        ui.keys_dropped = atomic_load_explicit(&kbd.dropped, memory_order_relaxed);
+        ui.key_mean_ms = key_lat.mean;
+        ui.key_p99_ms = p2_value(&key_p99);
+        ui.key_max_ms = key_lat.n ? key_lat.max : 0;
+        TP_BEGIN("ui_publish");
+        ui.log_records = ui.log_dropped = 0;
+        for (int k = 0; k < n_motors; k++) {
+            ui.log_records += tlm[k].seq;
+            ui.log_dropped += atomic_load_explicit(&tlm[k].dropped, memory_order_relaxed);
         }
-        static float filtered_acc = 0;
-        filtered_acc = 0.9 * filtered_acc + 0.1 * acc_vib;
-        static float filtered_gyro = 0;
-        filtered_gyro = 0.9 * filtered_gyro + 0.1 * gyro_vib;
-
-        float safe_speed = active_calib[i].speed_std;
-        if (safe_speed < 0.1f) safe_speed = 0.1f;
-        float safe_acc = active_calib[i].acc_std;
-        if (safe_acc < 0.01f) safe_acc = 0.01f;
-        float safe_gyro = active_calib[i].gyro_std;
-        if (safe_gyro < 0.01f) safe_gyro = 0.01f;
-        float safe_temp = active_calib[i].temp_std;
-        if (safe_temp < 0.5f) safe_temp = 0.5f;
-
-        speed_index = (speed - active_calib[i].speed_mean) / safe_speed;
-        acc_index = (filtered_acc - active_calib[i].acc_mean) / safe_acc;
-        gyro_index = (filtered_gyro - active_calib[i].gyro_mean) / safe_gyro;
-        temp_index = (temp - active_calib[i].temp_mean) / safe_temp;
-
-        
-
-        if (grace_period > 0) {
-            grace_period--;
-            speed_error_time = acc_error_time = gyro_error_time = temp_error_time = 0;
-        } else {
-            printf("\033[43;1H\033[K"); 
-            fflush(stdout);
-
-            update_sensor_status(speed_index, 2.0, 3.0, &speed_error_time, &local_status, &speed_color,
-                                "Speed out of safe range!", "Speed critically high!");
-            update_sensor_status(acc_index, 2.5, 4.0, &acc_error_time, &local_status, &acc_vib_color,
-                                "ACC out of safe range!", "ACC critically!");
-            update_sensor_status(gyro_index, 2.5, 4.0, &gyro_error_time, &local_status, &gyro_vib_color,
-                                "GYRO out of safe range!",  "GYRO critical!");
-            if (temp >= 70 || temp <= 0) {
-                temp_error_time++;
-                temp_status = MOTOR_ERROR;
-                temp_color = COLOR_RED;
-                send_msg("ERROR TEMPERATURE! IMMEDIATE STOP!", MOTOR_ERROR);
-            } else if ((temp >= 50 && temp < 70) || (temp > 0 && temp <= 10)) {
-                temp_error_time = 0;
-                temp_status = MOTOR_WARNING;
-                temp_color = COLOR_YELLOW;
-                send_msg("Temperature out of safe range!", MOTOR_WARNING);
-            } else {
-                temp_error_time = 0;
-                temp_status = MOTOR_OK;
-                temp_color = COLOR_RESET;
-                send_msg("                                          ", MOTOR_OK);
-            }
+        ui_publish(&ui);
+        TP_END("ui_publish");
 
-            if (local_status == MOTOR_ERROR || temp_status == MOTOR_ERROR) motor_status = MOTOR_ERROR;
-            else if (local_status == MOTOR_WARNING || temp_status == MOTOR_WARNING) motor_status = MOTOR_WARNING;
-            else motor_status = MOTOR_OK;
-        }
-        
-
-        printf("\033[10;50H\033[K\033[1m[ SYSTEM METRICS ]\033[0m");        
-        printf("\033[12;50H\033[K\033[1mSPEED     : %s%d\033[0m", speed_color,speed);
-        printf("\033[14;50H\033[K\033[1mVIB ACCEL : %s%.4f\033[0m", acc_vib_color, filtered_acc);
-        printf("\033[15;50H\033[K\033[1mVIB GYRO  : %s%.4f\033[0m", gyro_vib_color, filtered_gyro);    
-        printf("\033[17;50H\033[K\033[1mTEMP      : %s%.2f °C\033[0m", temp_color, temp);
-        printf("\033[19;50H\033[KPOWER: %d", i);
-        fflush(stdout);
-
-        if (speed_error_time >= 20 || acc_error_time >= 10 || gyro_error_time >= 10 || temp_error_time >= 10) {
-            emergency_stop(f_motor, "CRITICAL SENSOR FAILURE");
-            usleep(5000000);
+        if (stopped) {
+            emergency_stop(stopped, stopped->trip ? stopped->trip : "CRITICAL SENSOR FAILURE");
+            ui_publish(&ui);
+            backend_sleep_us(be, 5000000);
             break; 
         }
         
-        if (kbhit()) {
-            char c = getchar();
-            if (c == 's' || c == 'S' || c == ' ' ) {
-                fprintf(f_motor, "s000");
-                fflush(f_motor);
-                atomic_store(&is_running, false);
-                motor_status = MOTOR_IDLE;
-                break;
-            }
-            if (c == '\033' ) {
-                char c1 = getchar();
-                char c2 = getchar();
-                if (c1 == '[' ) {
-                    if (c2 =='A')
-                    {
-                        i=i+5;
-                        going_up = true;
-                        grace_period = 5;
-                    }
-                    else if (c2 =='B')
-                    {
-                        i=i-5;
-                        going_up = false;
-                        grace_period = 5;
-                    }                    
-                }
-            }
+        TP_BEGIN("telemetry_push");
+        for (int k = 0; k < n_motors; k++) {
+            const motor_ctx *m = &motors[k];
+            telemetry_record rec = {
+                .t_ns = last_iter_ns, .pwm = m->pwm, .status = m->status, .dir = m->dir,
+                .duty = m->duty, .speed = m->speed, .acc = m->acc, .gyro = m->gyro, .temp = m->temp,
+                .z = {m->out.z[0], m->out.z[1], m->out.z[2], m->out.z[3]},
+                .period_us = loop_period_ns / 1e3, .late_us = loop_rate > 0 ? rs.last_late_ns / 1e3 : 0.0,
+                .target_rpm = m->speed_mode ? m->target_rpm : 0,
+            };
+            telemetry_push(&tlm[k], &rec);
+        }
+        TP_END("telemetry_push");
+        TP_END("iteration");
+        TP_BEGIN("wait");
+        if (loop_rate > 0) rt_sched_wait(&rs);
+        /* wakes on each pulse or IMU sample of any motor, so the period
+           varies; the detector times its windows itself (detector.h) */
+        else backend_wait_any(bes, n_motors, 300000);
+        TP_END("wait");
+        sync_motors();
+        loop_period_ns = backend_now_ns(be) - last_iter_ns;
+        last_iter_ns += loop_period_ns;
+        metrics_observe_ns(mx_loop, mx_id.period, loop_period_ns);
+        metrics_add(mx_loop, mx_id.iterations, 1);
+        if (loop_rate > 0) {
+            metrics_observe_ns(mx_loop, mx_id.late, rs.last_late_ns > 0 ? rs.last_late_ns : 0);
+            metrics_set(mx_loop, mx_id.misses, rs.misses);
+        }
+        metrics_set(mx_loop, mx_id.log_records, ui.log_records);
+        metrics_set(mx_loop, mx_id.log_dropped, ui.log_dropped);
+        metrics_set(mx_loop, mx_id.keys_dropped, ui.keys_dropped);
+        stats_add(&loop_win, loop_period_ns / 1e6);
+        p2_add(&loop_p99, loop_period_ns / 1e6);
+        if (last_iter_ns - win_start_ns >= 1000000000ULL) {
+            win_mean_ms = loop_win.mean;
+            win_max_ms = loop_win.max;
+            win_p99_ms = p2_value(&loop_p99);
+            stats_reset(&loop_win);
+            p2_init(&loop_p99, 0.99);
+            win_start_ns = last_iter_ns;
         }
-        fprintf(f_log,"%d,%d,%.3f,%.3f,%.3f,%.3f,%d\n",
-            i,
-            speed,
-            speed_index,
-            acc_index,
-            gyro_index,
-            temp_index,
-            motor_status);
-        fflush(f_log);
-        usleep(300000);
     }
+    /* before any join, which can take a while: a setpoint the loop sent
+       around a stop key must not keep a motor running meanwhile */
+    for (int k = 0; k < n_motors; k++) backend_set_motor(motors[k].be, 's', 0);
     atomic_store(&is_running, false);
     pthread_join(ui_thread_id, NULL);
+    input_stop(&kbd);
+    metrics_stop(&mx);
     tcsetattr(STDIN_FILENO, TCSANOW, &orig_termios);
-    fprintf(f_motor, "s000");
-    fflush(f_motor);
-    fclose(f_motor);
-    fclose(f_log);
+    unsigned long long log_written = 0, log_files = 0, log_dropped = 0;
+    for (int k = 0; k < n_motors; k++) {
+        backend_set_motor(motors[k].be, 's', 0);
+        backend_close(motors[k].be);
+        telemetry_stop(&tlm[k]);
+        log_written += tlm[k].written;
+        log_files += tlm[k].files;
+        log_dropped += atomic_load(&tlm[k].dropped);
+    }
     free(frames.f1);
     printf("\033[2J\033[H\033[?25h");
     fflush(stdout);
     system("reset");
     SHOW_CURSOR();
+    if (loop_rate > 0) rt_sched_report(&rs, stdout);
+    printf("Terminal: %llu frames, %.0f bytes/frame\n", (unsigned long long)scr.frames,
+           scr.frames ? (double)scr.bytes / scr.frames : 0.0);
+    screen_free(&scr);
+    printf("Telemetry: %llu records in %llu files, %llu dropped\n", log_written, log_files, log_dropped);
+    printf("Keys: %ld applied, key to motor mean %.2f ms, p99 %.2f ms, max %.2f ms, %llu dropped\n",
+           key_lat.n, key_lat.mean, p2_value(&key_p99), key_lat.n ? key_lat.max : 0.0,
+           (unsigned long long)atomic_load(&kbd.dropped));
+    if (atomic_load(&stop_requested))
+        printf("Stop key: motors stopped %.3f ms after the key was read\n", atomic_load(&stop_latency_ns) / 1e6);
+    for (int k = 0; k < n_motors; k++) {
+        const spectrum *sp = &motors[k].spec;
+        if (motors[k].bands)
+            printf("Spectrum M%d: %llu windows (%s FFT, n=%d), %.1f us mean, %.1f us max, %llu gaps\n",
+                   k, (unsigned long long)sp->windows, fft_impl(), sp->p.n, sp->compute_us.mean,
+                   sp->compute_us.n ? sp->compute_us.max : 0.0, (unsigned long long)sp->gaps);
+        const adapt *ad = motors[k].adapt;
+        if (ad)
+            printf("Adapt M%d: %llu updates, %llu clamped, %llu replayed, %llu journaled, %llu compactions, %llu write errors\n",
+                   k, (unsigned long long)ad->updates, (unsigned long long)ad->clamped,
+                   (unsigned long long)ad->replayed, (unsigned long long)ad->flushed,
+                   (unsigned long long)ad->compactions, (unsigned long long)ad->write_errors);
+        motor_ctx_close(&motors[k]);
+    }
     free(frames.f2);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <sys/ioctl.h>
+#include "backend.h"
+#include "pulse_stats.h"
+
+#define ENCODER_HOLES    20
+/* Speed is averaged over the encoder edges of the last 250 ms */
+#define PULSE_WINDOW_NS  250000000ULL
+
+/*
+ * Sensor files stay open for the whole run and are re-read with pread() at
+ * offset 0: sysfs regenerates the attribute on every read from the start,
+ * and the IMU daemon rewrites its file in place. The loop sleeps in poll()
+ * on the speed driver (each edge on /dev/speed_pulses, else sysfs_notify()
+ * on the speed attribute) and on the daemon's notify FIFO.
+ * When the daemon's shared-memory segment exists, IMU samples come from
+ * there and the text file is only a fallback. Likewise speed is computed from
+ * the driver's pulse ring when /dev/speed_pulses is available, and motor
+ * commands go through the /dev/motor ioctl instead of ASCII sysfs writes.
+ */
+typedef struct {
+    FILE *f_motor;
+    int fd_stop;            /* own descriptor of the motor file for emergency_stop */
+    atomic_int estop;
+    int fd_motor;
+    int fd_speed;
+    int fd_imu;
+    int fd_notify;
+    const imu_shm *shm;
+    uint64_t shm_cursor;
+    uint64_t shm_lost;
+    pulse_source pulses;
+} hw_state;
+
+static void hw_attach_shm(hw_state *s, int motor) {
+    s->shm = imu_shm_attach(motor);
+    if (s->shm) s->shm_cursor = imu_shm_head(s->shm);
+}
+
+char *motor_data_path(char *buf, size_t len, int motor, const char *name) {
+    const char *dir = getenv("MOTOR_DATA_DIR");
+
+    if (motor == 0) snprintf(buf, len, "%s/%s", dir ? dir : ROBOT_DATA_DIR, name);
+    else snprintf(buf, len, "%s/motor%d/%s", dir ? dir : ROBOT_DATA_DIR, motor, name);
+    return buf;
+}
+
+char *data_path(char *buf, size_t len, const char *name) {
+    return motor_data_path(buf, len, 0, name);
+}
+
+char *motor_dev_path(char *buf, size_t len, const char *dev, int motor) {
+    if (motor == 0) snprintf(buf, len, "%s", dev);
+    else snprintf(buf, len, "%s%d", dev, motor);
+    return buf;
+}
+
+static int hw_send(hw_state *s, char dir, int pwm, int profile, int rate) {
+    char command_buffer[16];
+
+    if (s->fd_motor >= 0) {
+        struct motor_cmd mc = { .dir = (uint8_t)dir, .profile = (uint8_t)profile,
+                                .target = (uint16_t)pwm, .rate = (uint32_t)rate };
+        return ioctl(s->fd_motor, MOTOR_IOC_SET, &mc);
+    }
+
+    snprintf(command_buffer, sizeof(command_buffer), "%c%03d", dir, pwm);
+    rewind(s->f_motor);
+    fprintf(s->f_motor, "%s", command_buffer);
+    return fflush(s->f_motor);
+}
+
+/* emergency_stop sets estop before its own stop command. One that lands
+   between the check and the send would be overridden by this command, so
+   estop is checked again once it is sent and the stop repeated. */
+static int hw_set_motor_ramp(backend *b, char dir, int pwm, int profile, int rate) {
+    hw_state *s = b->priv;
+
+    if (atomic_load(&s->estop)) return hw_send(s, 's', 0, MOTOR_RAMP_STEP, 0);
+    int ret = hw_send(s, dir, pwm, profile, rate);
+    if (dir != 's' && atomic_load(&s->estop)) return hw_send(s, 's', 0, MOTOR_RAMP_STEP, 0);
+    return ret;
+}
+
+static int hw_set_motor(backend *b, char dir, int pwm) {
+    return hw_set_motor_ramp(b, dir, pwm, MOTOR_RAMP_STEP, 0);
+}
+
+/* Only /dev/motor reports the duty of the running PWM period. */
+static int hw_read_duty(backend *b, float *pwm) {
+    hw_state *s = b->priv;
+    struct motor_state ms;
+
+    if (s->fd_motor < 0 || ioctl(s->fd_motor, MOTOR_IOC_GET, &ms) < 0) return -1;
+    *pwm = ms.duty * 100.0f / MOTOR_DUTY_MAX;
+    return 0;
+}
+
+static uint64_t hw_now_ns(backend *b);
+
+static int hw_read_speed(backend *b, int *speed) {
+    hw_state *s = b->priv;
+    char line_buffer[32];
+    pulse_stats ps;
+
+    if (s->pulses.ring && pulse_window(&s->pulses, hw_now_ns(b), PULSE_WINDOW_NS, ENCODER_HOLES, &ps) == 0) {
+        *speed = (int)lrintf(ps.rpm);
+        return 0;
+    }
+
+    if (s->fd_speed < 0) {
+        char path[MOTOR_PATH_MAX];
+        s->fd_speed = open(motor_data_path(path, sizeof(path), b->motor, "speed"), O_RDONLY | O_CLOEXEC);
+    }
+    ssize_t n = s->fd_speed < 0 ? -1 : pread(s->fd_speed, line_buffer, sizeof(line_buffer) - 1, 0);
+    if (n < 0) {
+        *speed = 0;
+        return -1;
+    }
+    if (n > 0) {
+        line_buffer[n] = '\0';
+        *speed = (int)strtol(line_buffer, NULL, 10);
+    }
+    return 0;
+}
+
+int imu_parse_text(char *buf, imu_sample *out) {
+    /* Last line longer than 5 chars; anything shorter is a half-written sample. */
+    char *line = NULL;
+    for (char *p = buf; *p; ) {
+        size_t len = strcspn(p, "\n");
+        if (len > 5) line = p;
+        p += len;
+        if (*p) *p++ = '\0';
+    }
+    out->t_ns = 0;
+    if (!line || sscanf(line, "%f|%f|%f", &out->acc, &out->gyro, &out->temp) < 3) {
+        out->acc = out->gyro = out->temp = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static int hw_read_imu(backend *b, imu_sample *out) {
+    hw_state *s = b->priv;
+    char buf[128];
+    imu_record rec;
+
+    if (s->shm && imu_shm_latest(s->shm, &rec) == 0) {
+        out->acc = rec.acc;
+        out->gyro = rec.gyro;
+        out->temp = rec.temp;
+        out->t_ns = rec.t_ns;
+        return 0;
+    }
+    if (s->fd_imu < 0) {
+        char path[MOTOR_PATH_MAX];
+        s->fd_imu = open(motor_data_path(path, sizeof(path), b->motor, "imu"), O_RDONLY | O_CLOEXEC);
+    }
+    if (s->fd_imu < 0) return -1;
+    ssize_t n = pread(s->fd_imu, buf, sizeof(buf) - 1, 0);
+    if (n < 0) return -1;
+    buf[n] = '\0';
+    imu_parse_text(buf, out);
+    return 0;
+}
+
+static size_t hw_read_imu_records(backend *b, imu_record *out, size_t max) {
+    hw_state *s = b->priv;
+    if (!s->shm) return 0;
+    return imu_shm_read_since(s->shm, &s->shm_cursor, out, max, &s->shm_lost);
+}
+
+/*
+ * With the pulse ring mapped, speed is never read from the sysfs attribute,
+ * and kernfs keeps a notified attribute readable until it is read again:
+ * polled, it would wake every poll() from then on. So the ring's own fd is
+ * polled instead (POLLIN per edge, drained after the wake), and the
+ * attribute only without it, read back after each wake.
+ */
+static int hw_poll_fds(backend *b, struct pollfd *pfd) {
+    hw_state *s = b->priv;
+    int n = 0;
+
+    if (s->pulses.ring) pfd[n++] = (struct pollfd){ .fd = s->pulses.fd, .events = POLLIN };
+    else if (s->fd_speed >= 0) pfd[n++] = (struct pollfd){ .fd = s->fd_speed, .events = POLLPRI };
+    if (s->fd_notify >= 0) pfd[n++] = (struct pollfd){ .fd = s->fd_notify, .events = POLLIN };
+    return n;
+}
+
+static void hw_poll_done(backend *b, const struct pollfd *pfd, int n) {
+    hw_state *s = b->priv;
+    char drain[64];
+
+    for (int i = 0; i < n; i++) {
+        if (!pfd[i].revents) continue;
+        if (s->pulses.ring && pfd[i].fd == s->pulses.fd) {
+            /* speed_driver unbound: it stays hung up, stop polling it */
+            if (pfd[i].revents & (POLLHUP | POLLERR | POLLNVAL)) pulse_close(&s->pulses);
+            else pulse_drain(&s->pulses);
+        } else if (pfd[i].fd == s->fd_speed) {
+            if (pread(s->fd_speed, drain, sizeof(drain), 0) < 0) {
+                /* hw_read_speed reports it */
+            }
+        } else if (pfd[i].fd == s->fd_notify && (pfd[i].revents & POLLIN)) {
+            while (read(s->fd_notify, drain, sizeof(drain)) == (ssize_t)sizeof(drain));
+            /* the daemon is alive, so its segment should exist by now */
+            if (!s->shm) hw_attach_shm(s, b->motor);
+        }
+    }
+}
+
+static int hw_wait_data(backend *b, unsigned int timeout_us) {
+    struct pollfd pfd[BACKEND_MAX_FDS];
+    int n = hw_poll_fds(b, pfd);
+
+    int ret = poll(pfd, n, (int)((timeout_us + 999) / 1000));
+    if (ret <= 0) return 0;
+    hw_poll_done(b, pfd, n);
+    return 1;
+}
+
+int backend_wait_any(backend *const *bs, int n, unsigned int timeout_us) {
+    struct pollfd pfd[MAX_MOTORS * BACKEND_MAX_FDS];
+    int first[MAX_MOTORS + 1], total = 0;
+
+    if (n > MAX_MOTORS) n = MAX_MOTORS;
+    for (int k = 0; k < n; k++) {
+        first[k] = total;
+        int got = bs[k]->poll_fds ? bs[k]->poll_fds(bs[k], pfd + total) : -1;
+        if (got < 0) return backend_wait_data(bs[0], timeout_us);
+        total += got;
+    }
+    first[n] = total;
+    int ret = poll(pfd, total, (int)((timeout_us + 999) / 1000));
+    if (ret <= 0) return 0;
+    for (int k = 0; k < n; k++) bs[k]->poll_done(bs[k], pfd + first[k], first[k + 1] - first[k]);
+    return 1;
+}
+
+static uint64_t hw_now_ns(backend *b) {
+    struct timespec ts;
+    (void)b;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void hw_sleep_us(backend *b, unsigned int us) {
+    (void)b;
+    usleep(us);
+}
+
+static void hw_sleep_until_ns(backend *b, uint64_t t_ns) {
+    struct timespec ts = { .tv_sec = t_ns / 1000000000ULL, .tv_nsec = t_ns % 1000000000ULL };
+    (void)b;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+static void hw_sync_ns(backend *b, uint64_t t_ns) {
+    (void)b;
+    (void)t_ns;
+}
+
+/* One ioctl or one write(), no stdio: the loop thread may be inside
+   hw_set_motor_ramp on the same motor. */
+static void hw_emergency_stop(backend *b) {
+    hw_state *s = b->priv;
+    struct motor_cmd mc = { .dir = 's', .profile = MOTOR_RAMP_STEP };
+
+    atomic_store(&s->estop, 1);
+    if (s->fd_motor >= 0 && ioctl(s->fd_motor, MOTOR_IOC_SET, &mc) == 0) return;
+    if (s->fd_stop >= 0 && pwrite(s->fd_stop, "s000", 4, 0) == 4) return;
+    perror("emergency stop");
+}
+
+/* The guard belongs to fd_motor: closing it, even by crashing, stops the motor. */
+static int hw_set_guard(backend *b, const struct motor_guard *g) {
+    hw_state *s = b->priv;
+
+    if (s->fd_motor < 0) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    return ioctl(s->fd_motor, MOTOR_IOC_GUARD, g);
+}
+
+static int hw_read_trip(backend *b) {
+    hw_state *s = b->priv;
+    struct motor_state ms;
+
+    if (s->fd_motor < 0 || ioctl(s->fd_motor, MOTOR_IOC_GET, &ms) < 0) return MOTOR_TRIP_NONE;
+    return ms.trip;
+}
+
+static void hw_close(backend *b) {
+    hw_state *s = b->priv;
+    fclose(s->f_motor);
+    if (s->fd_stop >= 0) close(s->fd_stop);
+    if (s->fd_motor >= 0) close(s->fd_motor);
+    if (s->fd_speed >= 0) close(s->fd_speed);
+    if (s->fd_imu >= 0) close(s->fd_imu);
+    if (s->fd_notify >= 0) close(s->fd_notify);
+    if (s->shm) imu_shm_detach(s->shm);
+    pulse_close(&s->pulses);
+    free(s);
+    free(b);
+}
+
+backend *backend_hw_open(int motor) {
+    backend *b = calloc(1, sizeof(*b));
+    hw_state *s = calloc(1, sizeof(*s));
+    char path[MOTOR_PATH_MAX];
+    if (!b || !s) { free(b); free(s); return NULL; }
+
+    s->f_motor = fopen(motor_data_path(path, sizeof(path), motor, "motor"), "w");
+    if (s->f_motor == NULL) {
+        perror("File Error Motor");
+        free(b); free(s);
+        return NULL;
+    }
+    s->fd_stop = open(path, O_WRONLY | O_CLOEXEC);
+    s->fd_motor = open(motor_dev_path(path, sizeof(path), MOTOR_DEV, motor), O_RDWR | O_CLOEXEC);
+    s->fd_speed = open(motor_data_path(path, sizeof(path), motor, "speed"), O_RDONLY | O_CLOEXEC);
+    s->fd_imu = open(motor_data_path(path, sizeof(path), motor, "imu"), O_RDONLY | O_CLOEXEC);
+    /* O_RDWR so the FIFO never reports POLLHUP while the daemon restarts */
+    s->fd_notify = open(motor_dev_path(path, sizeof(path), IMU_NOTIFY_PATH, motor), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    hw_attach_shm(s, motor);
+    pulse_open(&s->pulses, motor_dev_path(path, sizeof(path), SPEED_PULSES_DEV, motor));
+
+    b->name = "hw";
+    b->set_motor = hw_set_motor;
+    b->set_motor_ramp = hw_set_motor_ramp;
+    b->read_duty = hw_read_duty;
+    b->read_speed = hw_read_speed;
+    b->read_imu = hw_read_imu;
+    b->read_imu_records = hw_read_imu_records;
+    b->wait_data = hw_wait_data;
+    b->poll_fds = hw_poll_fds;
+    b->poll_done = hw_poll_done;
+    b->now_ns = hw_now_ns;
+    b->sleep_us = hw_sleep_us;
+    b->sleep_until_ns = hw_sleep_until_ns;
+    b->sync_ns = hw_sync_ns;
+    b->emergency_stop = hw_emergency_stop;
+    b->set_guard = hw_set_guard;
+    b->read_trip = hw_read_trip;
+    b->close = hw_close;
+    b->motor = motor;
+    b->priv = s;
+    return b;
+}
+
+backend *backend_open(const char *spec, int motor) {
+    if (spec == NULL || spec[0] == '\0' || strcmp(spec, "hw") == 0)
+        return backend_hw_open(motor);
+    if (strncmp(spec, "sim", 3) == 0 && (spec[3] == '\0' || spec[3] == ':'))
+        return backend_sim_open(spec[3] == ':' ? spec + 4 : "", motor);
+    fprintf(stderr, "Unknown backend '%s'\n", spec);
+    return NULL;
+}
+
+backend *backend_from_args(int argc, char **argv, int motor) {
+    const char *spec = getenv("MOTOR_BACKEND"), *own = NULL;
+    char key[24];
+    int len = snprintf(key, sizeof(key), "--backend%d=", motor);
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--backend=", 10) == 0) spec = argv[i] + 10;
+        else if (strncmp(argv[i], key, len) == 0) own = argv[i] + len;
+    }
+    return backend_open(own ? own : spec, motor);
+}
@@ -0,0 +1,116 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <poll.h>
+#include "imu_shm.h"
+#include "../drivers/motor_ioctl.h"
+
+#define ROBOT_DATA_DIR "/home/slend/robot_data"
+/* FIFO the IMU daemon writes one byte into per published sample */
+#define IMU_NOTIFY_PATH "/tmp/imu_notify"
+#define MAX_MOTORS 8
+#define MOTOR_PATH_MAX 256          /* data_path() and friends */
+#define BACKEND_MAX_FDS 2           /* poll_fds() entries per backend */
+
+typedef struct {
+    float acc;
+    float gyro;
+    float temp;
+    uint64_t t_ns;      /* acquisition on the now_ns() clock, 0 if unknown */
+} imu_sample;
+
+/*
+ * Everything the control app and the calibration tool need from the outside
+ * world. "hw" talks to the sysfs/IMU files on the board, "sim" runs a DC motor
+ * plant on a virtual clock so whole runs finish in seconds on a dev box.
+ * A backend drives one motor; motor n > 0 uses /dev/motor<n>,
+ * /dev/speed_pulses<n>, the IMU segment of read_mcu -m <n> and the files
+ * in the motor<n>/ subdirectory of the data dir.
+ */
+typedef struct backend backend;
+struct backend {
+    const char *name;
+    int      (*set_motor)(backend *b, char dir, int pwm);
+    /* Ramps to pwm at rate %/s with a motor_ramp_profile; re-sending the
+       current setpoint leaves a running ramp alone. */
+    int      (*set_motor_ramp)(backend *b, char dir, int pwm, int profile, int rate);
+    /* Duty applied right now in %, fractional while a ramp runs; -1 if unknown. */
+    int      (*read_duty)(backend *b, float *pwm);
+    int      (*read_speed)(backend *b, int *speed);
+    int      (*read_imu)(backend *b, imu_sample *out);
+    /* Every IMU record published since the previous call, oldest first. */
+    size_t   (*read_imu_records)(backend *b, imu_record *out, size_t max);
+    /* Sleeps until a sensor has fresh data (1) or timeout_us passes (0). */
+    int      (*wait_data)(backend *b, unsigned int timeout_us);
+    /* wait_data split up for backend_wait_any(): the descriptors it sleeps
+       on (at most BACKEND_MAX_FDS, NULL hook if it sleeps on a clock of its
+       own), then what to consume once poll() filled in their revents. */
+    int      (*poll_fds)(backend *b, struct pollfd *pfd);
+    void     (*poll_done)(backend *b, const struct pollfd *pfd, int n);
+    uint64_t (*now_ns)(backend *b);
+    void     (*sleep_us)(backend *b, unsigned int us);
+    /* Sleeps until an absolute time on the backend's now_ns() clock. */
+    void     (*sleep_until_ns)(backend *b, uint64_t t_ns);
+    /* A loop serving several motors sleeps on the first one's clock and
+       brings the others up to it with this, without pacing. hw motors all
+       share CLOCK_MONOTONIC, so it does nothing there. */
+    void     (*sync_ns)(backend *b, uint64_t t_ns);
+    /* Stops the motor at once; safe to call from any thread while another
+       one runs the loop. The stop latches: until close, every later command
+       is turned into a stop, so a loop iteration in flight cannot restart
+       the motor. */
+    void     (*emergency_stop)(backend *b);
+    /* Arms the driver's watchdog and speed trip (struct motor_guard) for as
+       long as the backend is open; -1 if the driver has none. Once tripped,
+       drive commands fail with EIO until a stop. */
+    int      (*set_guard)(backend *b, const struct motor_guard *g);
+    /* enum motor_trip latched in the driver, MOTOR_TRIP_NONE if unknown. */
+    int      (*read_trip)(backend *b);
+    void     (*close)(backend *b);
+    int motor;
+    void *priv;
+};
+
+/* spec: NULL or "hw" for the board, "sim[:key=val,...]" for the plant */
+backend *backend_open(const char *spec, int motor);
+/* Picks the spec from --backend<motor>=<spec>, then --backend=<spec>, then
+   $MOTOR_BACKEND. */
+backend *backend_from_args(int argc, char **argv, int motor);
+backend *backend_hw_open(int motor);
+backend *backend_sim_open(const char *opts, int motor);
+
+/* wait_data over the n backends of a multi-motor loop: one poll() on all of
+   their descriptors, so each motor's data wakes it. If one has no poll_fds
+   hook, waits on bs[0] alone (sim motors run on its clock, see sync_ns). */
+int backend_wait_any(backend *const *bs, int n, unsigned int timeout_us);
+
+/* Path of a file in the robot data dir, overridable with $MOTOR_DATA_DIR,
+   written to buf (MOTOR_PATH_MAX is always enough) and returned. */
+char *data_path(char *buf, size_t len, const char *name);
+/* Same in the motor's subdirectory; motor 0 lives in the data dir itself. */
+char *motor_data_path(char *buf, size_t len, int motor, const char *name);
+/* Device node of a motor: dev for motor 0, dev<n> otherwise. */
+char *motor_dev_path(char *buf, size_t len, const char *dev, int motor);
+/* Newest "acc|gyro|temp" line of the daemon's text file, in place. On a
+   torn or missing line out is zeroed and -1 returned. */
+int imu_parse_text(char *buf, imu_sample *out);
+
+static inline int backend_set_motor(backend *b, char dir, int pwm) { return b->set_motor(b, dir, pwm); }
+static inline int backend_set_motor_ramp(backend *b, char dir, int pwm, int profile, int rate) { return b->set_motor_ramp(b, dir, pwm, profile, rate); }
+static inline int backend_read_duty(backend *b, float *pwm) { return b->read_duty(b, pwm); }
+static inline int backend_read_speed(backend *b, int *speed) { return b->read_speed(b, speed); }
+static inline int backend_read_imu(backend *b, imu_sample *out) { return b->read_imu(b, out); }
+static inline size_t backend_read_imu_records(backend *b, imu_record *out, size_t max) { return b->read_imu_records(b, out, max); }
+static inline int backend_wait_data(backend *b, unsigned int timeout_us) { return b->wait_data(b, timeout_us); }
+static inline uint64_t backend_now_ns(backend *b) { return b->now_ns(b); }
+static inline void backend_sleep_us(backend *b, unsigned int us) { b->sleep_us(b, us); }
+static inline void backend_sleep_until_ns(backend *b, uint64_t t_ns) { b->sleep_until_ns(b, t_ns); }
+static inline void backend_sync_ns(backend *b, uint64_t t_ns) { b->sync_ns(b, t_ns); }
+static inline void backend_emergency_stop(backend *b) { b->emergency_stop(b); }
+static inline int backend_set_guard(backend *b, const struct motor_guard *g) { return b->set_guard(b, g); }
+static inline int backend_read_trip(backend *b) { return b->read_trip(b); }
+static inline void backend_close(backend *b) { b->close(b); }
+
+#endif
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "calib_table.h"
+
+/* The monitor's floors and thresholds: speed, acc, gyro, temp. */
+static const float default_std_floor[CALIB_CHANNELS] = {0.1f, 0.01f, 0.01f, 0.5f};
+static const float default_warn_z[CALIB_CHANNELS] = {2.0f, 2.5f, 2.5f, 2.0f};
+static const float default_err_z[CALIB_CHANNELS] = {3.0f, 4.0f, 4.0f, 3.0f};
+
+static const char *dir_label[2] = {"up", "down"};
+
+uint32_t calib_crc32(const void *data, size_t len) {
+    const uint8_t *p = data;
+    uint32_t crc = 0xFFFFFFFFu;
+    while (len--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+    }
+    return ~crc;
+}
+
+void calib_table_init(calib_table *t) {
+    memset(t, 0, sizeof(*t));
+    t->magic = CALIB_BIN_MAGIC;
+    t->version = CALIB_BIN_VERSION;
+    t->header_size = offsetof(calib_table, entry);
+    t->entry_size = sizeof(calib_entry);
+    t->steps = CALIB_STEPS;
+    t->channels = CALIB_CHANNELS;
+    memcpy(t->std_floor, default_std_floor, sizeof(t->std_floor));
+    memcpy(t->warn_z, default_warn_z, sizeof(t->warn_z));
+    memcpy(t->err_z, default_err_z, sizeof(t->err_z));
+}
+
+void calib_entry_finish(const calib_table *t, calib_entry *e) {
+    for (int c = 0; c < CALIB_CHANNELS; c++) {
+        float s = e->std[c] > t->std_floor[c] ? e->std[c] : t->std_floor[c];
+        e->inv_std[c] = 1.0f / s;
+        e->warn_lo[c] = e->mean[c] - t->warn_z[c] * s;
+        e->warn_hi[c] = e->mean[c] + t->warn_z[c] * s;
+        e->err_lo[c] = e->mean[c] - t->err_z[c] * s;
+        e->err_hi[c] = e->mean[c] + t->err_z[c] * s;
+    }
+}
+
+void calib_table_finish(calib_table *t) {
+    for (int d = 0; d < 2; d++)
+        for (int p = 0; p < CALIB_STEPS; p++) calib_entry_finish(t, &t->entry[d][p]);
+    t->crc = calib_crc32(t->entry, sizeof(t->entry));
+}
+
+/* Makes a rename into path's directory durable. */
+static void sync_dir(const char *path) {
+    char dir[256];
+    const char *slash = strrchr(path, '/');
+
+    if (slash == NULL) snprintf(dir, sizeof(dir), ".");
+    else snprintf(dir, sizeof(dir), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+    fsync(fd);
+    close(fd);
+}
+
+int calib_table_write(const calib_table *t, const char *path) {
+    char tmp[280];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL) {
+        perror("File Error calib.bin");
+        return -1;
+    }
+    /* on disk before the rename, so a crash leaves the old table or the new one */
+    int bad = fwrite(t, sizeof(*t), 1, f) != 1 || fflush(f) != 0 || fsync(fileno(f)) < 0;
+    if (fclose(f) != 0 || bad) {
+        perror("File Error calib.bin");
+        unlink(tmp);
+        return -1;
+    }
+    /* readers never see a half-written table */
+    if (rename(tmp, path) < 0) {
+        perror("File Error calib.bin");
+        unlink(tmp);
+        return -1;
+    }
+    sync_dir(path);
+    return 0;
+}
+
+const calib_table *calib_table_map(const char *path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) < 0 || st.st_size != (off_t)sizeof(calib_table)) {
+        fprintf(stderr, "%s: unexpected size\n", path);
+        close(fd);
+        return NULL;
+    }
+    const calib_table *t = mmap(NULL, sizeof(calib_table), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (t == MAP_FAILED) {
+        perror("mmap calib.bin");
+        return NULL;
+    }
+    const char *why = NULL;
+    if (t->magic != CALIB_BIN_MAGIC) why = "bad magic";
+    else if (t->version != CALIB_BIN_VERSION) why = "unsupported version";
+    else if (t->header_size != offsetof(calib_table, entry) || t->entry_size != sizeof(calib_entry) ||
+             t->steps != CALIB_STEPS || t->channels != CALIB_CHANNELS) why = "layout mismatch";
+    else if (t->crc != calib_crc32(t->entry, sizeof(t->entry))) why = "checksum mismatch";
+    if (why) {
+        fprintf(stderr, "%s: %s\n", path, why);
+        munmap((void *)t, sizeof(calib_table));
+        return NULL;
+    }
+    return t;
+}
+
+void calib_table_unmap(const calib_table *t) {
+    munmap((void *)t, sizeof(calib_table));
+}
+
+int calib_table_read_csv(calib_table *t, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror("File Error Calib");
+        return -1;
+    }
+    char line[160], dir[8];
+    int rows = 0, lineno = 0;
+
+    calib_table_init(t);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        float v[2 * CALIB_CHANNELS];
+        int pwm, samples = 0;
+
+        lineno++;
+        if (strncmp(line, "sep=", 4) == 0 || strncmp(line, "PWM,", 4) == 0) continue;
+        int n = sscanf(line, "%d,%7[^,],%f,%f,%f,%f,%f,%f,%f,%f,%d",
+            &pwm, dir, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &samples);
+        int d = strcmp(dir, "up") == 0 ? CALIB_UP : strcmp(dir, "down") == 0 ? CALIB_DOWN : -1;
+        if (n < 10 || d < 0 || pwm < 0 || pwm >= CALIB_STEPS) {
+            fprintf(stderr, "%s:%d: malformed row\n", path, lineno);
+            continue;
+        }
+        calib_entry *e = &t->entry[d][pwm];
+        for (int c = 0; c < CALIB_CHANNELS; c++) {
+            e->mean[c] = v[2 * c];
+            e->std[c] = v[2 * c + 1];
+        }
+        e->samples = n == 11 ? (uint32_t)samples : 0;
+        rows++;
+    }
+    fclose(f);
+    if (rows < 2 * CALIB_STEPS)
+        fprintf(stderr, "%s: %d of %d steps calibrated\n", path, rows, 2 * CALIB_STEPS);
+    calib_table_finish(t);
+    return rows;
+}
+
+void calib_table_write_csv(const calib_table *t, FILE *f) {
+    fprintf(f, "sep=,\n");
+    fprintf(f, "PWM,Direction,SpeedMean,SpeedStd,AccMean,AccStd,GyroMean,GyroStd,TempMean,TempStd,Samples\n");
+    for (int d = 0; d < 2; d++) {
+        for (int i = 0; i < CALIB_STEPS; i++) {
+            int p = d == CALIB_UP ? i : CALIB_STEPS - 1 - i;
+            const calib_entry *e = &t->entry[d][p];
+            fprintf(f, "%d,%s,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%u\n",
+                p, dir_label[d], e->mean[0], e->std[0], e->mean[1], e->std[1],
+                e->mean[2], e->std[2], e->mean[3], e->std[3], e->samples);
+        }
+    }
+}
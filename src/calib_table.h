@@ -0,0 +1,70 @@
+#ifndef CALIB_TABLE_H
+#define CALIB_TABLE_H
+
+/*
+ * Binary calibration table (calib.bin). calib writes it next to calib.csv;
+ * main maps it read-only at startup. Each entry carries the measured
+ * mean/std per channel plus what the monitor needs per sample: reciprocal
+ * stds (with the monitor's std floors applied) and warn/error bounds in raw
+ * sensor units, so checking a reading is a pair of compares.
+ *
+ * The file is native-endian and only meant to be read on the machine that
+ * wrote it; magic, version, sizes and a CRC-32 of the entries are checked
+ * before use.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CALIB_BIN_MAGIC   0x42494C43u   /* "CLIB" */
+#define CALIB_BIN_VERSION 1
+#define CALIB_STEPS       101           /* PWM 0..100 */
+#define CALIB_CHANNELS    4
+
+enum { CAL_SPEED, CAL_ACC, CAL_GYRO, CAL_TEMP };
+enum { CALIB_UP, CALIB_DOWN };
+
+typedef struct {
+    float mean[CALIB_CHANNELS];
+    float std[CALIB_CHANNELS];          /* as measured */
+    float inv_std[CALIB_CHANNELS];      /* 1 / max(std, std_floor) */
+    float warn_lo[CALIB_CHANNELS], warn_hi[CALIB_CHANNELS];
+    float err_lo[CALIB_CHANNELS], err_hi[CALIB_CHANNELS];
+    uint32_t samples;                   /* valid samples behind mean/std */
+    uint32_t reserved;
+} calib_entry;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t entry_size;
+    uint32_t steps;
+    uint32_t channels;
+    uint32_t crc;                       /* CRC-32 of entry[][] */
+    uint32_t base_crc;                  /* adapt.bin: crc of the calib.bin it adapts, else 0 */
+    float std_floor[CALIB_CHANNELS];
+    float warn_z[CALIB_CHANNELS];
+    float err_z[CALIB_CHANNELS];
+    calib_entry entry[2][CALIB_STEPS];  /* [CALIB_UP / CALIB_DOWN][pwm] */
+} calib_table;
+
+/* Zeroed table with the default floors and thresholds. */
+void calib_table_init(calib_table *t);
+/* Fills inv_std and the bounds of every entry from mean/std, then the CRC. */
+void calib_table_finish(calib_table *t);
+/* The same for one entry, leaving the CRC stale. */
+void calib_entry_finish(const calib_table *t, calib_entry *e);
+/* Via a synced temp file and rename; the table is on disk on return. */
+int calib_table_write(const calib_table *t, const char *path);
+/* Read-only mapping of a validated file, NULL (with a message) otherwise. */
+const calib_table *calib_table_map(const char *path);
+void calib_table_unmap(const calib_table *t);
+/* Parses calib.csv into t and finishes it. Returns rows read, -1 on error. */
+int calib_table_read_csv(calib_table *t, const char *path);
+void calib_table_write_csv(const calib_table *t, FILE *f);
+/* CRC-32 (IEEE) of the file's entries. */
+uint32_t calib_crc32(const void *data, size_t len);
+
+#endif
@@ -3,172 +3,282 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <sys/stat.h>
+#include "backend.h"
+#include "stats.h"
+#include "calib_table.h"
+#include "spectrum.h"
+#include "mahal.h"
 
-#define MOTOR_PATH "/home/slend/robot_data/motor"
-#define IMU_PATH   "/home/slend/robot_data/imu"
-#define SPEED_PATH "/home/slend/robot_data/speed"
-#define CALIB_PATH "/home/slend/robot_data/calib.csv"
-
-float collect_samples(const char *label, int pwm, float ambient_acc, float ambient_gyro, FILE *f_calib, FILE *f_motor){
-    float mean_speed, variance_speed, std_speed,
-          mean_acc, variance_acc, std_acc,
-          mean_gyro, variance_gyro, std_gyro,
-          mean_temp, variance_temp, std_temp;
-    char line_buffer[128];
-    char command_buffer[16];
-
-    snprintf(command_buffer, sizeof(command_buffer), "f%03d", pwm);
-    rewind(f_motor);
-    fprintf(f_motor, "%s", command_buffer);
-    fflush(f_motor);
+#define CAL_CHANNELS 4          /* speed, acc, gyro, temp */
+#define CAL_FIXED_SAMPLES 30
+#define CAL_Z 1.96              /* 95 % confidence */
+#define CAL_IMU_BATCH 256
+/* between samples: speed is a 250 ms average, closer ones would be correlated */
+#define CAL_SAMPLE_NS 100000000ULL
+#define SPEC_CAL_WINDOWS 3      /* spectrum windows per measured step */
+#define SPEC_CAL_MAX_NS 20000000000ULL
+
+/*
+ * Adaptive mode (--adaptive): a PWM step is sampled until the 95 % confidence
+ * half-width of both the mean and the std of every channel is within that
+ * channel's tolerance, bounded by min_samples/max_samples. IMU channels only
+ * take a reading with a new acquisition time, so one the loop sees twice does
+ * not count twice; the text file carries no time, and every reading counts.
+ * The fixed 30-sample mode takes every reading, as it always has.
+ */
+int adaptive = 0;
+int min_samples = 8, max_samples = 60;
+int min_imu_samples = 4;        /* distinct IMU readings; the IMU is slower than the loop */
+double tolerance[CAL_CHANNELS] = {2.0, 0.01, 0.25, 0.1};  /* rpm, g, deg/s, deg C */
+long total_samples = 0;
+/* --motor=<n>: calibrates motor n into the motor<n>/ data subdirectory */
+int motor = 0;
+/* --spectrum[=<step>]: vibration band baselines every <step> % into bands.bin */
+int spectrum_step = 0;
+spectrum spec;
+imu_record imu_buf[CAL_IMU_BATCH];
+
+/* Drains the raw IMU records into spec; band windows go into st. */
+static void feed_bands(backend *be, int speed, stats *st) {
+    size_t n;
+    do {
+        n = backend_read_imu_records(be, imu_buf, CAL_IMU_BATCH);
+        /* one window per call at most: n is well below half an FFT */
+        if (spectrum_feed(&spec, imu_buf, n, speed) > 0 && spec.valid)
+            for (int b = 0; b < SPEC_BANDS; b++) stats_add(&st[b], spec.seg_band[b]);
+    } while (n == CAL_IMU_BATCH);
+}
+
+/* Returns once CAL_SAMPLE_NS have passed since *last_ns, waking on fresh
+   data only so as not to sleep past it. */
+static void wait_sample(backend *be, uint64_t *last_ns) {
+    uint64_t due = *last_ns + CAL_SAMPLE_NS, now;
+
+    while ((now = backend_now_ns(be)) < due) backend_wait_data(be, (unsigned int)((due - now + 999) / 1000));
+    *last_ns = now;
+}
+
+/* 95 % confidence half-widths of the mean and the std both within tol. */
+static int converged(const stats *s, double tol) {
+    return stats_ci_mean(s, CAL_Z) <= tol && stats_ci_std(s, CAL_Z) <= tol;
+}
+
+/* band: where to put the band baseline of this step, NULL to skip it;
+   joint: covariance of the samples with a fresh IMU reading */
+float collect_samples(int pwm, float ambient_acc, float ambient_gyro, calib_entry *e, calib_entry *band,
+                      mahal_entry *joint, backend *be){
+    stats ch[CAL_CHANNELS], bst[SPEC_BANDS];
+    mahal_acc co;
+    imu_sample imu;
+    uint64_t last_imu_ns = 0;
+
+    for (int c = 0; c < CAL_CHANNELS; c++) stats_reset(&ch[c]);
+    mahal_acc_reset(&co);
+    for (int b = 0; b < SPEC_BANDS; b++) stats_reset(&bst[b]);
+    backend_set_motor(be, 'f', pwm);
     
-    if (pwm < 20) usleep(500000);
-    else usleep(1000000);
+    if (pwm < 20) backend_sleep_us(be, 500000);
+    else backend_sleep_us(be, 1000000);
+    if (band) {
+        /* windows start after the settling time */
+        while (backend_read_imu_records(be, imu_buf, CAL_IMU_BATCH) == CAL_IMU_BATCH) ;
+        spectrum_reset(&spec);
+    }
 
-    int samples = 30, valid_samples = 0;
-    long sum_speed = 0;
-    long long sum_speed_sq = 0;
-    float sum_acc = 0.0, sum_acc_sq = 0.0, sum_gyro = 0.0,
-        sum_gyro_sq = 0.0, sum_temp = 0.0, sum_temp_sq  = 0.0;
+    int samples = adaptive ? max_samples : CAL_FIXED_SAMPLES, valid_samples = 0;
+    uint64_t last_ns = backend_now_ns(be);
 
     for (int s = 0; s < samples; s++) {
-        usleep(100000);
+        wait_sample(be, &last_ns);
 
         int current_speed = 0;
         float current_acc = 0.0, current_gyro = 0.0, current_temp = 0.0;
 
-        FILE *f_speed = fopen(SPEED_PATH, "r");
-        if (f_speed) {
-            if (fgets(line_buffer, sizeof(line_buffer), f_speed) != NULL) {
-                current_speed = (int)strtol(line_buffer, NULL, 10);
-            }
-            fclose(f_speed);
-        }
+        backend_read_speed(be, &current_speed);
+        if (band) feed_bands(be, current_speed, bst);
         if (current_speed < 0 || current_speed > 10000) continue;
         valid_samples++;
 
-        FILE *f_imu = fopen(IMU_PATH, "r");
-        if (f_imu) {
-            char temp_buf[128];
-            while(fgets(temp_buf, sizeof(temp_buf), f_imu) != NULL) {
-                 if(strlen(temp_buf) > 5) {
-                     strcpy(line_buffer, temp_buf);
-                 }
-            }
-            line_buffer[strcspn(line_buffer, "\n")] = 0;
-            int items = sscanf(line_buffer, "%f|%f|%f", &current_acc, &current_gyro, &current_temp);
-            current_acc -= ambient_acc;
-            current_gyro -= ambient_gyro;
-            if (items < 3) {
-                current_acc = 0; current_gyro = 0; current_temp = 0;
-            }
-            fclose(f_imu);
+        stats_add(&ch[0], current_speed);
+        if (backend_read_imu(be, &imu) == 0) {
+            if (adaptive && imu.t_ns && imu.t_ns == last_imu_ns)
+                goto check;
+            last_imu_ns = imu.t_ns;
+            current_acc = imu.acc - ambient_acc;
+            current_gyro = imu.gyro - ambient_gyro;
+            current_temp = imu.temp;
+            mahal_acc_add(&co, (float[CAL_CHANNELS]){current_speed, current_acc, current_gyro, current_temp});
         }
+        stats_add(&ch[1], current_acc);
+        stats_add(&ch[2], current_gyro);
+        stats_add(&ch[3], current_temp);
 
-            sum_speed += current_speed;
-            sum_speed_sq += current_speed * current_speed;
-            sum_acc += current_acc;
-            sum_acc_sq += current_acc * current_acc;
-            sum_gyro += current_gyro;
-            sum_gyro_sq += current_gyro * current_gyro;
-            sum_temp += current_temp;
-            sum_temp_sq += current_temp * current_temp;
+check:
+        if (adaptive && valid_samples >= min_samples && ch[1].n >= min_imu_samples) {
+            int done = 1;
+            for (int c = 0; c < CAL_CHANNELS; c++)
+                if (!converged(&ch[c], tolerance[c])) done = 0;
+            if (done) break;
+        }
     }
-    if (valid_samples == 0) {
-        fprintf(f_calib, "%d,%s,0.0000,0.0100,0.0000,0.0100,0.0000,0.0100,0.0000,0.0100\n", pwm, label);
-        return 0.0f;
+    /* a window needs a few seconds of records; keep going until there are enough */
+    uint64_t t0 = backend_now_ns(be);
+    while (band && bst[0].n < SPEC_CAL_WINDOWS && backend_now_ns(be) - t0 < SPEC_CAL_MAX_NS) {
+        int current_speed = 0;
+        backend_wait_data(be, 100000);
+        backend_read_speed(be, &current_speed);
+        feed_bands(be, current_speed, bst);
+    }
+    if (band) {
+        band->samples = bst[0].n;
+        for (int b = 0; b < SPEC_BANDS; b++) {
+            band->mean[b] = bst[b].n ? bst[b].mean : 0.0f;
+            band->std[b] = bst[b].n > 1 ? stats_std(&bst[b]) : 0.0f;
+        }
     }
 
-    mean_speed = (float)sum_speed / valid_samples;
-    variance_speed = ((float)sum_speed_sq / valid_samples) - (mean_speed * mean_speed);
-    mean_acc = sum_acc / valid_samples;
-    variance_acc = (sum_acc_sq / valid_samples) - (mean_acc * mean_acc);
-    mean_gyro = sum_gyro / valid_samples;
-    variance_gyro = (sum_gyro_sq / valid_samples) - (mean_gyro * mean_gyro);
-    mean_temp = sum_temp / valid_samples;
-    variance_temp = (sum_temp_sq / valid_samples) - (mean_temp * mean_temp);
-    if (variance_speed < 0) variance_speed = 0;
-    if (variance_acc < 0) variance_acc = 0;
-    if (variance_gyro < 0) variance_gyro = 0;
-    if (variance_temp < 0) variance_temp = 0;
-
-    std_speed = sqrt(variance_speed);
-    std_acc = sqrt(variance_acc);
-    std_gyro= sqrt(variance_gyro);
-    std_temp = sqrt(variance_temp);
-
-    if (std_speed<0.01)
-    {
-        std_speed=0.01;
+    mahal_acc_store(&co, joint);
+
+    total_samples += valid_samples;
+    e->samples = valid_samples;
+    for (int c = 0; c < CAL_CHANNELS; c++) {
+        double std = stats_std(&ch[c]);
+        e->mean[c] = valid_samples ? ch[c].mean : 0.0f;
+        e->std[c] = std < 0.01 ? 0.01f : std;
     }
-    if (std_acc<0.01)
-    {
-        std_acc=0.01;
+    return e->mean[CAL_SPEED];
+}
+
+/* calib --export: prints calib.bin as CSV. */
+int export_csv(void) {
+    char path[MOTOR_PATH_MAX];
+    const calib_table *t = calib_table_map(motor_data_path(path, sizeof(path), motor, "calib.bin"));
+    if (t == NULL) {
+        fprintf(stderr, "No valid %s\n", motor_data_path(path, sizeof(path), motor, "calib.bin"));
+        return 1;
     }
-    if (std_gyro<0.01)
-    {
-        std_gyro=0.01;
+    calib_table_write_csv(t, stdout);
+    calib_table_unmap(t);
+    return 0;
+}
+
+void parse_args(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--motor=", 8) == 0) {
+            motor = atoi(argv[i] + 8);
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            adaptive = 1;
+        } else if (strncmp(argv[i], "--tol=", 6) == 0) {
+            adaptive = 1;
+            sscanf(argv[i] + 6, "%lf,%lf,%lf,%lf",
+                &tolerance[0], &tolerance[1], &tolerance[2], &tolerance[3]);
+        } else if (strncmp(argv[i], "--samples=", 10) == 0) {
+            adaptive = 1;
+            sscanf(argv[i] + 10, "%d,%d", &min_samples, &max_samples);
+            if (min_samples < 2) min_samples = 2;
+            if (max_samples < min_samples) max_samples = min_samples;
+        } else if (strcmp(argv[i], "--spectrum") == 0) {
+            spectrum_step = 5;
+        } else if (strncmp(argv[i], "--spectrum=", 11) == 0) {
+            spectrum_step = atoi(argv[i] + 11);
+        }
     }
-    if (std_temp<0.01)
-    {
-        std_temp=0.01;
+}
+
+
+/*
+ * PWM steps that were not measured take the line between the measured ones,
+ * and the first/last measured step below/above them.
+ */
+static void interpolate_bands(calib_table *t) {
+    for (int d = 0; d < 2; d++) {
+        int prev = -1;
+        for (int p = 0; p < CALIB_STEPS; p++) {
+            if (t->entry[d][p].samples == 0) continue;
+            for (int q = prev + 1; q < p; q++) {
+                calib_entry *a = &t->entry[d][prev < 0 ? p : prev], *b = &t->entry[d][p], *e = &t->entry[d][q];
+                float f = prev < 0 ? 0.0f : (float)(q - prev) / (p - prev);
+                for (int c = 0; c < SPEC_BANDS; c++) {
+                    e->mean[c] = a->mean[c] + (b->mean[c] - a->mean[c]) * f;
+                    e->std[c] = a->std[c] + (b->std[c] - a->std[c]) * f;
+                }
+            }
+            prev = p;
+        }
+        for (int q = prev + 1; prev >= 0 && q < CALIB_STEPS; q++) {
+            memcpy(t->entry[d][q].mean, t->entry[d][prev].mean, sizeof(t->entry[d][q].mean));
+            memcpy(t->entry[d][q].std, t->entry[d][prev].std, sizeof(t->entry[d][q].std));
+        }
     }
-    fprintf(f_calib, "%d,%s,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n",
-        pwm, label, mean_speed, std_speed, mean_acc, std_acc,
-        mean_gyro, std_gyro, mean_temp, std_temp);
-    return mean_speed;
 }
 
+static int measure_bands(int pwm) {
+    return spectrum_step > 0 && (pwm % spectrum_step == 0 || pwm == CALIB_STEPS - 1);
+}
 
-int main() {
-    char line_buffer[128];
-    float acc_vib = 0.0, gyro_vib = 0.0, temp = 0.0, ambient_acc = 0.0, ambient_gyro = 0.0, ambient_data[3] = {0.0, 0.0, 0.0}, speed = 0.0;
+int main(int argc, char **argv) {
+    float ambient_acc = 0.0, ambient_gyro = 0.0, speed = 0.0;
+    stats ambient[2];
+    static calib_table table, bands;
+    static mahal_table cov;
     int start_pwm = -1;
+    char path[MOTOR_PATH_MAX];
+    imu_sample imu;
+    parse_args(argc, argv);
+    if (motor < 0 || motor >= MAX_MOTORS) {
+        fprintf(stderr, "Motor must be 0..%d\n", MAX_MOTORS - 1);
+        return 1;
+    }
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--export") == 0) return export_csv();
+    backend *be = backend_from_args(argc, argv, motor);
+    if (be == NULL) return 1;
+    /* the data dir, and motor<k>/ in it, may not exist yet */
+    mkdir(data_path(path, sizeof(path), ""), 0755);
+    if (motor > 0) mkdir(motor_data_path(path, sizeof(path), motor, ""), 0755);
+    if (spectrum_step > 0) {
+        spectrum_params sp;
+        spectrum_default_params(&sp);
+        if (spectrum_init(&spec, &sp) < 0) return 1;
+        spectrum_table_init(&bands);
+    }
+    uint64_t t_start = backend_now_ns(be);
+
+    stats_reset(&ambient[0]);
+    stats_reset(&ambient[1]);
     for (int i = 0; i < 50; i++)
     {
-        FILE *f_imu = fopen(IMU_PATH, "r");
-        if (f_imu) {
-            char temp_buf[128];
-            while(fgets(temp_buf, sizeof(temp_buf), f_imu) != NULL) {
-                 if(strlen(temp_buf) > 5) {
-                     strcpy(line_buffer, temp_buf);
-                 }
-            }
-            line_buffer[strcspn(line_buffer, "\n")] = 0;
-            int items = sscanf(line_buffer, "%f|%f|%f", &acc_vib, &gyro_vib, &temp);
-            if (items < 3) {
-                acc_vib = 0; gyro_vib = 0; temp = 0;
-            }
-            ambient_data[0] +=acc_vib;
-            ambient_data[1] +=gyro_vib;
-            ambient_data[2] +=temp;
-            fclose(f_imu);
-            usleep(100000);
+        if (backend_read_imu(be, &imu) == 0) {
+            stats_add(&ambient[0], imu.acc);
+            stats_add(&ambient[1], imu.gyro);
+            backend_sleep_us(be, 100000);
             printf("Calibrating IMU... %d%%\n", (i+1)*100/50);
             fflush(stdout);            
         }
     } 
-    ambient_acc = ambient_data[0]/50.0;
-    ambient_gyro = ambient_data[1]/50.0;
+    ambient_acc = ambient[0].mean;
+    ambient_gyro = ambient[1].mean;
+    printf("Ambient acc %.4f (std %.4f), gyro %.4f (std %.4f) over %ld readings\n",
+        ambient_acc, stats_std(&ambient[0]), ambient_gyro, stats_std(&ambient[1]), ambient[0].n);
 
-    FILE *f_motor = fopen(MOTOR_PATH, "w");
-    FILE *f_calib = fopen(CALIB_PATH, "w");
+    FILE *f_calib = fopen(motor_data_path(path, sizeof(path), motor, "calib.csv"), "w");
 
-    if (f_motor == NULL || f_calib == NULL) {
+    if (f_calib == NULL) {
         perror("File Error");
         return 1;
     } else {
         printf("Started calibration process\n");
     }
 
-  
-    fprintf(f_calib, "sep=,\n");
-    fprintf(f_calib, "PWM,Direction,SpeedMean,SpeedStd,AccMean,AccStd,GyroMean,GyroStd,TempMean,TempStd\n");
+    calib_table_init(&table);
+    mahal_table_init(&cov, table.std_floor);
     
     printf("Calibrating ascending...\n");
     for (int i = 0; i <= 100; i++)
     {
-        speed = collect_samples("up", i, ambient_acc, ambient_gyro, f_calib, f_motor);
+        speed = collect_samples(i, ambient_acc, ambient_gyro, &table.entry[CALIB_UP][i],
+                                measure_bands(i) ? &bands.entry[CALIB_UP][i] : NULL, &cov.entry[CALIB_UP][i], be);
         if (speed > 5.0f && start_pwm == -1) start_pwm = (i / 5) * 5;
         
         printf("Progress: %d%%\n", (i));
@@ -179,7 +289,8 @@ int main() {
     printf("Calibrating descending...\n");
     for (int i = 100; i >= 0; i--)
     {
-        speed = collect_samples("down", i, ambient_acc, ambient_gyro, f_calib, f_motor);
+        speed = collect_samples(i, ambient_acc, ambient_gyro, &table.entry[CALIB_DOWN][i],
+                                measure_bands(i) ? &bands.entry[CALIB_DOWN][i] : NULL, &cov.entry[CALIB_DOWN][i], be);
         printf("Progress: %d%%\n", (i));
         fflush(stdout);
     }
@@ -187,17 +298,32 @@ int main() {
 
     if (start_pwm == -1) start_pwm = 25;
 
-    FILE *f_meta = fopen("/home/slend/robot_data/motor_meta.csv", "w");
+    FILE *f_meta = fopen(motor_data_path(path, sizeof(path), motor, "motor_meta.csv"), "w");
     fprintf(f_meta, "start_pwm,%d\n", start_pwm);
     fclose(f_meta);
     printf("start_pwm=%d\n", start_pwm);
+    printf("%ld samples in %.1f s%s\n", total_samples,
+        (backend_now_ns(be) - t_start) / 1e9, adaptive ? " (adaptive)" : "");
 
-    fprintf(f_motor, "s000");
-    fflush(f_motor);
+    backend_set_motor(be, 's', 0);
     
-    fclose(f_motor);
-    fclose(f_calib);    
+    backend_close(be);
+
+    calib_table_finish(&table);
+    calib_table_write_csv(&table, f_calib);
+    fclose(f_calib);
+    if (calib_table_write(&table, motor_data_path(path, sizeof(path), motor, "calib.bin")) < 0) return 1;
+    mahal_table_finish(&cov);
+    if (mahal_table_write(&cov, motor_data_path(path, sizeof(path), motor, "cov.bin")) < 0) return 1;
+    if (spectrum_step > 0) {
+        interpolate_bands(&bands);
+        calib_table_finish(&bands);
+        if (calib_table_write(&bands, motor_data_path(path, sizeof(path), motor, "bands.bin")) < 0) return 1;
+        printf("Band baselines every %d %% written to bands.bin (%llu windows, %.1f us each)\n",
+               spectrum_step, (unsigned long long)spec.windows, spec.compute_us.mean);
+        spectrum_free(&spec);
+    }
 
-    printf("\nCalibration completed successfully! File calib.csv updated.\n");
+    printf("\nCalibration completed successfully! Files calib.csv, calib.bin and cov.bin updated.\n");
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include <string.h>
+#include <math.h>
+#include "detector.h"
+
+/* A step after a stall or a pause counts as at most this long. */
+#define DETECTOR_MAX_DT 1.0f
+
+static const char *const warn_msg[CALIB_CHANNELS] = {
+    "Speed out of safe range!", "ACC out of safe range!", "GYRO out of safe range!",
+    "Temperature out of safe range!",
+};
+static const char *const error_msg[CALIB_CHANNELS] = {
+    "Speed critically high!", "ACC critically!", "GYRO critical!",
+    "ERROR TEMPERATURE! IMMEDIATE STOP!",
+};
+static const char *const band_warn_msg[SPEC_BANDS] = {
+    "1x vibration out of safe range!", "2x vibration out of safe range!",
+    "Harmonic vibration out of safe range!", "High-freq vibration out of safe range!",
+};
+static const char *const band_error_msg[SPEC_BANDS] = {
+    "1x vibration critical!", "2x vibration critical!",
+    "Harmonic vibration critical!", "High-freq vibration critical!",
+};
+static const char joint_warn_msg[] = "Sensors jointly out of safe range!";
+static const char joint_error_msg[] = "Sensors jointly critical!";
+static const char ok_msg[] = "                                          ";
+
+void detector_default_params(detector_params *p) {
+    static const detector_params def = {
+        .warn_z = {2.0f, 2.5f, 2.5f},
+        .err_z = {3.0f, 4.0f, 4.0f},
+        /* the former iteration counts at the original 300 ms period */
+        .err_s = {6.0f, 3.0f, 3.0f, 3.0f},
+        .tau_s = 2.85f,
+        .startup_grace_s = 6.0f,
+        .grace_s = 1.5f,
+        .temp_err_lo = 0.0f, .temp_warn_lo = 10.0f, .temp_warn_hi = 50.0f, .temp_err_hi = 70.0f,
+        .band_warn_z = 3.0f, .band_err_z = 5.0f, .band_err_limit = 3,
+        .joint_err_s = 3.0f,
+    };
+    *p = def;
+}
+
+void detector_init(detector *d, const calib_table *t, const detector_params *p) {
+    memset(d, 0, sizeof(*d));
+    d->p = *p;
+    if (memcmp(t->warn_z, p->warn_z, sizeof(p->warn_z)) == 0 &&
+        memcmp(t->err_z, p->err_z, sizeof(p->err_z)) == 0) {
+        zscore_load(&d->soa, t);
+    } else {
+        calib_table tmp = *t;
+        memcpy(tmp.warn_z, p->warn_z, sizeof(p->warn_z));
+        memcpy(tmp.err_z, p->err_z, sizeof(p->err_z));
+        calib_table_finish(&tmp);
+        zscore_load(&d->soa, &tmp);
+    }
+    detector_reset(d);
+}
+
+void detector_reset(detector *d) {
+    d->filtered_acc = d->filtered_gyro = 0;
+    d->grace = d->p.startup_grace_s;
+    memset(d->err_time, 0, sizeof(d->err_time));
+    memset(d->level, 0, sizeof(d->level));
+    memset(d->band_z, 0, sizeof(d->band_z));
+    memset(d->band_level, 0, sizeof(d->band_level));
+    memset(d->band_err_count, 0, sizeof(d->band_err_count));
+    d->joint_err_time = 0;
+    d->joint_level = 0;
+    d->status = MOTOR_OK;
+}
+
+void detector_set_cov(detector *d, const mahal_table *cov) {
+    d->cov = cov;
+}
+
+void detector_set_bands(detector *d, const calib_soa *bands) {
+    d->bands = bands;
+}
+
+void detector_bands(detector *d, const float band[SPEC_BANDS], float duty, int dir) {
+    zscore_result zr;
+
+    if (d->bands == NULL) return;
+    if (band == NULL) {
+        memset(d->band_z, 0, sizeof(d->band_z));
+        memset(d->band_level, 0, sizeof(d->band_level));
+        memset(d->band_err_count, 0, sizeof(d->band_err_count));
+        return;
+    }
+    zscore_sample zs = { .pwm = duty, .dir = dir };
+    memcpy(zs.x, band, sizeof(zs.x));
+    zscore_batch(d->bands, &zs, &zr, 1);
+    for (int b = 0; b < SPEC_BANDS; b++) {
+        d->band_z[b] = zr.z[b];
+        d->band_level[b] = zr.z[b] >= d->p.band_err_z ? 2 : zr.z[b] >= d->p.band_warn_z;
+        if (d->grace > 0 || d->band_level[b] < 2) d->band_err_count[b] = 0;
+        else d->band_err_count[b]++;
+    }
+}
+
+void detector_setpoint_changed(detector *d) {
+    d->grace = d->p.grace_s;
+}
+
+static int temp_level(const detector_params *p, float temp) {
+    if (temp >= p->temp_err_hi || temp <= p->temp_err_lo) return 2;
+    if (temp >= p->temp_warn_hi || temp <= p->temp_warn_lo) return 1;
+    return 0;
+}
+
+int detector_step(detector *d, const detector_input *in, detector_output *out) {
+    const float dt = in->dt <= 0 ? 0 : in->dt < DETECTOR_MAX_DT ? in->dt : DETECTOR_MAX_DT;
+    const float a = d->p.tau_s > 0 ? 1 - expf(-dt / d->p.tau_s) : 1;
+    zscore_result zr;
+
+    d->filtered_acc = (1 - a) * d->filtered_acc + a * in->acc;
+    d->filtered_gyro = (1 - a) * d->filtered_gyro + a * in->gyro;
+
+    zscore_sample zs = { .x = {in->speed, d->filtered_acc, d->filtered_gyro, in->temp},
+                         .pwm = in->duty, .dir = in->dir };
+    zscore_batch(&d->soa, &zs, &zr, 1);
+    out->d2 = d->cov ? mahal_d2(d->cov, zs.x, in->duty, in->dir) : 0.0f;
+
+    out->msg = NULL;
+    if (d->grace > 0) {
+        d->grace -= dt;
+        memset(d->err_time, 0, sizeof(d->err_time));
+        memset(d->band_level, 0, sizeof(d->band_level));
+        memset(d->band_err_count, 0, sizeof(d->band_err_count));
+        d->joint_err_time = 0;
+    } else {
+        int worst = 0;
+        d->level[CAL_SPEED] = zscore_level(&zr, CAL_SPEED);
+        d->level[CAL_ACC] = zscore_level(&zr, CAL_ACC);
+        d->level[CAL_GYRO] = zscore_level(&zr, CAL_GYRO);
+        d->level[CAL_TEMP] = temp_level(&d->p, in->temp);
+        out->msg = ok_msg;
+        for (int c = 0; c < CALIB_CHANNELS; c++) {
+            if (d->level[c] == 2) d->err_time[c] += dt;
+            else d->err_time[c] = 0;
+            if (d->level[c] > worst) {
+                worst = d->level[c];
+                out->msg = worst == 2 ? error_msg[c] : warn_msg[c];
+            }
+        }
+        if (d->cov) {
+            d->joint_level = out->d2 >= d->cov->err_d2 ? 2 : out->d2 >= d->cov->warn_d2;
+            if (d->joint_level == 2) d->joint_err_time += dt;
+            else d->joint_err_time = 0;
+            if (d->joint_level > worst) {
+                worst = d->joint_level;
+                out->msg = worst == 2 ? joint_error_msg : joint_warn_msg;
+            }
+        }
+        for (int b = 0; b < SPEC_BANDS; b++) {
+            if (d->band_level[b] > worst) {
+                worst = d->band_level[b];
+                out->msg = worst == 2 ? band_error_msg[b] : band_warn_msg[b];
+            }
+        }
+        d->status = worst == 2 ? MOTOR_ERROR : worst == 1 ? MOTOR_WARNING : MOTOR_OK;
+    }
+
+    out->status = d->status;
+    memcpy(out->level, d->level, sizeof(out->level));
+    memcpy(out->z, zr.z, sizeof(out->z));
+    out->filtered_acc = d->filtered_acc;
+    out->filtered_gyro = d->filtered_gyro;
+    memcpy(out->band_level, d->band_level, sizeof(out->band_level));
+    memcpy(out->band_z, d->band_z, sizeof(out->band_z));
+    out->joint_level = d->joint_level;
+    out->stop = 0;
+    for (int c = 0; c < CALIB_CHANNELS; c++)
+        if (d->err_time[c] >= d->p.err_s[c]) out->stop = 1;
+    for (int b = 0; b < SPEC_BANDS; b++)
+        if (d->band_err_count[b] >= d->p.band_err_limit) out->stop = 1;
+    if (d->joint_err_time >= d->p.joint_err_s) out->stop = 1;
+    return out->stop;
+}
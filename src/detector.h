@@ -0,0 +1,101 @@
+#ifndef DETECTOR_H
+#define DETECTOR_H
+
+/*
+ * The anomaly detector of the control loop, free of I/O so it can also run
+ * over recorded traces (replay, sweep). One detector_step() per loop
+ * iteration: low-pass the vibration channels, score all channels against
+ * the calibration at the applied duty, apply the temperature bands, time
+ * consecutive errors and decide whether the motor must be stopped. With a
+ * cov.bin the four channels are also scored jointly (mahal.h).
+ *
+ * Grace periods, error windows and the filter are in seconds and advance
+ * by each step's dt, so they mean the same at 3 Hz and at 1 kHz, and for
+ * a loop that wakes on fresh data at an irregular rate.
+ */
+
+#include <stdint.h>
+#include "calib_table.h"
+#include "zscore.h"
+#include "spectrum.h"
+#include "mahal.h"
+
+typedef enum {
+    MOTOR_IDLE = 0,
+    MOTOR_OK = 1,
+    MOTOR_WARNING = 2,
+    MOTOR_ERROR = 3
+} MotorStatus;
+
+typedef struct {
+    float warn_z[3], err_z[3];      /* speed, acc, gyro sigmas */
+    float err_s[CALIB_CHANNELS];    /* seconds of consecutive errors before a stop */
+    float tau_s;                    /* acc/gyro low-pass time constant */
+    float startup_grace_s;          /* seconds ignored after start */
+    float grace_s;                  /* ... and after each setpoint change */
+    float temp_err_lo, temp_warn_lo, temp_warn_hi, temp_err_hi;   /* deg C */
+    /* vibration bands, upper side only; the limit counts spectrum windows,
+       which are a fixed span of IMU records whatever the loop rate */
+    float band_warn_z, band_err_z;
+    int band_err_limit;
+    float joint_err_s;              /* seconds of consecutive joint errors before a stop */
+} detector_params;
+
+typedef struct {
+    float duty;                     /* applied duty, % */
+    int dir;                        /* CALIB_UP / CALIB_DOWN */
+    float dt;                       /* seconds since the previous step */
+    int speed;
+    float acc, gyro, temp;          /* ambient already removed from acc/gyro */
+} detector_input;
+
+typedef struct {
+    MotorStatus status;             /* unchanged while in grace */
+    int level[CALIB_CHANNELS];      /* 0 ok, 1 warning, 2 error, last evaluated */
+    float z[CALIB_CHANNELS];
+    float filtered_acc, filtered_gyro;
+    const char *msg;                /* for the worst channel */
+    int stop;                       /* error limit reached on some channel */
+    int band_level[SPEC_BANDS];     /* of the last spectrum window */
+    float band_z[SPEC_BANDS];
+    float d2;                       /* squared Mahalanobis distance, 0 without cov.bin */
+    int joint_level;
+} detector_output;
+
+typedef struct {
+    detector_params p;
+    calib_soa soa;
+    float filtered_acc, filtered_gyro;
+    float grace;                    /* seconds left */
+    float err_time[CALIB_CHANNELS];
+    MotorStatus status;
+    int level[CALIB_CHANNELS];
+
+    const calib_soa *bands;         /* NULL without bands.bin */
+    float band_z[SPEC_BANDS];
+    int band_level[SPEC_BANDS];
+    int band_err_count[SPEC_BANDS];
+
+    const mahal_table *cov;         /* NULL without cov.bin */
+    float joint_err_time;
+    int joint_level;
+} detector;
+
+void detector_default_params(detector_params *p);
+/* Loads the calibration, re-deriving its bounds if p's sigmas differ from t's. */
+void detector_init(detector *d, const calib_table *t, const detector_params *p);
+/* Back to the startup state, keeping the calibration. */
+void detector_reset(detector *d);
+/* Setpoint changed: ignore the transient for p.grace_s. */
+void detector_setpoint_changed(detector *d);
+/* Returns out->stop. */
+int detector_step(detector *d, const detector_input *in, detector_output *out);
+/* Joint covariance table (cov.bin), owned by the caller. */
+void detector_set_cov(detector *d, const mahal_table *cov);
+/* Band baselines (bands.bin loaded with zscore_load), owned by the caller. */
+void detector_set_bands(detector *d, const calib_soa *bands);
+/* One spectrum window; its levels count in the following detector_step()s
+   until the next window. NULL (bands not resolvable) clears them. */
+void detector_bands(detector *d, const float band[SPEC_BANDS], float duty, int dir);
+
+#endif
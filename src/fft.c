@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <math.h>
+#include "fft.h"
+#include "simd4.h"
+
+int fft_plan_init(fft_plan *p, int n) {
+    int log2n = 0;
+
+    while ((1 << log2n) < n) log2n++;
+    if (n < 8 || (1 << log2n) != n) return -1;
+    p->n = n;
+    p->log2n = log2n;
+    p->bitrev = malloc(n * sizeof(*p->bitrev));
+    p->tw_re = aligned_alloc(16, n * sizeof(float));
+    p->tw_im = aligned_alloc(16, n * sizeof(float));
+    if (!p->bitrev || !p->tw_re || !p->tw_im) {
+        fft_plan_free(p);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        uint32_t r = 0;
+        for (int b = 0; b < log2n; b++) r |= (uint32_t)((i >> b) & 1) << (log2n - 1 - b);
+        p->bitrev[i] = r;
+    }
+    for (int h = 1; h < n; h <<= 1) {
+        for (int j = 0; j < h; j++) {
+            p->tw_re[h + j] = (float)cos(M_PI * j / h);
+            p->tw_im[h + j] = (float)-sin(M_PI * j / h);
+        }
+    }
+    return 0;
+}
+
+void fft_plan_free(fft_plan *p) {
+    free(p->bitrev);
+    free(p->tw_re);
+    free(p->tw_im);
+    p->bitrev = NULL;
+    p->tw_re = p->tw_im = NULL;
+}
+
+void fft_forward(const fft_plan *p, float *re, float *im) {
+    const int n = p->n;
+
+    for (int i = 0; i < n; i++) {
+        int j = p->bitrev[i];
+        if (j > i) {
+            float t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+
+    /* half-sizes 1 and 2: twiddles 1 and -i, no multiplies */
+    for (int k = 0; k < n; k += 4) {
+        float ar = re[k] + re[k + 1], ai = im[k] + im[k + 1];
+        float br = re[k] - re[k + 1], bi = im[k] - im[k + 1];
+        float cr = re[k + 2] + re[k + 3], ci = im[k + 2] + im[k + 3];
+        float dr = re[k + 2] - re[k + 3], di = im[k + 2] - im[k + 3];
+
+        re[k] = ar + cr;     im[k] = ai + ci;
+        re[k + 2] = ar - cr; im[k + 2] = ai - ci;
+        re[k + 1] = br + di; im[k + 1] = bi - dr;
+        re[k + 3] = br - di; im[k + 3] = bi + dr;
+    }
+
+    for (int h = 4; h < n; h <<= 1) {
+        const float *wr = p->tw_re + h, *wi = p->tw_im + h;
+        for (int k = 0; k < n; k += 2 * h) {
+            float *ar = re + k, *ai = im + k, *br = re + k + h, *bi = im + k + h;
+            for (int j = 0; j < h; j += 4) {
+                v4f xr = v4_load(br + j), xi = v4_load(bi + j);
+                v4f twr = v4_load(wr + j), twi = v4_load(wi + j);
+                v4f tr = v4_sub(v4_mul(xr, twr), v4_mul(xi, twi));
+                v4f ti = v4_add(v4_mul(xr, twi), v4_mul(xi, twr));
+                v4f yr = v4_load(ar + j), yi = v4_load(ai + j);
+                v4_store(ar + j, v4_add(yr, tr));
+                v4_store(ai + j, v4_add(yi, ti));
+                v4_store(br + j, v4_sub(yr, tr));
+                v4_store(bi + j, v4_sub(yi, ti));
+            }
+        }
+    }
+}
+
+const char *fft_impl(void) {
+    return SIMD4_IMPL;
+}
@@ -0,0 +1,27 @@
+#ifndef FFT_H
+#define FFT_H
+
+/*
+ * In-place radix-2 complex FFT on split real/imaginary arrays. The
+ * butterflies of every stage from half-size 4 up run four at a time
+ * through simd4.h, with each stage's twiddles stored contiguously, so a
+ * stage is a straight sweep of aligned vector loads. Arrays must be
+ * 16-byte aligned.
+ */
+
+#include <stdint.h>
+
+typedef struct {
+    int n, log2n;
+    uint32_t *bitrev;
+    float *tw_re, *tw_im;       /* stage with half-size h at offset h */
+} fft_plan;
+
+/* n is a power of two, at least 8. */
+int fft_plan_init(fft_plan *p, int n);
+void fft_plan_free(fft_plan *p);
+/* Forward transform, X[k] = sum x[j] e^(-2 pi i jk/n), unscaled. */
+void fft_forward(const fft_plan *p, float *re, float *im);
+const char *fft_impl(void);
+
+#endif
@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "motor_ctx.h"
+#include "render.h"
+#include "telemetry.h"
+
+/*
+ * hot_bench [--iters=<n>] [--filter=<substring>]
+ * Cost of every stage main runs per loop iteration, one CSV row each, so
+ * runs from two commits can be diffed or joined on the bench column:
+ *   imu_parse      newest line of the daemon's text file (file fallback)
+ *   speed_parse    the speed sysfs line
+ *   calib_map      mapping and validating calib.bin
+ *   calib_csv      parsing calib.csv (calibrations without calib.bin)
+ *   zscore         one sample against the table, all four channels
+ *   detector_step  the whole status update, joint score included
+ *   render_frame   composing the metrics panel and diffing it out
+ *   telemetry_push one log record into the writer's ring
+ *   loop_iteration motor_ctx_step of one simulated motor at 50 %
+ * Everything runs on a synthetic calibration in a temporary data dir.
+ * Built with -DBENCH_REV=\"<rev>\" the rows carry it.
+ */
+
+#ifndef BENCH_REV
+#define BENCH_REV "unknown"
+#endif
+#define DEFAULT_ITERS 200000
+#define LOOP_PERIOD_US 10000
+
+static char data_dir[64];
+static const char *filter;
+static long iters = DEFAULT_ITERS;
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int wanted(const char *name) {
+    return filter == NULL || strstr(name, filter) != NULL;
+}
+
+static void report(const char *name, long ops, uint64_t ns) {
+    printf("%s,%ld,%.1f,%s\n", name, ops, (double)ns / ops, BENCH_REV);
+    fflush(stdout);
+}
+
+/* Roughly what the sim plant calibrates to, with std floors applied. */
+static void make_calibration(calib_table *t, mahal_table *cov) {
+    calib_table_init(t);
+    for (int d = 0; d < 2; d++) {
+        for (int p = 0; p < CALIB_STEPS; p++) {
+            calib_entry *e = &t->entry[d][p];
+            float run = p >= 25;
+            float mean[CALIB_CHANNELS] = {run * 2.3f * p, 0.02f + run * 0.0002f * p, 0.5f + run * 0.01f * p, 32.5f};
+            float std[CALIB_CHANNELS] = {2.0f, 0.01f, 0.4f, 0.1f};
+            memcpy(e->mean, mean, sizeof(mean));
+            memcpy(e->std, std, sizeof(std));
+            e->samples = 100;
+        }
+    }
+    calib_table_finish(t);
+
+    mahal_table_init(cov, t->std_floor);
+    for (int d = 0; d < 2; d++) {
+        for (int p = 0; p < CALIB_STEPS; p++) {
+            const calib_entry *e = &t->entry[d][p];
+            mahal_entry *j = &cov->entry[d][p];
+            memcpy(j->mean, e->mean, sizeof(j->mean));
+            for (int c = 0, k = 0; c < CALIB_CHANNELS; k += ++c + 1) j->cov[k] = e->std[c] * e->std[c];
+            j->samples = e->samples;
+        }
+    }
+    mahal_table_finish(cov);
+}
+
+static int setup_data_dir(void) {
+    static calib_table t;
+    static mahal_table cov;
+    char path[MOTOR_PATH_MAX];
+
+    snprintf(data_dir, sizeof(data_dir), "/tmp/hot_bench.XXXXXX");
+    if (mkdtemp(data_dir) == NULL) {
+        perror("hot_bench");
+        return -1;
+    }
+    setenv("MOTOR_DATA_DIR", data_dir, 1);
+    make_calibration(&t, &cov);
+    if (calib_table_write(&t, motor_data_path(path, sizeof(path), 0, "calib.bin")) < 0) return -1;
+    if (mahal_table_write(&cov, motor_data_path(path, sizeof(path), 0, "cov.bin")) < 0) return -1;
+    FILE *f = fopen(motor_data_path(path, sizeof(path), 0, "calib.csv"), "w");
+    if (f == NULL) {
+        perror("hot_bench");
+        return -1;
+    }
+    calib_table_write_csv(&t, f);
+    fclose(f);
+    f = fopen(motor_data_path(path, sizeof(path), 0, "motor_meta.csv"), "w");
+    if (f) {
+        fprintf(f, "start_pwm,25\n");
+        fclose(f);
+    }
+    return 0;
+}
+
+static void remove_dir(const char *dir) {
+    char path[320];
+    DIR *d = opendir(dir);
+    struct dirent *e;
+
+    if (d == NULL) return;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (unlink(path) < 0) remove_dir(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+static void bench_parse(void) {
+    static const char text[] = "0.02|0.51|32.10\n0.03|0.50|32.11\n0.0";
+    char buf[sizeof(text)];
+    imu_sample s;
+    volatile float sink = 0;
+
+    if (wanted("imu_parse")) {
+        uint64_t t0 = mono_ns();
+        for (long i = 0; i < iters; i++) {
+            memcpy(buf, text, sizeof(text));
+            imu_parse_text(buf, &s);
+            sink += s.acc;
+        }
+        report("imu_parse", iters, mono_ns() - t0);
+    }
+    if (wanted("speed_parse")) {
+        volatile long speed = 0;
+        uint64_t t0 = mono_ns();
+        for (long i = 0; i < iters; i++) {
+            memcpy(buf, "117\n", 5);
+            speed += strtol(buf, NULL, 10);
+        }
+        report("speed_parse", iters, mono_ns() - t0);
+    }
+}
+
+static void bench_calib(void) {
+    long n = iters / 100 > 0 ? iters / 100 : 1;
+    static calib_table t;
+    char path[MOTOR_PATH_MAX];
+
+    if (wanted("calib_map")) {
+        uint64_t t0 = mono_ns();
+        for (long i = 0; i < n; i++) calib_table_unmap(calib_table_map(motor_data_path(path, sizeof(path), 0, "calib.bin")));
+        report("calib_map", n, mono_ns() - t0);
+    }
+    if (wanted("calib_csv")) {
+        uint64_t t0 = mono_ns();
+        for (long i = 0; i < n; i++) calib_table_read_csv(&t, motor_data_path(path, sizeof(path), 0, "calib.csv"));
+        report("calib_csv", n, mono_ns() - t0);
+    }
+}
+
+static void bench_detector(void) {
+    char path[MOTOR_PATH_MAX];
+    const calib_table *t = calib_table_map(motor_data_path(path, sizeof(path), 0, "calib.bin"));
+    const mahal_table *cov = mahal_table_map(motor_data_path(path, sizeof(path), 0, "cov.bin"));
+    static detector det;
+    detector_params p;
+    detector_output out;
+    zscore_result zr;
+    volatile float sink = 0;
+
+    if (t == NULL || cov == NULL) return;
+    detector_default_params(&p);
+    detector_init(&det, t, &p);
+    detector_set_cov(&det, cov);
+    srand(1);
+    if (wanted("zscore")) {
+        uint64_t t0 = mono_ns();
+        for (long i = 0; i < iters; i++) {
+            zscore_sample zs = { .x = {115.0f + (i & 7), 0.03f, 1.0f, 32.5f}, .pwm = 50.0f + (i & 3) * 0.25f,
+                                 .dir = CALIB_UP };
+            zscore_batch(&det.soa, &zs, &zr, 1);
+            sink += zr.z[0];
+        }
+        report("zscore", iters, mono_ns() - t0);
+    }
+    if (wanted("detector_step")) {
+        uint64_t t0 = mono_ns();
+        for (long i = 0; i < iters; i++) {
+            detector_input in = { .duty = 50.0f, .dir = CALIB_UP, .dt = 0.01f, .speed = 113 + (int)(i & 7),
+                                  .acc = 0.03f, .gyro = 1.0f, .temp = 32.5f };
+            detector_step(&det, &in, &out);
+            sink += out.d2;
+        }
+        report("detector_step", iters, mono_ns() - t0);
+    }
+    mahal_table_unmap(cov);
+    calib_table_unmap(t);
+}
+
+/* main's metrics panel with changing readings, written to /dev/null */
+static void bench_render(void) {
+    screen scr;
+    long n = iters / 10 > 0 ? iters / 10 : 1;
+    int fd = open("/dev/null", O_WRONLY);
+
+    if (!wanted("render_frame") || fd < 0 || screen_init(&scr, fd, 48, 120) < 0) {
+        if (fd >= 0) close(fd);
+        return;
+    }
+    uint64_t t0 = mono_ns();
+    for (long i = 0; i < n; i++) {
+        screen_clear(&scr);
+        screen_put(&scr, 10, 50, ATTR_BOLD, "[ SYSTEM METRICS ]");
+        screen_printf(&scr, 12, 50, ATTR_BOLD, "SPEED     : %ld", 110 + (i & 7));
+        screen_printf(&scr, 14, 50, ATTR_BOLD, "VIB ACCEL : %.4f", 0.02 + (i & 3) * 0.001);
+        screen_printf(&scr, 15, 50, ATTR_BOLD, "VIB GYRO  : %.4f", 0.5 + (i & 3) * 0.01);
+        screen_printf(&scr, 17, 50, ATTR_BOLD, "TEMP      : %.2f °C", 32.5);
+        screen_printf(&scr, 18, 50, ATTR_BOLD, "JOINT D2  : %.1f", (double)(i & 15));
+        screen_printf(&scr, 19, 50, ATTR_DEFAULT, "POWER: %d", 50);
+        screen_printf(&scr, 21, 50, ATTR_DEFAULT, "LOOP : %.1f ms (1 s: mean %.1f, p99 %.1f, max %.1f)",
+                      10.0, 10.0, 10.2, 10.4);
+        screen_printf(&scr, 44, 70, ATTR_BOLD, "[ GRACE PERIOD: %-3d ]", 0);
+        screen_printf(&scr, 46, 70, ATTR_BOLD, "%-42s", "Normal operation");
+        screen_flush(&scr);
+    }
+    report("render_frame", n, mono_ns() - t0);
+    screen_free(&scr);
+    close(fd);
+}
+
+/* Pushes in half-ring bursts and lets the writer drain in between, so the
+   ring never fills and no push takes the drop path. */
+static void bench_telemetry(void) {
+    static telemetry tlm;
+    char dir[128];
+    uint64_t ns = 0;
+    long n = 0;
+
+    if (!wanted("telemetry_push")) return;
+    snprintf(dir, sizeof(dir), "%s/log", data_dir);
+    mkdir(dir, 0755);
+    if (telemetry_start(&tlm, dir, 0, 0, 0) < 0) return;
+    while (n < iters) {
+        telemetry_record rec = { .pwm = 50, .status = MOTOR_OK, .duty = 50.0f, .speed = 115 };
+        uint64_t t0 = mono_ns();
+        for (int k = 0; k < TELEMETRY_RING / 2; k++) {
+            rec.t_ns = n + k;
+            telemetry_push(&tlm, &rec);
+        }
+        ns += mono_ns() - t0;
+        n += TELEMETRY_RING / 2;
+        while (atomic_load(&tlm.tail) != atomic_load(&tlm.head)) usleep(1000);
+    }
+    telemetry_stop(&tlm);
+    report("telemetry_push", n, ns);
+    if (atomic_load(&tlm.dropped)) fprintf(stderr, "telemetry_push: %llu dropped\n",
+                                           (unsigned long long)atomic_load(&tlm.dropped));
+}
+
+static void bench_loop(void) {
+    static motor_ctx m;
+    detector_params p;
+    long n = iters / 10 > 0 ? iters / 10 : 1;
+    uint64_t ns = 0;
+
+    if (!wanted("loop_iteration")) return;
+    detector_default_params(&p);
+    backend *be = backend_open("sim", 0);
+    if (be == NULL || motor_ctx_open(&m, 0, be, &p) < 0) return;
+    for (int i = 0; i < 50; i++) {
+        motor_ctx_ambient(&m);
+        backend_sleep_us(be, 100000);
+    }
+    motor_ctx_ambient_done(&m);
+    motor_ctx_change(&m, 50);
+    for (long i = 0; i < n; i++) {
+        uint64_t t0 = mono_ns();
+        motor_ctx_step(&m, 25);
+        ns += mono_ns() - t0;
+        backend_sleep_us(be, LOOP_PERIOD_US);
+    }
+    report("loop_iteration", n, ns);
+    motor_ctx_close(&m);
+    backend_close(be);
+}
+
+int main(int argc, char **argv) {
+    for (int a = 1; a < argc; a++) {
+        if (strncmp(argv[a], "--iters=", 8) == 0) iters = atol(argv[a] + 8);
+        else if (strncmp(argv[a], "--filter=", 9) == 0) filter = argv[a] + 9;
+        else {
+            fprintf(stderr, "Usage: %s [--iters=n] [--filter=substring]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (iters < 1 || setup_data_dir() < 0) return 1;
+
+    printf("bench,ops,ns_per_op,rev\n");
+    bench_parse();
+    bench_calib();
+    bench_detector();
+    bench_render();
+    bench_telemetry();
+    bench_loop();
+    remove_dir(data_dir);
+    return 0;
+}
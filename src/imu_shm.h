@@ -0,0 +1,161 @@
+#ifndef IMU_SHM_H
+#define IMU_SHM_H
+
+/*
+ * Binary IMU transport between read_mcu and its consumers: one POSIX shared
+ * memory segment holding a seqlock-protected "latest" record and a
+ * single-producer/multi-consumer ring of every published record. Readers
+ * never block the daemon; a reader that falls more than IMU_RING_SIZE
+ * records behind is told how many it lost.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define IMU_SHM_NAME    "/imu_data"
+#define IMU_SHM_MAGIC   0x31554D49u   /* "IMU1" */
+#define IMU_SHM_VERSION 1
+#define IMU_RING_SIZE   4096          /* power of two */
+
+typedef struct {
+    uint64_t t_ns;      /* CLOCK_MONOTONIC at acquisition */
+    float acc;          /* | |acc| - 1g |, g */
+    float gyro;         /* |gyro|, deg/s */
+    float temp;         /* deg C */
+    int16_t raw[7];     /* ax ay az temp gx gy gz, as read from the MPU */
+} imu_record;
+
+typedef struct {
+    _Atomic uint64_t seq;   /* 2*index+1 while writing, 2*index+2 when valid */
+    imu_record rec;
+} imu_slot;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    _Atomic uint32_t latest_seq;   /* odd while the writer updates latest */
+    imu_record latest;
+    _Atomic uint64_t head;         /* records ever published */
+    imu_slot ring[IMU_RING_SIZE];
+} imu_shm;
+
+/* One segment per motor: IMU_SHM_NAME for motor 0, IMU_SHM_NAME "<n>" after. */
+static inline const char *imu_shm_name(char *buf, size_t len, int motor) {
+    if (motor == 0) return IMU_SHM_NAME;
+    snprintf(buf, len, "%s%d", IMU_SHM_NAME, motor);
+    return buf;
+}
+
+/* Daemon side: creates (or reuses) and resets the segment. */
+static inline imu_shm *imu_shm_create(int motor) {
+    char name[32];
+    int fd = shm_open(imu_shm_name(name, sizeof(name), motor), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, sizeof(imu_shm)) < 0) { close(fd); return NULL; }
+    imu_shm *shm = mmap(NULL, sizeof(imu_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) return NULL;
+
+    shm->magic = 0;
+    atomic_store(&shm->head, 0);
+    atomic_store(&shm->latest_seq, 0);
+    for (size_t i = 0; i < IMU_RING_SIZE; i++) atomic_store(&shm->ring[i].seq, 0);
+    shm->version = IMU_SHM_VERSION;
+    atomic_thread_fence(memory_order_release);
+    shm->magic = IMU_SHM_MAGIC;
+    return shm;
+}
+
+/* Consumer side: read-only mapping, NULL if the daemon has not set it up. */
+static inline const imu_shm *imu_shm_attach(int motor) {
+    char name[32];
+    int fd = shm_open(imu_shm_name(name, sizeof(name), motor), O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    const imu_shm *shm = mmap(NULL, sizeof(imu_shm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) return NULL;
+    if (shm->magic != IMU_SHM_MAGIC || shm->version != IMU_SHM_VERSION) {
+        munmap((void *)shm, sizeof(imu_shm));
+        return NULL;
+    }
+    return shm;
+}
+
+static inline void imu_shm_detach(const imu_shm *shm) {
+    munmap((void *)shm, sizeof(imu_shm));
+}
+
+static inline void imu_shm_publish(imu_shm *shm, const imu_record *rec) {
+    uint64_t idx = atomic_load_explicit(&shm->head, memory_order_relaxed);
+    imu_slot *slot = &shm->ring[idx & (IMU_RING_SIZE - 1)];
+
+    atomic_store_explicit(&slot->seq, 2 * idx + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->rec = *rec;
+    atomic_store_explicit(&slot->seq, 2 * idx + 2, memory_order_release);
+
+    uint32_t seq = atomic_load_explicit(&shm->latest_seq, memory_order_relaxed);
+    atomic_store_explicit(&shm->latest_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    shm->latest = *rec;
+    atomic_store_explicit(&shm->latest_seq, seq + 2, memory_order_release);
+
+    atomic_store_explicit(&shm->head, idx + 1, memory_order_release);
+}
+
+/* Cursor for a reader that only wants records published from now on. */
+static inline uint64_t imu_shm_head(const imu_shm *shm) {
+    return atomic_load_explicit(&((imu_shm *)shm)->head, memory_order_acquire);
+}
+
+/* Newest record, torn-free. Returns -1 if nothing was published yet. */
+static inline int imu_shm_latest(const imu_shm *shm, imu_record *out) {
+    imu_shm *s = (imu_shm *)shm;
+    uint32_t s1, s2;
+    do {
+        s1 = atomic_load_explicit(&s->latest_seq, memory_order_acquire);
+        if (s1 == 0) return -1;
+        if (s1 & 1) continue;
+        memcpy(out, (const void *)&shm->latest, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        s2 = atomic_load_explicit(&s->latest_seq, memory_order_relaxed);
+    } while ((s1 & 1) || s1 != s2);
+    return 0;
+}
+
+/*
+ * Copies up to max records published since *cursor and advances it. Records
+ * already overwritten by the producer are skipped and added to *lost.
+ */
+static inline size_t imu_shm_read_since(const imu_shm *shm, uint64_t *cursor, imu_record *out, size_t max, uint64_t *lost) {
+    imu_shm *s = (imu_shm *)shm;
+    uint64_t head = atomic_load_explicit(&s->head, memory_order_acquire);
+    size_t n = 0;
+
+    if (*cursor > head) *cursor = head;   /* daemon restarted and reset the ring */
+    if (head - *cursor > IMU_RING_SIZE) {
+        if (lost) *lost += head - IMU_RING_SIZE - *cursor;
+        *cursor = head - IMU_RING_SIZE;
+    }
+    while (*cursor < head && n < max) {
+        uint64_t idx = *cursor;
+        imu_slot *slot = &s->ring[idx & (IMU_RING_SIZE - 1)];
+        uint64_t s1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        memcpy(&out[n], (const void *)&slot->rec, sizeof(out[n]));
+        atomic_thread_fence(memory_order_acquire);
+        uint64_t s2 = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+        if (s1 == 2 * idx + 2 && s2 == s1) n++;
+        else if (lost) (*lost)++;
+        (*cursor)++;
+    }
+    return n;
+}
+
+#endif
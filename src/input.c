@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include "input.h"
+#include "tracepoint.h"
+
+#define INPUT_POLL_MS 100
+
+enum { ESC_NONE, ESC_START, ESC_CSI, ESC_SS3 };
+
+uint64_t input_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void input_push(input *in, int type, int arg, uint64_t t_ns) {
+    uint64_t head = atomic_load_explicit(&in->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&in->tail, memory_order_acquire);
+
+    if (head - tail >= INPUT_RING) {
+        atomic_fetch_add_explicit(&in->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    in->ring[head & (INPUT_RING - 1)] = (input_cmd){ .type = type, .arg = arg, .t_ns = t_ns };
+    atomic_store_explicit(&in->head, head + 1, memory_order_release);
+}
+
+int input_pop(input *in, input_cmd *out) {
+    uint64_t tail = atomic_load_explicit(&in->tail, memory_order_relaxed);
+
+    if (tail == atomic_load_explicit(&in->head, memory_order_acquire)) return 0;
+    *out = in->ring[tail & (INPUT_RING - 1)];
+    atomic_store_explicit(&in->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+/* Plain keys; everything else is ignored. */
+static void input_key(input *in, unsigned char c, uint64_t t_ns) {
+    if (c == 's' || c == 'S' || c == ' ') {
+        in->on_stop(in->arg, t_ns);
+        input_push(in, INPUT_STOP, 0, t_ns);
+    } else if (c >= '0' && c <= '9') {
+        input_push(in, INPUT_SELECT, c - '0', t_ns);
+    } else if (c == '\t') {
+        input_push(in, INPUT_NEXT, 0, t_ns);
+    }
+}
+
+/* Final byte of a CSI or SS3 sequence. */
+static void input_seq(input *in, unsigned char final, uint64_t t_ns) {
+    if (final == 'A') input_push(in, INPUT_UP, 0, t_ns);
+    else if (final == 'B') input_push(in, INPUT_DOWN, 0, t_ns);
+}
+
+static void input_byte(input *in, unsigned char c, uint64_t t_ns) {
+    switch (in->esc_state) {
+    case ESC_NONE:
+        if (c == 0x1b) in->esc_state = ESC_START;
+        else input_key(in, c, t_ns);
+        break;
+    case ESC_START:
+        if (c == '[') {
+            in->esc_state = ESC_CSI;
+            in->esc_len = 0;
+        } else if (c == 'O') {
+            in->esc_state = ESC_SS3;
+        } else if (c == 0x1b) {
+            /* ESC ESC: the first one was a lone key */
+        } else {
+            /* Alt+key: treat as the key */
+            in->esc_state = ESC_NONE;
+            input_key(in, c, t_ns);
+        }
+        break;
+    case ESC_CSI:
+        /* parameters and intermediates run until a final byte 0x40..0x7e */
+        if (c >= 0x40 && c <= 0x7e) {
+            in->esc_state = ESC_NONE;
+            input_seq(in, c, t_ns);
+        } else if (c < 0x20 || ++in->esc_len > 16) {
+            in->esc_state = ESC_NONE;       /* malformed, resync */
+        }
+        break;
+    case ESC_SS3:
+        in->esc_state = ESC_NONE;
+        input_seq(in, c, t_ns);
+        break;
+    }
+}
+
+static void *input_thread(void *arg) {
+    input *in = arg;
+    unsigned char buf[64];
+    struct pollfd pfd = { .fd = in->fd, .events = POLLIN };
+
+    TP_THREAD("input");
+    while (!atomic_load(&in->stop)) {
+        int timeout = in->esc_state == ESC_NONE ? INPUT_POLL_MS : INPUT_ESC_TIMEOUT_MS;
+        int r = poll(&pfd, 1, timeout);
+
+        if (r == 0) {
+            /* an escape that went quiet was just the Esc key */
+            in->esc_state = ESC_NONE;
+            continue;
+        }
+        if (r < 0) continue;
+        if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) {
+            /* stdin closed: nothing more will come */
+            if (!(pfd.revents & POLLIN)) break;
+        }
+        ssize_t n = read(in->fd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n == 0 || (errno != EINTR && errno != EAGAIN)) break;
+            continue;
+        }
+        uint64_t t_ns = input_now_ns();
+        TP_BEGIN("keys");
+        for (ssize_t i = 0; i < n; i++) input_byte(in, buf[i], t_ns);
+        TP_END("keys");
+    }
+    return NULL;
+}
+
+int input_start(input *in, int fd, void (*on_stop)(void *arg, uint64_t t_ns), void *arg) {
+    memset(in, 0, sizeof(*in));
+    in->fd = fd;
+    in->on_stop = on_stop;
+    in->arg = arg;
+    if (pthread_create(&in->thread, NULL, input_thread, in) != 0) {
+        perror("input thread");
+        in->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void input_stop(input *in) {
+    if (in->fd < 0) return;
+    atomic_store(&in->stop, 1);
+    pthread_join(in->thread, NULL);
+}
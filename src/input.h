@@ -0,0 +1,58 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+/*
+ * Keyboard input on its own thread. It sleeps in poll() on stdin, decodes
+ * keys and escape sequences (CSI and SS3 arrows, with or without modifier
+ * parameters; anything else is consumed and dropped) and hands commands
+ * to the control loop through a single-producer/single-consumer ring, so
+ * the loop never touches the terminal. A stop key does not wait for the
+ * loop: the thread calls on_stop itself, right after the key is read.
+ * Every command carries the CLOCK_MONOTONIC time its key was read, for
+ * key-to-actuation latency.
+ */
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define INPUT_RING 64               /* power of two */
+/* a lone ESC is a key of its own if nothing follows within this */
+#define INPUT_ESC_TIMEOUT_MS 50
+
+enum {
+    INPUT_UP,
+    INPUT_DOWN,
+    INPUT_SELECT,                   /* arg = motor */
+    INPUT_NEXT,                     /* Tab */
+    INPUT_STOP,
+};
+
+typedef struct {
+    uint8_t type;
+    int8_t arg;
+    uint64_t t_ns;                  /* key read, CLOCK_MONOTONIC */
+} input_cmd;
+
+typedef struct {
+    int fd;
+    void (*on_stop)(void *arg, uint64_t t_ns);
+    void *arg;
+
+    _Atomic uint64_t head, tail;
+    input_cmd ring[INPUT_RING];
+    _Atomic uint64_t dropped;
+
+    pthread_t thread;
+    atomic_bool stop;
+    int esc_state, esc_len;
+} input;
+
+/* Starts the reader on fd; on_stop runs on the input thread. */
+int input_start(input *in, int fd, void (*on_stop)(void *arg, uint64_t t_ns), void *arg);
+/* Loop side: next command, 0 if none. */
+int input_pop(input *in, input_cmd *out);
+void input_stop(input *in);
+uint64_t input_now_ns(void);
+
+#endif
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "telemetry.h"
+
+/*
+ * log2csv telemetry-*.bin[.gz] ... > log.csv
+ * Converts telemetry files to CSV in the order given; gaps in seq (records
+ * dropped by the control loop) are reported on stderr.
+ */
+
+#ifdef HAVE_ZLIB
+typedef gzFile log_file;
+#define log_open(p)        gzopen(p, "rb")
+#define log_read(f, b, n)  gzread(f, b, n)
+#define log_close(f)       gzclose(f)
+#else
+typedef FILE *log_file;
+#define log_open(p)        fopen(p, "rb")
+#define log_read(f, b, n)  (int)fread(b, 1, n, f)
+#define log_close(f)       fclose(f)
+#endif
+
+int main(int argc, char **argv) {
+    telemetry_file_header h;
+    telemetry_record r;
+    unsigned long long rows = 0, gaps = 0;
+    uint32_t next_seq = 0;
+    uint64_t t0 = 0;
+    int have_seq = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s telemetry-*.bin[.gz] ...\n", argv[0]);
+        return 1;
+    }
+    printf("t_ms,seq,pwm,duty,dir,speed,acc,gyro,temp,speed_idx,acc_idx,gyro_idx,temp_idx,status,period_us,late_us,target_rpm\n");
+    for (int a = 1; a < argc; a++) {
+        log_file f = log_open(argv[a]);
+        if (f == NULL) {
+            perror(argv[a]);
+            continue;
+        }
+        if (log_read(f, &h, sizeof(h)) != sizeof(h) || h.magic != TELEMETRY_MAGIC ||
+            h.version != TELEMETRY_VERSION || h.record_size != sizeof(r)) {
+            fprintf(stderr, "%s: not a telemetry v%d file\n", argv[a], TELEMETRY_VERSION);
+            log_close(f);
+            continue;
+        }
+        if (!have_seq) t0 = h.t_start_ns;   /* times run on from the first file */
+        while (log_read(f, &r, sizeof(r)) == sizeof(r)) {
+            if (have_seq && r.seq != next_seq) {
+                fprintf(stderr, "%s: %u records dropped before seq %u\n", argv[a], r.seq - next_seq, r.seq);
+                gaps += r.seq - next_seq;
+            }
+            have_seq = 1;
+            next_seq = r.seq + 1;
+            printf("%.3f,%u,%d,%.2f,%c,%d,%.4f,%.4f,%.2f,%.3f,%.3f,%.3f,%.3f,%u,%.1f,%.1f,%.1f\n",
+                   (double)(int64_t)(r.t_ns - t0) / 1e6, r.seq, r.pwm, r.duty, r.dir ? r.dir : '-',
+                   r.speed, r.acc, r.gyro, r.temp, r.z[0], r.z[1], r.z[2], r.z[3],
+                   r.status, r.period_us, r.late_us, r.target_rpm);
+            rows++;
+        }
+        log_close(f);
+    }
+    fprintf(stderr, "%llu rows, %llu dropped\n", rows, gaps);
+    return 0;
+}
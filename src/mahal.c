@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mahal.h"
+
+/* chi-square, 4 dof: 1e-3 and 1e-5 of healthy samples beyond */
+#define MAHAL_WARN_D2 18.47f
+#define MAHAL_ERR_D2  28.47f
+/* the temperature follows the room, not the PWM: only a wide band counts */
+#define MAHAL_TEMP_FLOOR 5.0f
+
+#define TRI(i, j) ((i) * ((i) + 1) / 2 + (j))
+
+void mahal_acc_reset(mahal_acc *a) {
+    memset(a, 0, sizeof(*a));
+}
+
+/* Welford, extended to co-moments */
+void mahal_acc_add(mahal_acc *a, const float x[CALIB_CHANNELS]) {
+    double d[CALIB_CHANNELS];
+
+    a->n++;
+    for (int i = 0; i < CALIB_CHANNELS; i++) {
+        d[i] = x[i] - a->mean[i];
+        a->mean[i] += d[i] / a->n;
+    }
+    for (int i = 0; i < CALIB_CHANNELS; i++)
+        for (int j = 0; j <= i; j++) a->m2[TRI(i, j)] += d[i] * (x[j] - a->mean[j]);
+}
+
+void mahal_acc_store(const mahal_acc *a, mahal_entry *e) {
+    e->samples = a->n;
+    for (int i = 0; i < CALIB_CHANNELS; i++) e->mean[i] = a->mean[i];
+    for (int k = 0; k < MAHAL_TRI; k++) e->cov[k] = a->n > 1 ? a->m2[k] / (a->n - 1) : 0.0f;
+}
+
+void mahal_table_init(mahal_table *t, const float std_floor[CALIB_CHANNELS]) {
+    memset(t, 0, sizeof(*t));
+    t->magic = MAHAL_BIN_MAGIC;
+    t->version = MAHAL_BIN_VERSION;
+    t->header_size = offsetof(mahal_table, entry);
+    t->entry_size = sizeof(mahal_entry);
+    t->steps = CALIB_STEPS;
+    t->channels = CALIB_CHANNELS;
+    memcpy(t->std_floor, std_floor, sizeof(t->std_floor));
+    if (t->std_floor[CAL_TEMP] < MAHAL_TEMP_FLOOR) t->std_floor[CAL_TEMP] = MAHAL_TEMP_FLOOR;
+    t->warn_d2 = MAHAL_WARN_D2;
+    t->err_d2 = MAHAL_ERR_D2;
+}
+
+/* a = L L^T in place, lower triangle. Returns -1 if a is not positive definite. */
+static int cholesky(double a[MAHAL_TRI]) {
+    for (int i = 0; i < CALIB_CHANNELS; i++) {
+        for (int j = 0; j <= i; j++) {
+            double s = a[TRI(i, j)];
+            for (int k = 0; k < j; k++) s -= a[TRI(i, k)] * a[TRI(j, k)];
+            if (i == j) {
+                if (s <= 0) return -1;
+                a[TRI(i, i)] = sqrt(s);
+            } else {
+                a[TRI(i, j)] = s / a[TRI(j, j)];
+            }
+        }
+    }
+    return 0;
+}
+
+static void factor_entry(mahal_entry *e, const float std_floor[CALIB_CHANNELS]) {
+    double l[MAHAL_TRI], inv[MAHAL_TRI] = {0};
+
+    for (int k = 0; k < MAHAL_TRI; k++) l[k] = e->cov[k];
+    for (int i = 0; i < CALIB_CHANNELS; i++) {
+        double f = (double)std_floor[i] * std_floor[i];
+        if (l[TRI(i, i)] < f) l[TRI(i, i)] = f;
+    }
+    e->diag = 0;
+    if (cholesky(l) < 0) {
+        /* rank-deficient: keep the floored variances only */
+        e->diag = 1;
+        for (int i = 0; i < CALIB_CHANNELS; i++) {
+            double v = e->cov[TRI(i, i)], f = (double)std_floor[i] * std_floor[i];
+            for (int j = 0; j < i; j++) l[TRI(i, j)] = 0;
+            l[TRI(i, i)] = sqrt(v > f ? v : f);
+        }
+    }
+    /* forward substitution column by column: L inv = I */
+    for (int j = 0; j < CALIB_CHANNELS; j++) {
+        inv[TRI(j, j)] = 1.0 / l[TRI(j, j)];
+        for (int i = j + 1; i < CALIB_CHANNELS; i++) {
+            double s = 0;
+            for (int k = j; k < i; k++) s -= l[TRI(i, k)] * inv[TRI(k, j)];
+            inv[TRI(i, j)] = s / l[TRI(i, i)];
+        }
+    }
+    for (int k = 0; k < MAHAL_TRI; k++) e->inv_chol[k] = inv[k];
+}
+
+void mahal_table_finish(mahal_table *t) {
+    for (int d = 0; d < 2; d++)
+        for (int p = 0; p < CALIB_STEPS; p++) factor_entry(&t->entry[d][p], t->std_floor);
+    t->crc = calib_crc32(t->entry, sizeof(t->entry));
+}
+
+int mahal_table_write(const mahal_table *t, const char *path) {
+    char tmp[280];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL) {
+        perror("File Error cov.bin");
+        return -1;
+    }
+    if (fwrite(t, sizeof(*t), 1, f) != 1 || fclose(f) != 0) {
+        perror("File Error cov.bin");
+        unlink(tmp);
+        return -1;
+    }
+    if (rename(tmp, path) < 0) {
+        perror("File Error cov.bin");
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+const mahal_table *mahal_table_map(const char *path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) < 0 || st.st_size != (off_t)sizeof(mahal_table)) {
+        fprintf(stderr, "%s: unexpected size\n", path);
+        close(fd);
+        return NULL;
+    }
+    const mahal_table *t = mmap(NULL, sizeof(mahal_table), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (t == MAP_FAILED) {
+        perror("mmap cov.bin");
+        return NULL;
+    }
+    const char *why = NULL;
+    if (t->magic != MAHAL_BIN_MAGIC) why = "bad magic";
+    else if (t->version != MAHAL_BIN_VERSION) why = "unsupported version";
+    else if (t->header_size != offsetof(mahal_table, entry) || t->entry_size != sizeof(mahal_entry) ||
+             t->steps != CALIB_STEPS || t->channels != CALIB_CHANNELS) why = "layout mismatch";
+    else if (t->crc != calib_crc32(t->entry, sizeof(t->entry))) why = "checksum mismatch";
+    if (why) {
+        fprintf(stderr, "%s: %s\n", path, why);
+        munmap((void *)t, sizeof(mahal_table));
+        return NULL;
+    }
+    return t;
+}
+
+void mahal_table_unmap(const mahal_table *t) {
+    munmap((void *)t, sizeof(mahal_table));
+}
@@ -0,0 +1,96 @@
+#ifndef MAHAL_H
+#define MAHAL_H
+
+/*
+ * Joint scoring of speed, acc, gyro and temp: the squared Mahalanobis
+ * distance from the calibrated mean under the per-PWM, per-direction
+ * covariance. Deviations that stay inside every single-channel band but
+ * go against the calibrated correlation (slightly slow and slightly
+ * shaky) add up here.
+ *
+ * calib writes cov.bin next to calib.bin, in the same style: native-endian,
+ * checked by magic, version, sizes and CRC-32. Each entry holds the
+ * covariance as measured and the inverse of its Cholesky factor, so that
+ * d2 = |L^-1 (x - mean)|^2 is ten multiply-adds and four squares.
+ */
+
+#include <stdint.h>
+#include "calib_table.h"
+
+#define MAHAL_BIN_MAGIC   0x4C48414Du   /* "MAHL" */
+#define MAHAL_BIN_VERSION 1
+#define MAHAL_TRI         10            /* lower triangle of 4x4, row by row */
+
+typedef struct {
+    float mean[CALIB_CHANNELS];
+    float cov[MAHAL_TRI];               /* as measured */
+    float inv_chol[MAHAL_TRI];          /* L^-1 of the floored covariance */
+    uint32_t samples;                   /* joint samples behind mean/cov */
+    uint32_t diag;                      /* 1: not positive definite, scored without correlations */
+} mahal_entry;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t entry_size;
+    uint32_t steps;
+    uint32_t channels;
+    uint32_t crc;                       /* CRC-32 of entry[][] */
+    uint32_t reserved;
+    float std_floor[CALIB_CHANNELS];    /* raise the variances to floor^2 */
+    float warn_d2, err_d2;              /* chi-square with 4 degrees of freedom */
+    mahal_entry entry[2][CALIB_STEPS];  /* [CALIB_UP / CALIB_DOWN][pwm] */
+} mahal_table;
+
+/* Co-moments of one PWM step, accumulated during calibration. */
+typedef struct {
+    uint32_t n;
+    double mean[CALIB_CHANNELS];
+    double m2[MAHAL_TRI];
+} mahal_acc;
+
+void mahal_acc_reset(mahal_acc *a);
+void mahal_acc_add(mahal_acc *a, const float x[CALIB_CHANNELS]);
+/* Mean and covariance of a into e. */
+void mahal_acc_store(const mahal_acc *a, mahal_entry *e);
+
+/* Zeroed table with the default thresholds and the given std floors
+   (the temperature's widened). */
+void mahal_table_init(mahal_table *t, const float std_floor[CALIB_CHANNELS]);
+/* Factors every entry's covariance into inv_chol, then the CRC. */
+void mahal_table_finish(mahal_table *t);
+int mahal_table_write(const mahal_table *t, const char *path);
+/* Read-only mapping of a validated file, NULL (with a message) otherwise. */
+const mahal_table *mahal_table_map(const char *path);
+void mahal_table_unmap(const mahal_table *t);
+
+static inline float mahal_entry_d2(const mahal_entry *e, const float x[CALIB_CHANNELS]) {
+    const float *l = e->inv_chol;
+    float r0 = x[0] - e->mean[0], r1 = x[1] - e->mean[1];
+    float r2 = x[2] - e->mean[2], r3 = x[3] - e->mean[3];
+    float w0 = l[0] * r0;
+    float w1 = l[1] * r0 + l[2] * r1;
+    float w2 = l[3] * r0 + l[4] * r1 + l[5] * r2;
+    float w3 = l[6] * r0 + l[7] * r1 + l[8] * r2 + l[9] * r3;
+    return w0 * w0 + w1 * w1 + w2 * w2 + w3 * w3;
+}
+
+/* Squared distance at a fractional duty, against mean and factor blended
+   between the two nearest steps. */
+static inline float mahal_d2(const mahal_table *t, const float x[CALIB_CHANNELS], float pwm, int dir) {
+    if (pwm < 0) pwm = 0;
+    if (pwm > CALIB_STEPS - 1) pwm = CALIB_STEPS - 1;
+    int lo = (int)pwm;
+    float f = pwm - lo;
+    const mahal_entry *a = &t->entry[dir][lo];
+    if (f == 0) return mahal_entry_d2(a, x);
+
+    const mahal_entry *b = a + 1;
+    mahal_entry e;
+    for (int c = 0; c < CALIB_CHANNELS; c++) e.mean[c] = a->mean[c] + f * (b->mean[c] - a->mean[c]);
+    for (int k = 0; k < MAHAL_TRI; k++) e.inv_chol[k] = a->inv_chol[k] + f * (b->inv_chol[k] - a->inv_chol[k]);
+    return mahal_entry_d2(&e, x);
+}
+
+#endif
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "zscore.h"
+#include "mahal.h"
+
+/*
+ * mahal_bench <calib.bin> <cov.bin> [--samples=<n>]
+ * Cost per sample of the joint score against the four per-channel checks
+ * the detector already runs, on samples drawn from the calibrated joint
+ * distribution at random fractional duties:
+ *   channels   zscore_batch, one sample per call as in detector_step
+ *   joint      mahal_d2, blended between two PWM steps
+ *   step       mahal_entry_d2 at one step
+ * and the share of these healthy samples each flags as warning / error,
+ * scored at the step they were drawn from.
+ */
+
+#define DEFAULT_SAMPLES 1000000
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double gauss(void) {
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0), v = rand() / (RAND_MAX + 1.0);
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+/* x = mean + L z with L the inverse of the stored inv_chol */
+static void draw(const mahal_entry *e, float x[CALIB_CHANNELS]) {
+    double l[4][4] = {{0}}, m[4][4] = {{0}}, z[4];
+    int k = 0;
+
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j <= i; j++) m[i][j] = e->inv_chol[k++];
+    for (int j = 0; j < 4; j++) {
+        l[j][j] = 1.0 / m[j][j];
+        for (int i = j + 1; i < 4; i++) {
+            double s = 0;
+            for (int q = j; q < i; q++) s -= m[i][q] * l[q][j];
+            l[i][j] = s / m[i][i];
+        }
+    }
+    for (int i = 0; i < 4; i++) z[i] = gauss();
+    for (int i = 0; i < 4; i++) {
+        double s = e->mean[i];
+        for (int j = 0; j <= i; j++) s += l[i][j] * z[j];
+        x[i] = s;
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *paths[2] = {NULL, NULL};
+    size_t n = DEFAULT_SAMPLES;
+    int np = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--samples=", 10) == 0) n = strtoul(argv[i] + 10, NULL, 10);
+        else if (np < 2) paths[np++] = argv[i];
+    }
+    if (np < 2) {
+        fprintf(stderr, "usage: %s <calib.bin> <cov.bin> [--samples=<n>]\n", argv[0]);
+        return 1;
+    }
+    const calib_table *t = calib_table_map(paths[0]);
+    const mahal_table *cov = mahal_table_map(paths[1]);
+    calib_soa *soa = aligned_alloc(16, sizeof(*soa));
+    zscore_sample *in = aligned_alloc(16, n * sizeof(*in));
+    zscore_result *out = aligned_alloc(16, n * sizeof(*out));
+    float *d2 = malloc(n * sizeof(*d2));
+    if (t == NULL || cov == NULL || soa == NULL || in == NULL || out == NULL || d2 == NULL) {
+        fprintf(stderr, "cannot load %s / %s\n", paths[0], paths[1]);
+        return 1;
+    }
+    zscore_load(soa, t);
+
+    srand(1);
+    for (size_t i = 0; i < n; i++) {
+        in[i].dir = rand() & 1;
+        in[i].pwm = rand() / (RAND_MAX + 1.0f) * (CALIB_STEPS - 1);
+        draw(&cov->entry[in[i].dir][(int)(in[i].pwm + 0.5f)], in[i].x);
+    }
+
+    uint64_t t0 = mono_ns();
+    for (size_t i = 0; i < n; i++) zscore_batch(soa, &in[i], &out[i], 1);
+    double ch_ns = (double)(mono_ns() - t0) / n;
+
+    t0 = mono_ns();
+    for (size_t i = 0; i < n; i++) d2[i] = mahal_d2(cov, in[i].x, in[i].pwm, in[i].dir);
+    double joint_ns = (double)(mono_ns() - t0) / n;
+
+    volatile float sink = 0;
+    t0 = mono_ns();
+    for (size_t i = 0; i < n; i++) sink += mahal_entry_d2(&cov->entry[in[i].dir][(int)in[i].pwm], in[i].x);
+    double step_ns = (double)(mono_ns() - t0) / n;
+
+    for (size_t i = 0; i < n; i++) {
+        in[i].pwm = (int)(in[i].pwm + 0.5f);
+        zscore_batch(soa, &in[i], &out[i], 1);
+        d2[i] = mahal_d2(cov, in[i].x, in[i].pwm, in[i].dir);
+    }
+    size_t ch_warn = 0, ch_err = 0, j_warn = 0, j_err = 0;
+    for (size_t i = 0; i < n; i++) {
+        /* temperature has absolute bands in the detector, not z */
+        ch_warn += (out[i].warn & 7) != 0;
+        ch_err += (out[i].err & 7) != 0;
+        j_warn += d2[i] >= cov->warn_d2;
+        j_err += d2[i] >= cov->err_d2;
+    }
+
+    printf("zscore: %s, %zu samples\n", zscore_impl(), n);
+    printf("%-10s %10s %10s %10s\n", "score", "ns/sample", "warn %", "error %");
+    printf("%-10s %10.2f %10.4f %10.4f\n", "channels", ch_ns, 100.0 * ch_warn / n, 100.0 * ch_err / n);
+    printf("%-10s %10.2f %10.4f %10.4f\n", "joint", joint_ns, 100.0 * j_warn / n, 100.0 * j_err / n);
+    printf("%-10s %10.2f\n", "step", step_ns);
+
+    free(d2);
+    free(out);
+    free(in);
+    free(soa);
+    mahal_table_unmap(cov);
+    calib_table_unmap(t);
+    return 0;
+}
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "metrics.h"
+#include "tracepoint.h"
+
+#define METRICS_POLL_MS     200     /* stop flag check while idle */
+#define METRICS_REQUEST_MS  100     /* wait for a request line, then send bare text */
+
+static const char *const type_name[] = {"counter", "gauge", "histogram"};
+
+void metrics_init(metrics *m) {
+    memset(m, 0, sizeof(*m));
+    m->listen_fd = -1;
+}
+
+static int metrics_register(metrics *m, metric_type type, const char *name, const char *help,
+                            const char *labels, int slots) {
+    if (m->n_defs == METRICS_MAX || m->n_slots + slots > METRICS_SLOTS) {
+        fprintf(stderr, "metrics: no room for %s\n", name);
+        return -1;
+    }
+    metric_def *d = &m->def[m->n_defs++];
+    d->name = name;
+    d->help = help;
+    snprintf(d->labels, sizeof(d->labels), "%s", labels ? labels : "");
+    d->type = type;
+    d->slot = m->n_slots;
+    m->n_slots += slots;
+    return d->slot;
+}
+
+int metrics_counter(metrics *m, const char *name, const char *help, const char *labels) {
+    return metrics_register(m, METRIC_COUNTER, name, help, labels, 1);
+}
+
+int metrics_gauge(metrics *m, const char *name, const char *help, const char *labels) {
+    return metrics_register(m, METRIC_GAUGE, name, help, labels, 1);
+}
+
+/* buckets 0..METRICS_HIST_BINS (the last one +Inf), then sum_ns */
+int metrics_histogram(metrics *m, const char *name, const char *help, const char *labels) {
+    return metrics_register(m, METRIC_HISTOGRAM, name, help, labels, METRICS_HIST_BINS + 2);
+}
+
+metrics_shard *metrics_thread(metrics *m) {
+    int k = atomic_fetch_add(&m->n_shards, 1);
+    if (k >= METRICS_SHARDS) {
+        fprintf(stderr, "metrics: more than %d threads, updates dropped\n", METRICS_SHARDS);
+        return NULL;
+    }
+    return &m->shard[k];
+}
+
+static uint64_t slot_sum_u(const metrics *m, int slot) {
+    uint64_t sum = 0;
+    for (int k = 0; k < METRICS_SHARDS; k++)
+        sum += atomic_load_explicit(&((metrics *)m)->shard[k].v[slot], memory_order_relaxed);
+    return sum;
+}
+
+static double slot_sum_d(const metrics *m, int slot) {
+    double sum = 0;
+    for (int k = 0; k < METRICS_SHARDS; k++) {
+        union { uint64_t u; double d; } v = {
+            atomic_load_explicit(&((metrics *)m)->shard[k].v[slot], memory_order_relaxed) };
+        sum += v.d;
+    }
+    return sum;
+}
+
+/* name{labels,extra} with the braces only when there is something inside */
+static void series(FILE *f, const metric_def *d, const char *suffix, const char *extra) {
+    const char *sep = d->labels[0] && extra[0] ? "," : "";
+    if (d->labels[0] || extra[0]) fprintf(f, "%s%s{%s%s%s} ", d->name, suffix, d->labels, sep, extra);
+    else fprintf(f, "%s%s ", d->name, suffix);
+}
+
+static void render_def(const metrics *m, const metric_def *d, FILE *f) {
+    if (d->type != METRIC_HISTOGRAM) {
+        series(f, d, "", "");
+        fprintf(f, "%.9g\n", slot_sum_d(m, d->slot));
+        return;
+    }
+    uint64_t cum = 0;
+    char le[32];
+    for (int b = 0; b <= METRICS_HIST_BINS; b++) {
+        cum += slot_sum_u(m, d->slot + b);
+        if (b < METRICS_HIST_BINS) snprintf(le, sizeof(le), "le=\"%.9g\"", (double)(1ULL << b) * 1e-6);
+        else snprintf(le, sizeof(le), "le=\"+Inf\"");
+        series(f, d, "_bucket", le);
+        fprintf(f, "%llu\n", (unsigned long long)cum);
+    }
+    series(f, d, "_sum", "");
+    fprintf(f, "%.9g\n", slot_sum_u(m, d->slot + METRICS_HIST_BINS + 1) / 1e9);
+    series(f, d, "_count", "");
+    fprintf(f, "%llu\n", (unsigned long long)cum);
+}
+
+void metrics_render(metrics *m, FILE *f) {
+    for (int i = 0; i < m->n_defs; i++) {
+        const metric_def *d = &m->def[i];
+        int seen = 0;
+        for (int j = 0; j < i && !seen; j++) seen = strcmp(m->def[j].name, d->name) == 0;
+        if (seen) continue;
+        fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", d->name, d->help, d->name, type_name[d->type]);
+        for (int j = i; j < m->n_defs; j++)
+            if (strcmp(m->def[j].name, d->name) == 0) render_def(m, &m->def[j], f);
+    }
+}
+
+static void write_all(int fd, const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        p += n;
+        len -= n;
+    }
+}
+
+static void serve_client(metrics *m, int fd) {
+    char req[1024];
+    size_t got = 0;
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+    /* up to the end of the request head, or nothing at all */
+    while (got < sizeof(req) - 1 && poll(&pfd, 1, METRICS_REQUEST_MS) > 0) {
+        ssize_t n = read(fd, req + got, sizeof(req) - 1 - got);
+        if (n <= 0) break;
+        got += n;
+        req[got] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+    }
+    req[got] = '\0';
+
+    char *body = NULL;
+    size_t body_len = 0;
+    FILE *f = open_memstream(&body, &body_len);
+    if (f == NULL) return;
+    metrics_render(m, f);
+    fclose(f);
+
+    if (got == 0) {
+        write_all(fd, body, body_len);
+    } else if (strncmp(req, "GET /metrics", 12) == 0 || strncmp(req, "GET / ", 6) == 0) {
+        char head[160];
+        int n = snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: %zu\r\nConnection: close\r\n\r\n", body_len);
+        write_all(fd, head, n);
+        write_all(fd, body, body_len);
+    } else {
+        static const char nf[] = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        write_all(fd, nf, sizeof(nf) - 1);
+    }
+    free(body);
+    atomic_fetch_add(&m->scrapes, 1);
+}
+
+/* One client at a time: a scrape costs a few hundred microseconds. */
+static void *metrics_thread_main(void *arg) {
+    metrics *m = arg;
+    struct pollfd pfd = { .fd = m->listen_fd, .events = POLLIN };
+
+    TP_THREAD("metrics");
+    while (!atomic_load(&m->stop)) {
+        if (poll(&pfd, 1, METRICS_POLL_MS) <= 0) continue;
+        int fd = accept(m->listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+        /* a client that stops reading does not hold up the next scrape */
+        struct timeval tv = { .tv_sec = 1 };
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        TP_BEGIN("scrape");
+        serve_client(m, fd);
+        TP_END("scrape");
+        close(fd);
+    }
+    return NULL;
+}
+
+static int listen_unix(metrics *m, const char *path) {
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+        fprintf(stderr, "metrics: socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(sa.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(fd, 4) < 0) {
+        close(fd);
+        return -1;
+    }
+    snprintf(m->unix_path, sizeof(m->unix_path), "%s", path);
+    return fd;
+}
+
+static int listen_tcp(int port) {
+    struct sockaddr_in sa = { .sin_family = AF_INET, .sin_port = htons(port),
+                              .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    int one = 1;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(fd, 4) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int metrics_serve(metrics *m, const char *addr) {
+    m->listen_fd = strchr(addr, '/') ? listen_unix(m, addr) : listen_tcp(atoi(addr));
+    if (m->listen_fd < 0) {
+        perror("metrics listen");
+        return -1;
+    }
+    atomic_store(&m->stop, false);
+    if (pthread_create(&m->thread, NULL, metrics_thread_main, m) != 0) {
+        close(m->listen_fd);
+        m->listen_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void metrics_stop(metrics *m) {
+    if (m->listen_fd < 0) return;
+    atomic_store(&m->stop, true);
+    pthread_join(m->thread, NULL);
+    close(m->listen_fd);
+    m->listen_fd = -1;
+    if (m->unix_path[0]) unlink(m->unix_path);
+}
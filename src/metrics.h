@@ -0,0 +1,103 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/*
+ * Counters, gauges and latency histograms in the Prometheus text format,
+ * served by a thread of their own on a Unix socket or a localhost TCP port.
+ *
+ * Every metric is registered at startup, before any thread updates it.
+ * Each updating thread then takes a shard of its own with metrics_thread()
+ * and is its only writer: an update is a relaxed load and store of one
+ * 64-bit slot, no lock, no read-modify-write, so the control loop never
+ * waits on a scrape. The scrape sums the shards. A gauge is meant to be set
+ * from one thread only.
+ *
+ * A client sending "GET /metrics" gets an HTTP/1.0 response, so curl and
+ * Prometheus work directly; one that sends nothing gets the bare text,
+ * e.g. `nc -U <socket>`.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define METRICS_MAX        128      /* registered series */
+#define METRICS_SLOTS      1024     /* 64-bit values per shard */
+#define METRICS_SHARDS     8        /* updating threads */
+/* Histogram buckets: le 1 us * 2^k for k < METRICS_HIST_BINS, then +Inf. */
+#define METRICS_HIST_BINS  24
+
+typedef enum { METRIC_COUNTER, METRIC_GAUGE, METRIC_HISTOGRAM } metric_type;
+
+typedef struct {
+    const char *name, *help;
+    char labels[64];                /* name="value",... without braces, may be empty */
+    metric_type type;
+    int slot;                       /* first value slot */
+} metric_def;
+
+typedef struct {
+    _Atomic uint64_t v[METRICS_SLOTS];  /* double bits; histogram buckets and sum_ns as integers */
+} metrics_shard;
+
+typedef struct {
+    metric_def def[METRICS_MAX];
+    int n_defs, n_slots;
+    metrics_shard shard[METRICS_SHARDS];
+    _Atomic int n_shards;
+
+    int listen_fd;
+    char unix_path[108];            /* unlinked on stop */
+    pthread_t thread;
+    atomic_bool stop;
+    _Atomic uint64_t scrapes;
+} metrics;
+
+void metrics_init(metrics *m);
+/* Registration, single-threaded. Returns the id (the series' first slot),
+   -1 when full. labels may be NULL. Series of the same name share one
+   HELP/TYPE header. */
+int metrics_counter(metrics *m, const char *name, const char *help, const char *labels);
+int metrics_gauge(metrics *m, const char *name, const char *help, const char *labels);
+/* Observed in ns, exposed in seconds. */
+int metrics_histogram(metrics *m, const char *name, const char *help, const char *labels);
+
+/* The calling thread's shard, NULL once METRICS_SHARDS are taken (updates
+   to NULL are dropped). */
+metrics_shard *metrics_thread(metrics *m);
+
+static inline void metrics_add(metrics_shard *s, int id, double n) {
+    if (s == NULL || id < 0) return;
+    _Atomic uint64_t *p = &s->v[id];
+    union { uint64_t u; double d; } v = { atomic_load_explicit(p, memory_order_relaxed) };
+    v.d += n;
+    atomic_store_explicit(p, v.u, memory_order_relaxed);
+}
+
+static inline void metrics_set(metrics_shard *s, int id, double x) {
+    if (s == NULL || id < 0) return;
+    union { uint64_t u; double d; } v = { .d = x };
+    atomic_store_explicit(&s->v[id], v.u, memory_order_relaxed);
+}
+
+static inline void metrics_observe_ns(metrics_shard *s, int id, uint64_t ns) {
+    if (s == NULL || id < 0) return;
+    uint64_t us = (ns + 999) / 1000;
+    int bin = us == 0 ? 0 : 64 - __builtin_clzll(us);
+    if (us && (us & (us - 1)) == 0) bin--;  /* exact powers of two belong to their own le */
+    if (bin > METRICS_HIST_BINS) bin = METRICS_HIST_BINS;
+    _Atomic uint64_t *p = &s->v[id];
+    atomic_store_explicit(&p[bin], atomic_load_explicit(&p[bin], memory_order_relaxed) + 1, memory_order_relaxed);
+    p += METRICS_HIST_BINS + 1;
+    atomic_store_explicit(p, atomic_load_explicit(p, memory_order_relaxed) + ns, memory_order_relaxed);
+}
+
+/* The text exposition of everything registered. */
+void metrics_render(metrics *m, FILE *f);
+/* addr: a path (containing '/') for a Unix socket, else a TCP port on
+   127.0.0.1. Starts the server thread; -1 if it cannot listen. */
+int metrics_serve(metrics *m, const char *addr);
+void metrics_stop(metrics *m);
+
+#endif
@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "motor_ctx.h"
+#include "tracepoint.h"
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void motor_ctx_report(motor_ctx *m, MotorStatus status, const char *msg) {
+    if (status != m->last_sent) {
+        m->last_sent = status;
+        m->event = msg;
+    }
+    m->status = status;
+}
+
+static void motor_ctx_close_bands(motor_ctx *m) {
+    if (m->bands) calib_table_unmap(m->bands);
+    spectrum_free(&m->spec);
+    free(m->band_soa);
+    free(m->imu_buf);
+    m->bands = NULL;
+    m->band_soa = NULL;
+    m->imu_buf = NULL;
+}
+
+/* Optional: without bands.bin the raw IMU records are not read at all. */
+static void motor_ctx_open_bands(motor_ctx *m) {
+    spectrum_params sp;
+    char path[MOTOR_PATH_MAX];
+
+    motor_data_path(path, sizeof(path), m->id, "bands.bin");
+
+    if (access(path, R_OK) < 0 || (m->bands = calib_table_map(path)) == NULL) return;
+    spectrum_default_params(&sp);
+    m->band_soa = aligned_alloc(16, sizeof(*m->band_soa));
+    m->imu_buf = malloc(MOTOR_IMU_BATCH * sizeof(*m->imu_buf));
+    if (m->band_soa == NULL || m->imu_buf == NULL || spectrum_init(&m->spec, &sp) < 0) {
+        motor_ctx_close_bands(m);
+        return;
+    }
+    zscore_load(m->band_soa, m->bands);
+    detector_set_bands(&m->det, m->band_soa);
+}
+
+/* Maps calib.bin; falls back to parsing calib.csv from older calibrations. */
+int motor_ctx_open(motor_ctx *m, int id, backend *be, const detector_params *p) {
+    char path[MOTOR_PATH_MAX];
+
+    memset(m, 0, sizeof(*m));
+    m->id = id;
+    m->be = be;
+    m->start_pwm = 25;
+    m->dir = 's';
+    m->going_up = 1;
+    m->status = MOTOR_OK;
+    m->last_sent = MOTOR_IDLE;
+
+    m->calib = calib_table_map(motor_data_path(path, sizeof(path), id, "calib.bin"));
+    if (m->calib == NULL) {
+        m->calib_csv = calloc(1, sizeof(*m->calib_csv));
+        if (m->calib_csv == NULL) return -1;
+        calib_table_read_csv(m->calib_csv, motor_data_path(path, sizeof(path), id, "calib.csv"));
+        m->calib = m->calib_csv;
+    }
+    detector_init(&m->det, m->calib, p);
+    FILE *f_meta = fopen(motor_data_path(path, sizeof(path), id, "motor_meta.csv"), "r");
+    if (f_meta) {
+        fscanf(f_meta, "start_pwm,%d", &m->start_pwm);
+        fclose(f_meta);
+    }
+    speed_tuning tuning;
+    speed_tuning_default(&tuning);
+    speed_tuning_load(&tuning, motor_data_path(path, sizeof(path), id, "speed_tuning.csv"));
+    speed_ctl_init(&m->ctl, m->calib, m->start_pwm, &tuning);
+    motor_ctx_open_bands(m);
+    /* optional as well: calibrations older than cov.bin score per channel only */
+    motor_data_path(path, sizeof(path), id, "cov.bin");
+    if (access(path, R_OK) == 0 && (m->cov = mahal_table_map(path)) != NULL)
+        detector_set_cov(&m->det, m->cov);
+    stats_reset(&m->ambient[0]);
+    stats_reset(&m->ambient[1]);
+    return 0;
+}
+
+void motor_ctx_close(motor_ctx *m) {
+    if (m->adapt) {
+        adapt_close(m->adapt);
+        free(m->adapt);
+        m->adapt = NULL;
+    }
+    if (m->calib_csv) free(m->calib_csv);
+    else if (m->calib) calib_table_unmap(m->calib);
+    m->calib = NULL;
+    m->calib_csv = NULL;
+    motor_ctx_close_bands(m);
+    if (m->cov) mahal_table_unmap(m->cov);
+    m->cov = NULL;
+}
+
+int motor_ctx_adapt(motor_ctx *m) {
+    char bin[MOTOR_PATH_MAX], journal[MOTOR_PATH_MAX];
+
+    if (m->calib_csv) {
+        fprintf(stderr, "motor %d: --adapt needs calib.bin\n", m->id);
+        return -1;
+    }
+    m->adapt = malloc(sizeof(*m->adapt));
+    if (m->adapt == NULL) return -1;
+    if (adapt_open(m->adapt, m->calib, m->det.p.warn_z, m->det.p.err_z, motor_data_path(bin, sizeof(bin), m->id, "adapt.bin"),
+                   motor_data_path(journal, sizeof(journal), m->id, "adapt.journal")) < 0) {
+        free(m->adapt);
+        m->adapt = NULL;
+        return -1;
+    }
+    zscore_load(&m->det.soa, m->adapt->cur);
+    return 0;
+}
+
+/* Only samples the detector found healthy on every score, settled at a
+   calibration step, move the baseline. */
+static void motor_ctx_learn(motor_ctx *m, const detector_input *din) {
+    int p = (int)lrintf(din->duty);
+    uint64_t now = backend_now_ns(m->be);
+
+    if (m->running && m->out.status == MOTOR_OK && m->det.grace <= 0 && m->out.joint_level == 0 &&
+        fabsf(din->duty - p) < ADAPT_BIN_TOL && p > 0 && p < CALIB_STEPS) {
+        int healthy = 1;
+        for (int c = 0; c < CALIB_CHANNELS; c++) healthy &= m->out.level[c] == 0;
+        for (int b = 0; b < SPEC_BANDS; b++) healthy &= m->out.band_level[b] == 0;
+        float x[CALIB_CHANNELS] = {din->speed, din->acc, din->gyro, din->temp};
+        if (healthy && adapt_sample(m->adapt, x, din->dir, p, now))
+            zscore_load_entry(&m->det.soa, m->adapt->cur, din->dir, p);
+    }
+    adapt_flush(m->adapt, now, 0);
+}
+
+int motor_ctx_ambient(motor_ctx *m) {
+    imu_sample imu;
+
+    if (backend_read_imu(m->be, &imu) < 0) {
+        motor_ctx_report(m, MOTOR_ERROR, "IMU DATA LOST!");
+        return -1;
+    }
+    stats_add(&m->ambient[0], imu.acc);
+    stats_add(&m->ambient[1], imu.gyro);
+    return 0;
+}
+
+void motor_ctx_ambient_done(motor_ctx *m) {
+    m->ambient_acc = m->ambient[0].mean;
+    m->ambient_gyro = m->ambient[1].mean;
+}
+
+void motor_ctx_change(motor_ctx *m, int delta) {
+    m->pwm += delta;
+    m->going_up = delta > 0;
+    detector_setpoint_changed(&m->det);
+}
+
+void motor_ctx_set_speed(motor_ctx *m, float rpm) {
+    int up = rpm > m->target_rpm;
+    float min = speed_ctl_min_rpm(&m->ctl, up ? CALIB_UP : CALIB_DOWN);
+    float max = speed_ctl_max_rpm(&m->ctl, up ? CALIB_UP : CALIB_DOWN);
+
+    if (rpm > max) rpm = max;
+    if (rpm < min) rpm = up ? min : 0;
+    if (rpm == m->target_rpm) return;
+    m->target_rpm = rpm;
+    m->going_up = up;
+    detector_setpoint_changed(&m->det);
+}
+
+int motor_ctx_guard(motor_ctx *m, unsigned wdt_ms, int speed_trip) {
+    struct motor_guard g = { .wdt_ms = wdt_ms };
+
+    if (speed_trip) {
+        float top = fmaxf(speed_ctl_max_rpm(&m->ctl, CALIB_UP), speed_ctl_max_rpm(&m->ctl, CALIB_DOWN));
+        int p = m->start_pwm;
+
+        /* underspeed from the first step that actually turned on the way up */
+        while (p < CALIB_STEPS - 1 && m->ctl.rpm[CALIB_UP][p] <= 0) p++;
+        g.max_rpm = (uint32_t)lrintf(top * GUARD_OVERSPEED);
+        g.min_rpm = (uint32_t)lrintf(m->ctl.rpm[CALIB_UP][p] * GUARD_UNDERSPEED);
+        g.min_duty = p;
+        g.grace_ms = GUARD_GRACE_MS;
+    }
+    return backend_set_guard(m->be, &g);
+}
+
+static const char *const trip_msg[] = {
+    "DRIVER STOPPED THE MOTOR", "WATCHDOG TRIP", "OVERSPEED TRIP", "UNDERSPEED TRIP",
+};
+
+int motor_ctx_step(motor_ctx *m, int ramp_rate) {
+    imu_sample imu;
+
+    m->event = NULL;
+    uint64_t t0 = mono_ns();
+    TP_BEGIN("read_speed");
+    backend_read_speed(m->be, &m->speed);
+    TP_END("read_speed");
+    m->sensor_ns = mono_ns() - t0;
+    if (m->speed_mode) {
+        TP_BEGIN("speed_ctl");
+        m->pwm = (int)lrintf(speed_ctl_update(&m->ctl, m->going_up ? CALIB_UP : CALIB_DOWN, m->target_rpm,
+                                              m->speed, m->duty, backend_now_ns(m->be)));
+        TP_END("speed_ctl");
+    }
+    int i = m->pwm;
+    if (i < 0) i = 0;
+    if (i > 100) i = 100;
+
+    if (i == 0) {
+        m->running = 0;
+    } else if (!m->running) {
+        if (i < m->start_pwm) i = m->start_pwm;
+        if (m->speed > 5) m->running = 1;
+    } else if (!m->going_up && i < m->start_pwm) {
+        i = 0;
+        m->running = 0;
+        backend_set_motor(m->be, 's', 0);
+    }
+    m->pwm = i;
+    m->dir = i > 0 ? 'f' : 's';
+    TP_BEGIN("set_motor");
+    int sent = backend_set_motor_ramp(m->be, m->dir, i, ramp_rate > 0 ? MOTOR_RAMP_SCURVE : MOTOR_RAMP_STEP, ramp_rate);
+    TP_END("set_motor");
+    if (sent < 0 && errno == EIO) {
+        int trip = backend_read_trip(m->be);
+        m->trip = trip_msg[trip >= 0 && trip <= MOTOR_TRIP_UNDERSPEED ? trip : 0];
+        motor_ctx_report(m, MOTOR_ERROR, m->trip);
+        return 1;
+    }
+
+    t0 = mono_ns();
+    TP_BEGIN("read_imu");
+    int got = backend_read_imu(m->be, &imu);
+    TP_END("read_imu");
+    if (got < 0) return -1;
+    m->sensor_ns += mono_ns() - t0;
+    m->imu_age_ns = imu.t_ns ? (int64_t)(backend_now_ns(m->be) - imu.t_ns) : -1;
+    m->acc = imu.acc - m->ambient_acc;
+    m->gyro = imu.gyro - m->ambient_gyro;
+    m->temp = imu.temp;
+
+    /* judged at the duty the driver applies right now */
+    m->duty = i;
+    backend_read_duty(m->be, &m->duty);
+    if (m->bands) {
+        TP_BEGIN("spectrum");
+        size_t n;
+        int windows = 0;
+        do {
+            n = backend_read_imu_records(m->be, m->imu_buf, MOTOR_IMU_BATCH);
+            windows += spectrum_feed(&m->spec, m->imu_buf, n, m->speed);
+        } while (n == MOTOR_IMU_BATCH);
+        if (windows)
+            detector_bands(&m->det, m->spec.valid ? m->spec.band : NULL, m->duty,
+                           m->going_up ? CALIB_UP : CALIB_DOWN);
+        TP_END("spectrum");
+    }
+    /* the detector's windows run on elapsed time, not on steps */
+    uint64_t now = backend_now_ns(m->be);
+    float dt = m->detect_ns ? (now - m->detect_ns) / 1e9f : 0;
+    m->detect_ns = now;
+    detector_input din = { .duty = m->duty, .dir = m->going_up ? CALIB_UP : CALIB_DOWN, .dt = dt,
+                           .speed = m->speed, .acc = m->acc, .gyro = m->gyro, .temp = m->temp };
+    TP_BEGIN("detector");
+    int stop = detector_step(&m->det, &din, &m->out);
+    TP_END("detector");
+    if (m->adapt && !stop) {
+        TP_BEGIN("adapt");
+        motor_ctx_learn(m, &din);
+        TP_END("adapt");
+    }
+    if (m->out.msg) motor_ctx_report(m, m->out.status, m->out.msg);
+    return stop;
+}
+
+void motor_ctx_stop(motor_ctx *m, MotorStatus status, const char *msg) {
+    motor_ctx_report(m, status, msg);
+    m->pwm = 0;
+    m->target_rpm = 0;
+    speed_ctl_reset(&m->ctl);
+    m->running = 0;
+    backend_set_motor(m->be, 's', 0);
+}
@@ -0,0 +1,95 @@
+#ifndef MOTOR_CTX_H
+#define MOTOR_CTX_H
+
+/*
+ * Everything main keeps per motor: its backend, calibration and detector,
+ * the setpoint logic (start_pwm kick, cut-off below start_pwm on the way
+ * down) and the readings of the last step. main steps all motors from one
+ * loop; nothing in here is shared, so a step costs the same for any number
+ * of motors.
+ */
+
+#include "backend.h"
+#include "calib_table.h"
+#include "detector.h"
+#include "stats.h"
+#include "speed_ctl.h"
+#include "spectrum.h"
+#include "adapt.h"
+
+/* IMU records read per call while draining them into the spectrum */
+#define MOTOR_IMU_BATCH 256
+
+/* --speed-trip limits, from the calibrated speed curve */
+#define GUARD_OVERSPEED  1.25f      /* of the fastest calibrated speed */
+#define GUARD_UNDERSPEED 0.5f       /* of the slowest calibrated speed */
+#define GUARD_GRACE_MS   1500       /* spin-up after a setpoint change */
+
+typedef struct {
+    int id;
+    backend *be;
+    const calib_table *calib;
+    calib_table *calib_csv;     /* parsed calib.csv when calib.bin is missing */
+    detector det;
+    int start_pwm;
+
+    int pwm;                    /* setpoint, % */
+    char dir;
+    int going_up, running;
+
+    /* speed-setpoint mode: pwm follows target_rpm */
+    int speed_mode;
+    float target_rpm;
+    speed_ctl ctl;
+
+    const mahal_table *cov;     /* joint scoring, only with a cov.bin */
+    adapt *adapt;               /* --adapt: baselines follow healthy running */
+
+    /* vibration bands, only with a bands.bin from calib --spectrum */
+    const calib_table *bands;
+    calib_soa *band_soa;
+    spectrum spec;
+    imu_record *imu_buf;
+
+    stats ambient[2];           /* acc, gyro at standstill */
+    float ambient_acc, ambient_gyro;
+
+    /* last step */
+    int speed;
+    float duty, acc, gyro, temp;
+    detector_output out;
+    MotorStatus status;
+    MotorStatus last_sent;
+    const char *event;          /* message for a status change, NULL if none */
+    const char *trip;           /* the driver's guard stopped the motor */
+    uint64_t sensor_ns;         /* wall time spent reading speed and IMU */
+    int64_t imu_age_ns;         /* of the IMU sample, -1 if the backend cannot tell */
+    uint64_t detect_ns;         /* backend clock of the last detector step, 0 before */
+} motor_ctx;
+
+/* Loads the motor's calibration, motor_meta.csv, speed_tuning.csv and, if
+   present, cov.bin and bands.bin from its data dir. */
+int motor_ctx_open(motor_ctx *m, int id, backend *be, const detector_params *p);
+void motor_ctx_close(motor_ctx *m);
+/* --adapt: scores against adapt.bin/adapt.journal from now on and keeps
+   them updated (adapt.h). Needs a calib.bin. */
+int motor_ctx_adapt(motor_ctx *m);
+/* One ambient reading while the motor stands still; -1 if the IMU is lost. */
+int motor_ctx_ambient(motor_ctx *m);
+void motor_ctx_ambient_done(motor_ctx *m);
+/* Arms the driver's heartbeat watchdog (wdt_ms, 0 = off) and, with
+   speed_trip, its over/underspeed trip. */
+int motor_ctx_guard(motor_ctx *m, unsigned wdt_ms, int speed_trip);
+/* Setpoint change of delta % from the keyboard. */
+void motor_ctx_change(motor_ctx *m, int delta);
+/* Speed-setpoint mode: new target in rpm. Targets below the speed at
+   start_pwm stop the motor when lowering and start at it when raising. */
+void motor_ctx_set_speed(motor_ctx *m, float rpm);
+/* Sends the setpoint, reads the sensors and runs the detector. Returns 1 if
+   the motor must be stopped (or the driver already tripped), -1 if the IMU
+   is lost, 0 otherwise. */
+int motor_ctx_step(motor_ctx *m, int ramp_rate);
+/* Stops the motor now and reports msg once per status change. */
+void motor_ctx_stop(motor_ctx *m, MotorStatus status, const char *msg);
+
+#endif
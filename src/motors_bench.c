@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "motor_ctx.h"
+
+/*
+ * motors_bench [--max=<n>] [--iters=<n>] [--backend=sim[:opts]]
+ * Runs main's single loop over 1, 2, 4, ... max simulated motors and
+ * prints the cost of one motor step (setpoint, sensors, detector) and of
+ * keeping the plants on the loop's clock. All motors use motor 0's
+ * calibration. A flat ns/step column means adding a motor costs the same
+ * as the first one.
+ */
+
+#define BENCH_PERIOD_US 10000
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    int max = 64, iters = 20000;
+    const char *spec = "sim";
+    detector_params p;
+    double base_ns = 0;
+
+    for (int a = 1; a < argc; a++) {
+        if (strncmp(argv[a], "--max=", 6) == 0) max = atoi(argv[a] + 6);
+        else if (strncmp(argv[a], "--iters=", 8) == 0) iters = atoi(argv[a] + 8);
+        else if (strncmp(argv[a], "--backend=", 10) == 0) spec = argv[a] + 10;
+    }
+    if (strncmp(spec, "sim", 3) != 0 || max < 1 || iters < 1) {
+        fprintf(stderr, "Usage: %s [--max=n] [--iters=n] [--backend=sim[:opts]]\n", argv[0]);
+        return 1;
+    }
+    motor_ctx *m = calloc(max, sizeof(*m));
+    if (m == NULL) {
+        perror("motors_bench");
+        return 1;
+    }
+    detector_default_params(&p);
+
+    printf("motors,steps,step_ns,sync_ns,loop_us,step_vs_1\n");
+    for (int n = 1; n <= max; n *= 2) {
+        for (int k = 0; k < n; k++) {
+            backend *be = backend_open(spec, k);
+            if (be == NULL || motor_ctx_open(&m[k], 0, be, &p) < 0) return 1;
+            m[k].id = k;
+        }
+        /* ambient at standstill, then every motor to 50 % */
+        for (int i = 0; i < 50; i++) {
+            for (int k = 0; k < n; k++) motor_ctx_ambient(&m[k]);
+            backend_sleep_us(m[0].be, 100000);
+            for (int k = 1; k < n; k++) backend_sync_ns(m[k].be, backend_now_ns(m[0].be));
+        }
+        for (int k = 0; k < n; k++) {
+            motor_ctx_ambient_done(&m[k]);
+            motor_ctx_change(&m[k], 50);
+        }
+
+        double step_s = 0, sync_s = 0;
+        for (int it = 0; it < iters; it++) {
+            double t0 = now_s();
+            for (int k = 0; k < n; k++) motor_ctx_step(&m[k], 25);
+            double t1 = now_s();
+            backend_sleep_us(m[0].be, BENCH_PERIOD_US);
+            uint64_t t = backend_now_ns(m[0].be);
+            for (int k = 1; k < n; k++) backend_sync_ns(m[k].be, t);
+            sync_s += now_s() - t1;
+            step_s += t1 - t0;
+        }
+        double step_ns = step_s * 1e9 / ((double)iters * n);
+        if (n == 1) base_ns = step_ns;
+        printf("%d,%lld,%.1f,%.1f,%.2f,%.2f\n", n, (long long)iters * n, step_ns,
+               sync_s * 1e9 / ((double)iters * n), (step_s + sync_s) * 1e6 / iters, step_ns / base_ns);
+        fflush(stdout);
+
+        for (int k = 0; k < n; k++) {
+            backend_close(m[k].be);
+            motor_ctx_close(&m[k]);
+        }
+    }
+    free(m);
+    return 0;
+}
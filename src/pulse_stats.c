@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/mman.h>
+#include "pulse_stats.h"
+#include "stats.h"
+
+#define PULSE_MAX_WINDOW 512
+
+int pulse_open(pulse_source *ps, const char *dev) {
+    ps->ring = NULL;
+    ps->fd = open(dev, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (ps->fd < 0) return -1;
+    void *map = mmap(NULL, sizeof(struct speed_pulse_ring), PROT_READ, MAP_SHARED, ps->fd, 0);
+    if (map == MAP_FAILED) {
+        close(ps->fd);
+        ps->fd = -1;
+        return -1;
+    }
+    ps->ring = map;
+    return 0;
+}
+
+void pulse_close(pulse_source *ps) {
+    if (ps->ring) munmap((void *)ps->ring, sizeof(struct speed_pulse_ring));
+    if (ps->fd >= 0) close(ps->fd);
+    ps->ring = NULL;
+    ps->fd = -1;
+}
+
+void pulse_drain(const pulse_source *ps) {
+    uint64_t ts[64];
+
+    if (ps->fd < 0) return;
+    while (read(ps->fd, ts, sizeof(ts)) == (ssize_t)sizeof(ts))
+        ;
+}
+
+/* Copies the newest edges, newest first, stopping at the window start. */
+static int pulse_snapshot(const struct speed_pulse_ring *ring, uint64_t from_ns, uint64_t *ts) {
+    for (;;) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        int n = 0;
+
+        while (n < PULSE_MAX_WINDOW && (uint64_t)n < head && n < SPEED_RING_SIZE) {
+            uint64_t t = ring->ts[(head - 1 - n) & (SPEED_RING_SIZE - 1)];
+            if (t <= from_ns) break;
+            ts[n++] = t;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        /* retry if the IRQ lapped the entries we just copied */
+        if (__atomic_load_n(&ring->head, __ATOMIC_RELAXED) - head < (uint64_t)(SPEED_RING_SIZE - n))
+            return n;
+    }
+}
+
+int pulse_window(const pulse_source *ps, uint64_t now_ns, uint64_t window_ns, int holes, pulse_stats *out) {
+    uint64_t ts[PULSE_MAX_WINDOW];
+
+    memset(out, 0, sizeof(*out));
+    if (!ps->ring) return -1;
+
+    int n = pulse_snapshot(ps->ring, now_ns > window_ns ? now_ns - window_ns : 0, ts);
+    out->pulses = n;
+    if (n < 2) return 0;
+
+    /* ts[] runs newest to oldest; walk the intervals oldest first */
+    stats iv;
+    double st = 0, sr = 0, stt = 0, str = 0;
+    stats_reset(&iv);
+    for (int i = n - 1; i > 0; i--) {
+        double dt = (double)(ts[i - 1] - ts[i]);
+        double t = (double)(ts[i - 1] - ts[n - 1]) * 1e-9;
+        double rpm = 60e9 / (dt * holes);
+
+        stats_add(&iv, dt);
+        st += t; sr += rpm; stt += t * t; str += t * rpm;
+    }
+    out->rpm = (float)(60e9 * (n - 1) / ((double)(ts[0] - ts[n - 1]) * holes));
+    int k = iv.n;
+    out->jitter = k > 1 ? (float)(sqrt(stats_sample_var(&iv)) / iv.mean) : 0;
+    double den = k * stt - st * st;
+    out->accel = (k > 1 && den > 0) ? (float)((k * str - st * sr) / den) : 0;
+    return 0;
+}
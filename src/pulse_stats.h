@@ -0,0 +1,29 @@
+#ifndef PULSE_STATS_H
+#define PULSE_STATS_H
+
+#include <stdint.h>
+#include "../drivers/speed_pulses.h"
+
+typedef struct {
+    int fd;
+    const struct speed_pulse_ring *ring;
+} pulse_source;
+
+typedef struct {
+    float rpm;          /* mean speed over the window */
+    float accel;        /* rpm/s, slope of per-interval speed over the window */
+    float jitter;       /* std/mean of the inter-pulse intervals */
+    int pulses;         /* edges that fell inside the window */
+} pulse_stats;
+
+/* Maps a /dev/speed_pulses node read-only. Returns -1 if the driver lacks it.
+   fd polls POLLIN on every new edge until pulse_drain(). */
+int pulse_open(pulse_source *ps, const char *dev);
+void pulse_close(pulse_source *ps);
+/* Consumes the edges queued on fd, so poll() blocks until the next one;
+   the mapped ring, which pulse_window() reads, is unaffected. */
+void pulse_drain(const pulse_source *ps);
+/* Statistics over the edges in (now_ns - window_ns, now_ns]. */
+int pulse_window(const pulse_source *ps, uint64_t now_ns, uint64_t window_ns, int holes, pulse_stats *out);
+
+#endif
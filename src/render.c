@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "render.h"
+
+/* A skipped stretch shorter than this is cheaper to rewrite than to jump over. */
+#define RENDER_MAX_GAP 6
+#define RENDER_CELL_MAX 24  /* worst case bytes per cell: cursor move + SGR + char */
+
+int screen_init(screen *s, int fd, int rows, int cols) {
+    memset(s, 0, sizeof(*s));
+    s->fd = fd;
+    s->rows = rows;
+    s->cols = cols;
+    s->cur = calloc((size_t)rows * cols, sizeof(cell));
+    s->prev = calloc((size_t)rows * cols, sizeof(cell));
+    s->out_cap = (size_t)rows * cols * RENDER_CELL_MAX + 64;
+    s->out = malloc(s->out_cap);
+    if (!s->cur || !s->prev || !s->out) {
+        screen_free(s);
+        return -1;
+    }
+    /* len 0 never matches a composed cell, so the first flush draws everything */
+    screen_clear(s);
+    return 0;
+}
+
+void screen_free(screen *s) {
+    free(s->cur);
+    free(s->prev);
+    free(s->out);
+    s->cur = s->prev = NULL;
+    s->out = NULL;
+}
+
+void screen_clear(screen *s) {
+    for (int i = 0; i < s->rows * s->cols; i++) {
+        s->cur[i].ch[0] = ' ';
+        s->cur[i].len = 1;
+        s->cur[i].attr = ATTR_DEFAULT;
+    }
+}
+
+static int utf8_len(unsigned char c) {
+    if (c < 0x80) return 1;
+    if ((c & 0xE0) == 0xC0) return 2;
+    if ((c & 0xF0) == 0xE0) return 3;
+    if ((c & 0xF8) == 0xF0) return 4;
+    return 1;
+}
+
+void screen_put(screen *s, int row, int col, uint8_t attr, const char *text) {
+    int r = row, c = col;
+
+    while (*text) {
+        if (*text == '\n') {
+            r++;
+            c = col;
+            text++;
+            continue;
+        }
+        if (*text == '\r') {
+            text++;
+            continue;
+        }
+        int n = utf8_len((unsigned char)*text);
+        if (r >= 1 && r <= s->rows && c >= 1 && c <= s->cols) {
+            cell *dst = &s->cur[(r - 1) * s->cols + (c - 1)];
+            int k;
+            for (k = 0; k < n && text[k]; k++) dst->ch[k] = text[k];
+            dst->len = k;
+            dst->attr = attr;
+        }
+        for (int k = 0; k < n && *text; k++) text++;
+        c++;
+    }
+}
+
+void screen_printf(screen *s, int row, int col, uint8_t attr, const char *fmt, ...) {
+    char buf[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    screen_put(s, row, col, attr, buf);
+}
+
+static int cell_eq(const cell *a, const cell *b) {
+    return a->len == b->len && a->attr == b->attr && memcmp(a->ch, b->ch, a->len) == 0;
+}
+
+static char *emit_attr(char *p, uint8_t attr) {
+    int colour = attr & 0x0F;
+    p += sprintf(p, "\033[0%s", attr & ATTR_BOLD ? ";1" : "");
+    if (colour) p += sprintf(p, ";%d", 30 + colour);
+    *p++ = 'm';
+    return p;
+}
+
+ssize_t screen_flush(screen *s) {
+    char *p = s->out;
+    int cur_r = -1, cur_c = -1, cur_attr = -1;
+
+    if (s->frames == 0) p += sprintf(p, "\033[?25l\033[2J");
+
+    for (int r = 0; r < s->rows; r++) {
+        cell *row = &s->cur[r * s->cols], *old = &s->prev[r * s->cols];
+        int c = 0;
+        while (c < s->cols) {
+            if (cell_eq(&row[c], &old[c])) {
+                c++;
+                continue;
+            }
+            /* close a short gap by rewriting it when the attribute allows */
+            if (r == cur_r && c > cur_c && c - cur_c <= RENDER_MAX_GAP) {
+                int k;
+                for (k = cur_c; k < c && row[k].attr == cur_attr; k++)
+                    ;
+                if (k == c) {
+                    for (k = cur_c; k < c; k++) {
+                        memcpy(p, row[k].ch, row[k].len);
+                        p += row[k].len;
+                    }
+                    cur_c = c;
+                }
+            }
+            if (r != cur_r || c != cur_c) p += sprintf(p, "\033[%d;%dH", r + 1, c + 1);
+            if (row[c].attr != cur_attr) {
+                p = emit_attr(p, row[c].attr);
+                cur_attr = row[c].attr;
+            }
+            memcpy(p, row[c].ch, row[c].len);
+            p += row[c].len;
+            old[c] = row[c];
+            cur_r = r;
+            cur_c = ++c;
+        }
+    }
+    if (cur_attr > 0) p += sprintf(p, "\033[0m");
+
+    size_t len = p - s->out, done = 0;
+    while (done < len) {
+        ssize_t w = write(s->fd, s->out + done, len - done);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        done += w;
+    }
+    s->frames++;
+    s->bytes += len;
+    s->last_bytes = len;
+    return len;
+}
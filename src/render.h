@@ -0,0 +1,50 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+/*
+ * Off-screen terminal buffer. Frames are composed into cells, diffed
+ * against what the terminal already shows, and the changes go out as
+ * coalesced runs in a single write(). Rows and columns are 1-based, like
+ * the cursor escapes.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* attr: low nibble colour, plus ATTR_BOLD */
+#define ATTR_DEFAULT 0
+#define ATTR_RED     1
+#define ATTR_GREEN   2
+#define ATTR_YELLOW  3
+#define ATTR_BOLD    0x10
+
+typedef struct {
+    char ch[4];         /* one UTF-8 encoded character, one column wide */
+    uint8_t len;
+    uint8_t attr;
+} cell;
+
+typedef struct {
+    int fd;
+    int rows, cols;
+    cell *cur, *prev;   /* frame being composed, frame on the terminal */
+    char *out;
+    size_t out_cap;
+    uint64_t frames;
+    uint64_t bytes;     /* written over all frames */
+    size_t last_bytes;
+} screen;
+
+int screen_init(screen *s, int fd, int rows, int cols);
+void screen_free(screen *s);
+/* Blanks the frame being composed. */
+void screen_clear(screen *s);
+/* Writes text at row/col; '\n' continues at col on the next row, '\r' is dropped. */
+void screen_put(screen *s, int row, int col, uint8_t attr, const char *text);
+void screen_printf(screen *s, int row, int col, uint8_t attr, const char *fmt, ...)
+    __attribute__((format(printf, 5, 6)));
+/* Sends the difference to the terminal. Returns bytes written, -1 on error. */
+ssize_t screen_flush(screen *s);
+
+#endif
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "detector.h"
+#include "trace.h"
+
+/*
+ * replay [options] calib.bin|calib.csv telemetry-*.bin ...
+ * Runs the detector over recorded telemetry as fast as possible and prints
+ * status changes and would-be emergency stops. After a stop the detector
+ * restarts as main would on the next run.
+ *   --warn=<s>,<a>,<g>  --err=<s>,<a>,<g>    sigmas for speed, acc, gyro
+ *   --limits=<s>,<a>,<g>,<t>                 seconds of consecutive errors before a stop
+ *   --tau=<s>  --grace=<s>  --startup-grace=<s>  --joint-limit=<s>
+ *   --temp=<err_lo>,<warn_lo>,<warn_hi>,<err_hi>
+ *   --repeat=<n>   run n passes for the throughput figure
+ *   -q             summary only
+ */
+
+static const char *const status_name[] = {"IDLE", "OK", "WARNING", "ERROR"};
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int parse_param(detector_params *p, const char *arg) {
+    if (strncmp(arg, "--warn=", 7) == 0)
+        return sscanf(arg + 7, "%f,%f,%f", &p->warn_z[0], &p->warn_z[1], &p->warn_z[2]) == 3 ? 0 : -1;
+    if (strncmp(arg, "--err=", 6) == 0)
+        return sscanf(arg + 6, "%f,%f,%f", &p->err_z[0], &p->err_z[1], &p->err_z[2]) == 3 ? 0 : -1;
+    if (strncmp(arg, "--limits=", 9) == 0)
+        return sscanf(arg + 9, "%f,%f,%f,%f", &p->err_s[0], &p->err_s[1],
+                      &p->err_s[2], &p->err_s[3]) == 4 ? 0 : -1;
+    if (strncmp(arg, "--tau=", 6) == 0) return sscanf(arg + 6, "%f", &p->tau_s) == 1 ? 0 : -1;
+    if (strncmp(arg, "--grace=", 8) == 0) return sscanf(arg + 8, "%f", &p->grace_s) == 1 ? 0 : -1;
+    if (strncmp(arg, "--startup-grace=", 16) == 0) return sscanf(arg + 16, "%f", &p->startup_grace_s) == 1 ? 0 : -1;
+    if (strncmp(arg, "--joint-limit=", 14) == 0) return sscanf(arg + 14, "%f", &p->joint_err_s) == 1 ? 0 : -1;
+    if (strncmp(arg, "--temp=", 7) == 0)
+        return sscanf(arg + 7, "%f,%f,%f,%f", &p->temp_err_lo, &p->temp_warn_lo,
+                      &p->temp_warn_hi, &p->temp_err_hi) == 4 ? 0 : -1;
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    detector_params params;
+    static calib_table from_csv;
+    static detector det;
+    const calib_table *calib = NULL;
+    trace *traces = calloc(argc, sizeof(trace));
+    int n_traces = 0, repeat = 1, quiet = 0;
+
+    detector_default_params(&params);
+    for (int a = 1; a < argc; a++) {
+        if (strncmp(argv[a], "--repeat=", 9) == 0) repeat = atoi(argv[a] + 9);
+        else if (strcmp(argv[a], "-q") == 0) quiet = 1;
+        else if (strncmp(argv[a], "--", 2) == 0) {
+            if (parse_param(&params, argv[a]) < 0) {
+                fprintf(stderr, "Bad option %s\n", argv[a]);
+                return 1;
+            }
+        } else if (calib == NULL) {
+            calib = calib_table_map(argv[a]);
+            if (calib == NULL) {
+                if (calib_table_read_csv(&from_csv, argv[a]) <= 0) return 1;
+                calib = &from_csv;
+            }
+        } else if (trace_load(&traces[n_traces], argv[a]) == 0) {
+            n_traces++;
+        }
+    }
+    if (calib == NULL || n_traces == 0) {
+        fprintf(stderr, "Usage: %s [options] calib.bin telemetry-*.bin ...\n", argv[0]);
+        return 1;
+    }
+    if (repeat < 1) repeat = 1;
+
+    unsigned long long samples = 0, warnings = 0, errors = 0, stops = 0, agree = 0;
+    detector_output out;
+    double t0 = now_s();
+
+    for (int pass = 0; pass < repeat; pass++) {
+        int report = pass == 0 && !quiet;
+        for (int k = 0; k < n_traces; k++) {
+            const trace *tr = &traces[k];
+            MotorStatus last = MOTOR_IDLE;
+
+            detector_init(&det, calib, &params);
+            if (report) printf("# %s: %zu samples\n", tr->name, tr->n);
+            for (size_t j = 0; j < tr->n; j++) {
+                const trace_sample *s = &tr->s[j];
+                if (s->new_setpoint) detector_setpoint_changed(&det);
+                int stop = detector_step(&det, &s->in, &out);
+                double t_ms = (s->t_ns - tr->s[0].t_ns) / 1e6;
+
+                if (pass == 0) {
+                    if (out.status != last && out.status == MOTOR_WARNING) warnings++;
+                    if (out.status != last && out.status == MOTOR_ERROR) errors++;
+                    if (out.status == s->status) agree++;
+                }
+                if (report && out.status != last)
+                    printf("%12.1f  pwm %3d  %-7s  %s\n", t_ms, s->pwm, status_name[out.status],
+                           out.msg ? out.msg : "");
+                last = out.status;
+                if (stop) {
+                    if (pass == 0) stops++;
+                    if (report) printf("%12.1f  pwm %3d  STOP     CRITICAL SENSOR FAILURE\n", t_ms, s->pwm);
+                    detector_reset(&det);
+                    last = MOTOR_IDLE;
+                }
+            }
+            samples += tr->n;
+        }
+    }
+    double dt = now_s() - t0;
+    unsigned long long per_pass = samples / repeat;
+
+    printf("%llu samples, %llu warnings, %llu errors, %llu would-be stops, %.1f%% agree with live status\n",
+           per_pass, warnings, errors, stops, per_pass ? 100.0 * agree / per_pass : 0.0);
+    printf("%.0f samples/s (%d pass%s, %.3f s, %s kernel)\n", samples / dt, repeat,
+           repeat > 1 ? "es" : "", dt, zscore_impl());
+    for (int k = 0; k < n_traces; k++) trace_free(&traces[k]);
+    free(traces);
+    return 0;
+}
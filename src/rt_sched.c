@@ -0,0 +1,99 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "rt_sched.h"
+
+int rt_setup(int fifo_prio, int cpu, int lock_memory) {
+    int ret = 0;
+
+    if (lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        perror("mlockall");
+        ret = -1;
+    }
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+            perror("sched_setaffinity");
+            ret = -1;
+        }
+    }
+    if (fifo_prio > 0) {
+        struct sched_param sp = { .sched_priority = fifo_prio };
+        if (sched_setscheduler(0, SCHED_FIFO, &sp) < 0) {
+            perror("sched_setscheduler");
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+void rt_sched_init(rt_sched *rs, backend *be, unsigned int rate_hz) {
+    memset(rs, 0, sizeof(*rs));
+    rs->be = be;
+    rs->period_ns = 1000000000ULL / (rate_hz ? rate_hz : 1);
+    rs->last_wake_ns = backend_now_ns(be);
+    rs->next_ns = rs->last_wake_ns + rs->period_ns;
+}
+
+static int rt_hist_bin(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    int bin = 0;
+    while (us && bin < RT_HIST_BINS - 1) {
+        us >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+void rt_sched_wait(rt_sched *rs) {
+    uint64_t now = backend_now_ns(rs->be);
+
+    rs->busy_ns = now - rs->last_wake_ns;
+    if (rs->busy_ns > rs->max_busy_ns) rs->max_busy_ns = rs->busy_ns;
+
+    /* Overran: drop the deadlines already in the past instead of bursting. */
+    if (now >= rs->next_ns) {
+        uint64_t behind = (now - rs->next_ns) / rs->period_ns + 1;
+        rs->misses += behind;
+        rs->next_ns += behind * rs->period_ns;
+    }
+
+    backend_sleep_until_ns(rs->be, rs->next_ns);
+
+    now = backend_now_ns(rs->be);
+    rs->last_late_ns = (int64_t)(now - rs->next_ns);
+    if (rs->last_late_ns > rs->max_late_ns) rs->max_late_ns = rs->last_late_ns;
+    rs->hist[rt_hist_bin(rs->last_late_ns > 0 ? (uint64_t)rs->last_late_ns : 0)]++;
+    rs->last_period_ns = now - rs->last_wake_ns;
+    rs->last_wake_ns = now;
+    rs->next_ns += rs->period_ns;
+    rs->iterations++;
+}
+
+uint64_t rt_sched_percentile(const rt_sched *rs, double fraction) {
+    uint64_t total = 0, seen = 0;
+    for (int b = 0; b < RT_HIST_BINS; b++) total += rs->hist[b];
+    if (total == 0) return 0;
+    for (int b = 0; b < RT_HIST_BINS; b++) {
+        seen += rs->hist[b];
+        if (seen >= fraction * total) return b == 0 ? 1000 : (1000ULL << b);
+    }
+    return 1000ULL << (RT_HIST_BINS - 1);
+}
+
+void rt_sched_report(const rt_sched *rs, FILE *out) {
+    fprintf(out, "loop: %llu iterations at %.1f Hz, %llu deadline misses, max late %.1f us, max busy %.1f us\n",
+            (unsigned long long)rs->iterations, 1e9 / rs->period_ns, (unsigned long long)rs->misses,
+            rs->max_late_ns / 1e3, rs->max_busy_ns / 1e3);
+    fprintf(out, "wake-up lateness histogram:\n");
+    for (int b = 0; b < RT_HIST_BINS; b++) {
+        if (rs->hist[b] == 0) continue;
+        if (b == 0) fprintf(out, "  <      1 us: %u\n", rs->hist[b]);
+        else if (b == RT_HIST_BINS - 1) fprintf(out, "  >= %6u us: %u\n", 1u << (b - 1), rs->hist[b]);
+        else fprintf(out, "  < %7u us: %u\n", 1u << b, rs->hist[b]);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef RT_SCHED_H
+#define RT_SCHED_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "backend.h"
+
+/* Lateness histogram: bin 0 is < 1 us, bin k is [2^(k-1), 2^k) us. */
+#define RT_HIST_BINS 18
+
+typedef struct {
+    backend *be;
+    uint64_t period_ns;
+    uint64_t next_ns;           /* absolute deadline of the next wake-up */
+    uint64_t last_wake_ns;
+
+    uint64_t iterations;
+    uint64_t misses;            /* periods skipped because work overran */
+    uint64_t last_period_ns;    /* wake-to-wake time of the last iteration */
+    int64_t last_late_ns;       /* wake-up minus deadline */
+    int64_t max_late_ns;
+    uint64_t busy_ns;           /* work time of the last iteration */
+    uint64_t max_busy_ns;
+    uint32_t hist[RT_HIST_BINS];
+} rt_sched;
+
+/* SCHED_FIFO priority (0 keeps the default policy), CPU pin (-1 for none)
+   and mlockall(). Returns -1 if any of them was refused. */
+int rt_setup(int fifo_prio, int cpu, int lock_memory);
+void rt_sched_init(rt_sched *rs, backend *be, unsigned int rate_hz);
+/* Sleeps until the next absolute deadline and accounts jitter and misses. */
+void rt_sched_wait(rt_sched *rs);
+/* Lateness in ns below which the given fraction (0..1) of wake-ups fell. */
+uint64_t rt_sched_percentile(const rt_sched *rs, double fraction);
+void rt_sched_report(const rt_sched *rs, FILE *out);
+
+#endif
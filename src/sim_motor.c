@@ -0,0 +1,460 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include "backend.h"
+
+/*
+ * Simulated DC motor + encoder + MPU-6050 behind the backend interface.
+ * Time only moves when the caller sleeps, so a run is as fast as the CPU
+ * unless rt=<scale> asks for (scaled) wall-clock pacing.
+ *
+ * Options, comma separated after "sim:":
+ *   seed=<n>                  noise seed
+ *   rt=<scale>                0 = as fast as possible (default), 1 = real time
+ *   start=<pwm>               PWM needed to break away from standstill
+ *   stop=<pwm>                PWM below which a spinning motor stalls
+ *   tau=<s>                   mechanical time constant
+ *   imu_hz=<n>                IMU daemon publish rate
+ *   fault=<kind>@<s>[x<mag>]  inject a fault at virtual time <s> seconds;
+ *                             kinds: imbalance, stall, overheat, encoder, imu
+ *
+ * set_guard behaves like motor_driver's guard, checked every plant step.
+ */
+
+#define SIM_HOLES       20
+#define SIM_MAX_FAULTS  8
+#define SIM_STEP_NS     10000000ULL
+/* speed_driver rate-limits sysfs_notify() to one per SPEED_NOTIFY_NS */
+#define SIM_SPEED_NOTIFY_NS 100000000ULL
+
+typedef enum {
+    FAULT_IMBALANCE,
+    FAULT_STALL,
+    FAULT_OVERHEAT,
+    FAULT_ENCODER,
+    FAULT_IMU
+} fault_kind;
+
+typedef struct {
+    fault_kind kind;
+    uint64_t at_ns;
+    float mag;
+} sim_fault;
+
+typedef struct {
+    uint64_t t_ns;
+    uint64_t rng;
+    float rt_scale;
+    uint64_t imu_period_ns;
+    uint64_t next_imu_ns, next_speed_ns;
+    uint64_t last_record_ns;
+
+    int start_pwm, stop_pwm;
+    float tau, kv, dead_pwm;
+    float amb_temp, tau_temp, heat_per_pwm;
+
+    atomic_int estop;       /* set by emergency_stop from any thread */
+    float duty;
+    int profile, target;
+    float ramp_from, ramp_rate;
+    uint64_t ramp_start_ns;
+    int spinning;
+    float rpm;
+    float temp;
+    float phase;
+
+    struct motor_guard guard;
+    int guard_on;
+    int trip;
+    uint64_t last_kick_ns, setpoint_ns;
+    float overspeed_pulses;     /* pulses in a row above max_rpm */
+
+    sim_fault faults[SIM_MAX_FAULTS];
+    int n_faults;
+} sim_state;
+
+static double sim_uniform(sim_state *s) {
+    s->rng ^= s->rng << 13;
+    s->rng ^= s->rng >> 7;
+    s->rng ^= s->rng << 17;
+    return ((s->rng >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static double sim_gauss(sim_state *s) {
+    double u1 = sim_uniform(s), u2 = sim_uniform(s);
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/* Magnitude of the strongest active fault of a kind, 0 if none. */
+static float sim_fault_mag(const sim_state *s, fault_kind kind) {
+    float mag = 0;
+    for (int i = 0; i < s->n_faults; i++) {
+        if (s->faults[i].kind == kind && s->t_ns >= s->faults[i].at_ns && s->faults[i].mag > mag)
+            mag = s->faults[i].mag;
+    }
+    return mag;
+}
+
+/* Same ramp shapes as motor_driver's pwm_timer_callback. */
+static void sim_update_duty(sim_state *s) {
+    if (atomic_load_explicit(&s->estop, memory_order_relaxed)) {
+        s->target = 0;
+        s->duty = 0;
+    }
+    if (s->duty != s->target) {
+        float span = s->target - s->ramp_from;
+        float len = s->ramp_rate > 0 ? fabsf(span) / s->ramp_rate : 0;
+        float p = len > 0 ? (s->t_ns - s->ramp_start_ns) * 1e-9f / len : 1;
+        if (p >= 1) p = 1;
+        if (s->profile == MOTOR_RAMP_SCURVE) p = p * p * (3 - 2 * p);
+        s->duty = s->ramp_from + span * p;
+        if (p >= 1) s->duty = s->target;
+    }
+    if (!s->spinning && s->duty >= s->start_pwm) s->spinning = 1;
+    else if (s->spinning && s->duty < s->stop_pwm) s->spinning = 0;
+}
+
+static float sim_target_rpm(const sim_state *s) {
+    if (!s->spinning || s->duty <= s->dead_pwm) return 0;
+    float rpm = s->kv * (s->duty - s->dead_pwm);
+    float stall = sim_fault_mag(s, FAULT_STALL);
+    if (stall > 1) stall = 1;
+    return rpm * (1 - stall);
+}
+
+/* motor_driver's guard_timer_callback and speed hook, on plant time; a
+   step of dt seconds counts the pulses it would have brought. */
+static void sim_guard_check(sim_state *s, float dt) {
+    const struct motor_guard *g = &s->guard;
+    int reason = MOTOR_TRIP_NONE;
+
+    if (!s->guard_on || s->trip || (s->target == 0 && s->duty == 0)) {
+        s->overspeed_pulses = 0;
+        return;
+    }
+    if (g->max_rpm && s->rpm > g->max_rpm) s->overspeed_pulses += s->rpm * SIM_HOLES / 60.0f * dt;
+    else s->overspeed_pulses = 0;
+    if (g->wdt_ms && s->t_ns - s->last_kick_ns > (uint64_t)g->wdt_ms * 1000000)
+        reason = MOTOR_TRIP_WATCHDOG;
+    else if (s->overspeed_pulses >= MOTOR_OVERSPEED_PULSES)
+        reason = MOTOR_TRIP_OVERSPEED;
+    else if (g->min_rpm && s->duty >= g->min_duty && s->rpm < g->min_rpm &&
+             s->t_ns - s->setpoint_ns >= (uint64_t)g->grace_ms * 1000000)
+        reason = MOTOR_TRIP_UNDERSPEED;
+    if (reason != MOTOR_TRIP_NONE) {
+        s->trip = reason;
+        s->target = 0;
+        s->duty = 0;
+    }
+}
+
+static void sim_advance(sim_state *s, uint64_t dt_ns) {
+    while (dt_ns > 0) {
+        uint64_t step = dt_ns < SIM_STEP_NS ? dt_ns : SIM_STEP_NS;
+        float dt = step * 1e-9f;
+        sim_update_duty(s);
+        float target = sim_target_rpm(s);
+
+        s->rpm += (target - s->rpm) * (1 - expf(-dt / s->tau));
+        s->phase = fmodf(s->phase + 2 * (float)M_PI * s->rpm / 60.0f * dt, 2 * (float)M_PI);
+
+        float temp_target = s->amb_temp + s->heat_per_pwm * (s->spinning ? s->duty : 0);
+        s->temp += (temp_target - s->temp) * (1 - expf(-dt / s->tau_temp));
+        s->temp += sim_fault_mag(s, FAULT_OVERHEAT) / 60.0f * dt;
+
+        s->t_ns += step;
+        sim_guard_check(s, dt);
+        dt_ns -= step;
+    }
+}
+
+/* Direction only flips the H-bridge, so the plant just sees the duty. */
+static int sim_set_motor_ramp(backend *b, char dir, int pwm, int profile, int rate) {
+    sim_state *s = b->priv;
+
+    if (pwm < 0) pwm = 0;
+    if (pwm > 100) pwm = 100;
+    if (dir != 'f' && dir != 'b') pwm = 0;
+    if (atomic_load_explicit(&s->estop, memory_order_relaxed)) {
+        dir = 's';
+        pwm = 0;
+        profile = MOTOR_RAMP_STEP;
+    }
+    s->last_kick_ns = s->t_ns;
+    if (s->trip) {
+        if (dir == 'f' || dir == 'b') {
+            errno = EIO;
+            return -1;
+        }
+        s->trip = MOTOR_TRIP_NONE;
+    }
+    if (profile == MOTOR_RAMP_STEP) rate = 0;
+    if (pwm == s->target && profile == s->profile) return 0;
+    s->setpoint_ns = s->t_ns;
+
+    s->profile = profile;
+    s->target = pwm;
+    s->ramp_from = s->duty;
+    s->ramp_rate = rate;
+    s->ramp_start_ns = s->t_ns;
+    sim_update_duty(s);
+    return 0;
+}
+
+static int sim_set_motor(backend *b, char dir, int pwm) {
+    return sim_set_motor_ramp(b, dir, pwm, MOTOR_RAMP_STEP, 0);
+}
+
+static int sim_read_duty(backend *b, float *pwm) {
+    sim_state *s = b->priv;
+    *pwm = s->duty;
+    return 0;
+}
+
+/* Mimics speed_driver: rpm from one quantized inter-pulse delta, 0 after 500 ms. */
+static int sim_read_speed(backend *b, int *speed) {
+    sim_state *s = b->priv;
+
+    *speed = 0;
+    if (sim_fault_mag(s, FAULT_ENCODER) > 0) return 0;
+    if (s->rpm <= 0) return 0;
+
+    double delta_ns = 60e9 / (s->rpm * SIM_HOLES);
+    delta_ns *= 1 + 0.02 * sim_gauss(s);
+    if (delta_ns > 500e6 || delta_ns <= 1000) return 0;
+    *speed = (int)(60000000000ULL / ((uint64_t)delta_ns * SIM_HOLES));
+    return 0;
+}
+
+/* Vibration magnitudes at a given shaft phase, before sensor noise. */
+static void sim_vibration(const sim_state *s, float phase, float *acc, float *gyro) {
+    float load = s->rpm / 250.0f;
+    float imbalance = 1 + sim_fault_mag(s, FAULT_IMBALANCE);
+    float shape = 0.7f + 0.3f * sinf(phase);
+    *acc = 0.02f + 0.15f * load * load * imbalance * shape;
+    *gyro = 1.5f + 4.0f * load * load * imbalance * shape;
+}
+
+/* Same reduction as read_mcu: | |acc| - 1g | and |gyro|, printed with %.2f. */
+static int sim_read_imu(backend *b, imu_sample *out) {
+    sim_state *s = b->priv;
+    float acc, gyro;
+
+    if (sim_fault_mag(s, FAULT_IMU) > 0) return -1;
+
+    sim_vibration(s, s->phase, &acc, &gyro);
+    acc += (0.005f + 0.1f * acc) * sim_gauss(s);
+    gyro += (0.1f + 0.1f * gyro) * sim_gauss(s);
+
+    out->acc = roundf(fabsf(acc) * 100) / 100;
+    out->gyro = roundf(fabsf(gyro) * 100) / 100;
+    out->temp = roundf((s->temp + 0.05f * sim_gauss(s)) * 100) / 100;
+    out->t_ns = s->t_ns;
+    return 0;
+}
+
+/*
+ * Records the daemon would have published since the last call, one per IMU
+ * period. Raw axes carry the vibration as a rotating vector at shaft phase.
+ */
+static size_t sim_read_imu_records(backend *b, imu_record *out, size_t max) {
+    sim_state *s = b->priv;
+    size_t n = 0;
+
+    if (sim_fault_mag(s, FAULT_IMU) > 0) {
+        s->last_record_ns = s->t_ns;
+        return 0;
+    }
+    uint64_t t = s->last_record_ns + s->imu_period_ns;
+    if (s->t_ns - s->last_record_ns > max * s->imu_period_ns)
+        t = s->t_ns - (max - 1) * s->imu_period_ns;
+    for (; t <= s->t_ns && n < max; t += s->imu_period_ns, n++) {
+        imu_record *r = &out[n];
+        float phase = s->phase - 2 * (float)M_PI * s->rpm / 60.0f * (s->t_ns - t) * 1e-9f;
+        float acc, gyro;
+
+        sim_vibration(s, phase, &acc, &gyro);
+        float ax = acc * cosf(phase) + 0.005f * sim_gauss(s);
+        float ay = acc * sinf(phase) + 0.005f * sim_gauss(s);
+        float az = 1.0f + 0.005f * sim_gauss(s);
+        float gx = gyro * cosf(phase) + 0.1f * sim_gauss(s);
+        float gy = gyro * sinf(phase) + 0.1f * sim_gauss(s);
+        float gz = 0.1f * sim_gauss(s);
+        float temp = s->temp + 0.05f * sim_gauss(s);
+
+        r->t_ns = t;
+        r->raw[0] = (int16_t)lrintf(ax * 16384.0f);
+        r->raw[1] = (int16_t)lrintf(ay * 16384.0f);
+        r->raw[2] = (int16_t)lrintf(az * 16384.0f);
+        r->raw[3] = (int16_t)lrintf((temp - 36.53f) * 340.0f);
+        r->raw[4] = (int16_t)lrintf(gx * 131.0f);
+        r->raw[5] = (int16_t)lrintf(gy * 131.0f);
+        r->raw[6] = (int16_t)lrintf(gz * 131.0f);
+        r->acc = fabsf(sqrtf(ax * ax + ay * ay + az * az) - 1.0f);
+        r->gyro = sqrtf(gx * gx + gy * gy + gz * gz);
+        r->temp = temp;
+        s->last_record_ns = t;
+    }
+    return n;
+}
+
+static uint64_t sim_now_ns(backend *b) {
+    sim_state *s = b->priv;
+    return s->t_ns;
+}
+
+static void sim_sleep_ns(sim_state *s, uint64_t ns) {
+    if (s->rt_scale > 0) usleep((useconds_t)(ns / 1000 * s->rt_scale));
+    sim_advance(s, ns);
+}
+
+static void sim_sleep_us(backend *b, unsigned int us) {
+    sim_sleep_ns(b->priv, (uint64_t)us * 1000);
+}
+
+static void sim_sleep_until_ns(backend *b, uint64_t t_ns) {
+    sim_state *s = b->priv;
+    if (t_ns > s->t_ns) sim_sleep_ns(s, t_ns - s->t_ns);
+}
+
+/* Wakes on the next IMU publish or, while the shaft turns, the next speed notify. */
+static int sim_wait_data(backend *b, unsigned int timeout_us) {
+    sim_state *s = b->priv;
+    uint64_t deadline = s->t_ns + (uint64_t)timeout_us * 1000;
+    uint64_t next = s->next_imu_ns;
+
+    if (s->rpm > 1.0f && s->next_speed_ns < next) next = s->next_speed_ns;
+    int fresh = next <= deadline;
+    uint64_t until = fresh ? next : deadline;
+    if (until > s->t_ns) sim_sleep_ns(s, until - s->t_ns);
+
+    while (s->next_imu_ns <= s->t_ns) s->next_imu_ns += s->imu_period_ns;
+    while (s->next_speed_ns <= s->t_ns) s->next_speed_ns += SIM_SPEED_NOTIFY_NS;
+    return fresh;
+}
+
+/* Catches the plant up to the loop's clock; sensors published meanwhile are
+   simply there on the next read, as on the board. */
+static void sim_sync_ns(backend *b, uint64_t t_ns) {
+    sim_state *s = b->priv;
+
+    if (t_ns > s->t_ns) sim_advance(s, t_ns - s->t_ns);
+    while (s->next_imu_ns <= s->t_ns) s->next_imu_ns += s->imu_period_ns;
+    while (s->next_speed_ns <= s->t_ns) s->next_speed_ns += SIM_SPEED_NOTIFY_NS;
+}
+
+/* Only flags the stop: the plant belongs to the loop thread, which applies
+   it on its next step. */
+static void sim_emergency_stop(backend *b) {
+    sim_state *s = b->priv;
+    atomic_store(&s->estop, 1);
+}
+
+static int sim_set_guard(backend *b, const struct motor_guard *g) {
+    sim_state *s = b->priv;
+
+    s->guard = *g;
+    s->guard_on = g->wdt_ms || g->max_rpm || g->min_rpm;
+    s->last_kick_ns = s->t_ns;
+    s->overspeed_pulses = 0;
+    return 0;
+}
+
+static int sim_read_trip(backend *b) {
+    sim_state *s = b->priv;
+    return s->trip;
+}
+
+static void sim_close(backend *b) {
+    free(b->priv);
+    free(b);
+}
+
+static int sim_parse_fault(sim_state *s, const char *val) {
+    static const char *kinds[] = { "imbalance", "stall", "overheat", "encoder", "imu" };
+    static const float default_mag[] = { 2.0f, 1.0f, 10.0f, 1.0f, 1.0f };
+    const char *at = strchr(val, '@');
+    if (!at || s->n_faults >= SIM_MAX_FAULTS) return -1;
+
+    for (int k = 0; k < 5; k++) {
+        if (strlen(kinds[k]) == (size_t)(at - val) && strncmp(val, kinds[k], at - val) == 0) {
+            sim_fault *f = &s->faults[s->n_faults++];
+            char *end;
+            f->kind = (fault_kind)k;
+            f->at_ns = (uint64_t)(strtod(at + 1, &end) * 1e9);
+            f->mag = (*end == 'x') ? strtof(end + 1, NULL) : default_mag[k];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+backend *backend_sim_open(const char *opts, int motor) {
+    backend *b = calloc(1, sizeof(*b));
+    sim_state *s = calloc(1, sizeof(*s));
+    char buf[256], *save = NULL;
+    if (!b || !s) { free(b); free(s); return NULL; }
+
+    /* each motor of a multi-motor run gets its own noise */
+    s->rng = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)motor * 0xBF58476D1CE4E5B9ULL);
+    s->start_pwm = 28;
+    s->stop_pwm = 18;
+    s->dead_pwm = 12;
+    s->kv = 3.0f;
+    s->tau = 0.25f;
+    s->amb_temp = 32.0f;
+    s->tau_temp = 300.0f;
+    s->heat_per_pwm = 0.08f;
+    s->imu_period_ns = 500000000ULL;
+
+    strncpy(buf, opts ? opts : "", sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    for (char *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *val = strchr(tok, '=');
+        if (!val) goto bad;
+        *val++ = '\0';
+        if (strcmp(tok, "seed") == 0) s->rng ^= strtoull(val, NULL, 0) * 0xD6E8FEB86659FD93ULL;
+        else if (strcmp(tok, "rt") == 0) s->rt_scale = strtof(val, NULL);
+        else if (strcmp(tok, "start") == 0) s->start_pwm = atoi(val);
+        else if (strcmp(tok, "stop") == 0) s->stop_pwm = atoi(val);
+        else if (strcmp(tok, "tau") == 0) s->tau = strtof(val, NULL);
+        else if (strcmp(tok, "imu_hz") == 0) s->imu_period_ns = (uint64_t)(1e9 / strtod(val, NULL));
+        else if (strcmp(tok, "fault") == 0) { if (sim_parse_fault(s, val) < 0) goto bad; }
+        else goto bad;
+        continue;
+bad:
+        fprintf(stderr, "Bad sim option '%s'\n", tok);
+        free(b); free(s);
+        return NULL;
+    }
+    if (s->rng == 0) s->rng = 1;
+    if (s->tau <= 0) s->tau = 0.25f;
+    if (s->imu_period_ns == 0) s->imu_period_ns = 500000000ULL;
+    s->next_imu_ns = s->imu_period_ns;
+    s->next_speed_ns = SIM_SPEED_NOTIFY_NS;
+    s->temp = s->amb_temp;
+
+    b->name = "sim";
+    b->set_motor = sim_set_motor;
+    b->set_motor_ramp = sim_set_motor_ramp;
+    b->read_duty = sim_read_duty;
+    b->read_speed = sim_read_speed;
+    b->read_imu = sim_read_imu;
+    b->read_imu_records = sim_read_imu_records;
+    b->wait_data = sim_wait_data;
+    b->now_ns = sim_now_ns;
+    b->sleep_us = sim_sleep_us;
+    b->sleep_until_ns = sim_sleep_until_ns;
+    b->sync_ns = sim_sync_ns;
+    b->emergency_stop = sim_emergency_stop;
+    b->set_guard = sim_set_guard;
+    b->read_trip = sim_read_trip;
+    b->close = sim_close;
+    b->motor = motor;
+    b->priv = s;
+    return b;
+}
@@ -0,0 +1,74 @@
+#ifndef SIMD4_H
+#define SIMD4_H
+
+/*
+ * Four-lane float vectors: SSE on x86, NEON on ARM, plain arrays elsewhere.
+ * Only what the z-score kernel needs. Loads and stores expect 16-byte
+ * aligned pointers.
+ */
+
+#include <stdint.h>
+
+#if defined(__SSE2__) && !defined(SIMD4_SCALAR)
+#include <emmintrin.h>
+#define SIMD4_IMPL "sse2"
+typedef __m128 v4f;
+typedef __m128 v4m;
+static inline v4f v4_load(const float *p) { return _mm_load_ps(p); }
+static inline v4f v4_loadu(const float *p) { return _mm_loadu_ps(p); }
+static inline void v4_store(float *p, v4f a) { _mm_store_ps(p, a); }
+static inline void v4_storeu(float *p, v4f a) { _mm_storeu_ps(p, a); }
+static inline v4f v4_set1(float x) { return _mm_set1_ps(x); }
+static inline v4f v4_add(v4f a, v4f b) { return _mm_add_ps(a, b); }
+static inline v4f v4_sub(v4f a, v4f b) { return _mm_sub_ps(a, b); }
+static inline v4f v4_mul(v4f a, v4f b) { return _mm_mul_ps(a, b); }
+static inline v4m v4_le(v4f a, v4f b) { return _mm_cmple_ps(a, b); }
+static inline v4m v4_ge(v4f a, v4f b) { return _mm_cmpge_ps(a, b); }
+static inline v4m v4_or(v4m a, v4m b) { return _mm_or_ps(a, b); }
+/* bit i set when lane i is true */
+static inline unsigned v4_mask(v4m m) { return (unsigned)_mm_movemask_ps(m); }
+
+#elif defined(__ARM_NEON) && !defined(SIMD4_SCALAR)
+#include <arm_neon.h>
+#define SIMD4_IMPL "neon"
+typedef float32x4_t v4f;
+typedef uint32x4_t v4m;
+static inline v4f v4_load(const float *p) { return vld1q_f32(p); }
+static inline v4f v4_loadu(const float *p) { return vld1q_f32(p); }
+static inline void v4_store(float *p, v4f a) { vst1q_f32(p, a); }
+static inline void v4_storeu(float *p, v4f a) { vst1q_f32(p, a); }
+static inline v4f v4_set1(float x) { return vdupq_n_f32(x); }
+static inline v4f v4_add(v4f a, v4f b) { return vaddq_f32(a, b); }
+static inline v4f v4_sub(v4f a, v4f b) { return vsubq_f32(a, b); }
+static inline v4f v4_mul(v4f a, v4f b) { return vmulq_f32(a, b); }
+static inline v4m v4_le(v4f a, v4f b) { return vcleq_f32(a, b); }
+static inline v4m v4_ge(v4f a, v4f b) { return vcgeq_f32(a, b); }
+static inline v4m v4_or(v4m a, v4m b) { return vorrq_u32(a, b); }
+static inline unsigned v4_mask(v4m m) {
+    /* no horizontal add on 32-bit ARM */
+    return (vgetq_lane_u32(m, 0) & 1) | (vgetq_lane_u32(m, 1) & 2) |
+           (vgetq_lane_u32(m, 2) & 4) | (vgetq_lane_u32(m, 3) & 8);
+}
+
+#else
+#define SIMD4_IMPL "scalar"
+typedef struct { float f[4]; } v4f;
+typedef struct { unsigned bits; } v4m;
+static inline v4f v4_load(const float *p) { v4f r; for (int i = 0; i < 4; i++) r.f[i] = p[i]; return r; }
+static inline v4f v4_loadu(const float *p) { return v4_load(p); }
+static inline void v4_store(float *p, v4f a) { for (int i = 0; i < 4; i++) p[i] = a.f[i]; }
+static inline void v4_storeu(float *p, v4f a) { v4_store(p, a); }
+static inline v4f v4_set1(float x) { v4f r = {{x, x, x, x}}; return r; }
+static inline v4f v4_add(v4f a, v4f b) { for (int i = 0; i < 4; i++) a.f[i] += b.f[i]; return a; }
+static inline v4f v4_sub(v4f a, v4f b) { for (int i = 0; i < 4; i++) a.f[i] -= b.f[i]; return a; }
+static inline v4f v4_mul(v4f a, v4f b) { for (int i = 0; i < 4; i++) a.f[i] *= b.f[i]; return a; }
+static inline v4m v4_le(v4f a, v4f b) { v4m m = {0}; for (int i = 0; i < 4; i++) m.bits |= (unsigned)(a.f[i] <= b.f[i]) << i; return m; }
+static inline v4m v4_ge(v4f a, v4f b) { v4m m = {0}; for (int i = 0; i < 4; i++) m.bits |= (unsigned)(a.f[i] >= b.f[i]) << i; return m; }
+static inline v4m v4_or(v4m a, v4m b) { a.bits |= b.bits; return a; }
+static inline unsigned v4_mask(v4m m) { return m.bits; }
+#endif
+
+/* a + (b - a) * t */
+static inline v4f v4_lerp(v4f a, v4f b, v4f t) { return v4_add(a, v4_mul(v4_sub(b, a), t)); }
+
+#endif
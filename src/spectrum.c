@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "spectrum.h"
+
+#define SPEC_STD_FLOOR 0.002f       /* g */
+#define SPEC_WARN_Z    3.0f
+#define SPEC_ERR_Z     5.0f
+
+/* band edges in multiples of the shaft frequency; the last one ends at Nyquist */
+static const float band_lo[SPEC_BANDS] = {0.5f, 1.5f, 2.5f, 5.5f};
+static const float band_hi[SPEC_BANDS] = {1.5f, 2.5f, 5.5f, 0.0f};
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void spectrum_default_params(spectrum_params *p) {
+    p->n = 1024;
+    p->decim = 4;
+    p->avg = 4;
+}
+
+int spectrum_init(spectrum *s, const spectrum_params *p) {
+    memset(s, 0, sizeof(*s));
+    if (p->decim < 1 || p->avg < 1 || p->avg > SPEC_AVG_MAX) return -1;
+    if (fft_plan_init(&s->plan, p->n) < 0) return -1;
+    s->p = *p;
+    s->win = aligned_alloc(16, p->n * sizeof(float));
+    s->x = malloc(p->n * sizeof(float));
+    s->y = malloc(p->n * sizeof(float));
+    s->t = malloc(p->n * sizeof(uint64_t));
+    s->re = aligned_alloc(16, p->n * sizeof(float));
+    s->im = aligned_alloc(16, p->n * sizeof(float));
+    if (!s->win || !s->x || !s->y || !s->t || !s->re || !s->im) {
+        spectrum_free(s);
+        return -1;
+    }
+    for (int i = 0; i < p->n; i++) {
+        s->win[i] = 0.5f - 0.5f * cosf(2 * (float)M_PI * i / p->n);
+        s->win_power += s->win[i] * s->win[i];
+    }
+    spectrum_reset(s);
+    stats_reset(&s->compute_us);
+    return 0;
+}
+
+void spectrum_free(spectrum *s) {
+    fft_plan_free(&s->plan);
+    free(s->win);
+    free(s->x);
+    free(s->y);
+    free(s->t);
+    free(s->re);
+    free(s->im);
+    s->win = s->x = s->y = s->re = s->im = NULL;
+    s->t = NULL;
+}
+
+void spectrum_reset(spectrum *s) {
+    s->pos = s->fill = s->since = 0;
+    s->dec_n = 0;
+    s->dec_x = s->dec_y = 0;
+    s->last_ns = 0;
+    s->seg_n = s->seg_pos = 0;
+    s->valid = 0;
+}
+
+/* Power of bins k = 1..kmax overlapping [lo, hi) Hz, partial bins pro rata. */
+static float band_power(const float *pw, int kmax, float df, float lo, float hi) {
+    int k0 = (int)floorf(lo / df + 0.5f), k1 = (int)ceilf(hi / df - 0.5f);
+    float sum = 0;
+
+    if (k0 < 1) k0 = 1;
+    if (k1 > kmax) k1 = kmax;
+    for (int k = k0; k <= k1; k++) {
+        float a = fmaxf((k - 0.5f) * df, lo), b = fminf((k + 0.5f) * df, hi);
+        if (b > a) sum += pw[k] * (b - a) / df;
+    }
+    return sum;
+}
+
+static void spectrum_analyse(spectrum *s, float rpm) {
+    const int n = s->p.n;
+    uint64_t t0 = mono_ns();
+    float mx = 0, my = 0;
+
+    for (int i = 0; i < n; i++) {
+        mx += s->x[i];
+        my += s->y[i];
+    }
+    mx /= n;
+    my /= n;
+    for (int i = 0, j = s->pos; i < n; i++, j = j + 1 == n ? 0 : j + 1) {
+        s->re[i] = (s->x[j] - mx) * s->win[i];
+        s->im[i] = (s->y[j] - my) * s->win[i];
+    }
+    uint64_t span = s->t[s->pos ? s->pos - 1 : n - 1] - s->t[s->pos];
+    fft_forward(&s->plan, s->re, s->im);
+
+    /* |Z(f)|^2 + |Z(-f)|^2 is the power of both radial axes at |f| */
+    int half = n / 2;
+    float scale = 1.0f / (n * s->win_power);
+    for (int k = 1; k < half; k++) {
+        float p = s->re[k] * s->re[k] + s->im[k] * s->im[k] +
+                  s->re[n - k] * s->re[n - k] + s->im[n - k] * s->im[n - k];
+        s->re[k] = p * scale;
+    }
+    s->re[half] = (s->re[half] * s->re[half] + s->im[half] * s->im[half]) * scale;
+
+    s->fs = span ? (float)((n - 1) * 1e9 / span) : 0;
+    s->shaft_hz = rpm / 60.0f;
+    float df = s->fs / n, nyq = s->fs / 2;
+    s->valid = s->fs > 0 && s->shaft_hz >= 2 * df && band_lo[BAND_HIGH] * s->shaft_hz < nyq;
+    if (!s->valid) {
+        s->seg_n = 0;
+    } else {
+        if (s->seg_n > 0 && fabsf(s->shaft_hz - s->seg_hz) > SPEC_RPM_TOL * s->seg_hz) s->seg_n = 0;
+        if (s->seg_n == 0) s->seg_hz = s->shaft_hz;
+        float *seg = s->seg[s->seg_pos];
+        for (int b = 0; b < SPEC_BANDS; b++) {
+            float hi = band_hi[b] > 0 ? band_hi[b] * s->shaft_hz : nyq;
+            seg[b] = band_power(s->re, half, df, band_lo[b] * s->shaft_hz, hi);
+            s->seg_band[b] = sqrtf(seg[b]);
+        }
+        s->seg_pos = (s->seg_pos + 1) % s->p.avg;
+        if (s->seg_n < s->p.avg) s->seg_n++;
+        for (int b = 0; b < SPEC_BANDS; b++) {
+            float sum = 0;
+            for (int i = 0; i < s->seg_n; i++) sum += s->seg[i][b];
+            s->band[b] = sqrtf(sum / s->seg_n);
+        }
+    }
+    s->windows++;
+    stats_add(&s->compute_us, (mono_ns() - t0) / 1e3);
+}
+
+int spectrum_feed(spectrum *s, const imu_record *r, size_t count, float rpm) {
+    int done = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (s->last_ns && r[i].t_ns - s->last_ns > SPEC_MAX_GAP_NS) {
+            s->fill = s->since = s->dec_n = 0;
+            s->dec_x = s->dec_y = 0;
+            s->gaps++;
+        }
+        s->last_ns = r[i].t_ns;
+        s->dec_x += r[i].raw[0] / 16384.0f;
+        s->dec_y += r[i].raw[1] / 16384.0f;
+        if (++s->dec_n < s->p.decim) continue;
+
+        s->x[s->pos] = s->dec_x / s->p.decim;
+        s->y[s->pos] = s->dec_y / s->p.decim;
+        s->t[s->pos] = r[i].t_ns;
+        s->pos = s->pos + 1 == s->p.n ? 0 : s->pos + 1;
+        s->dec_n = 0;
+        s->dec_x = s->dec_y = 0;
+        if (s->fill < s->p.n) s->fill++;
+        if (++s->since >= s->p.n / 2 && s->fill == s->p.n) {
+            spectrum_analyse(s, rpm);
+            s->since = 0;
+            done++;
+        }
+    }
+    return done;
+}
+
+void spectrum_table_init(calib_table *t) {
+    calib_table_init(t);
+    for (int b = 0; b < SPEC_BANDS; b++) {
+        t->std_floor[b] = SPEC_STD_FLOOR;
+        t->warn_z[b] = SPEC_WARN_Z;
+        t->err_z[b] = SPEC_ERR_Z;
+    }
+}
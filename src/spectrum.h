@@ -0,0 +1,74 @@
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+/*
+ * Streaming Welch analysis of the raw IMU records. The radial acceleration
+ * (x + iy, the IMU z axis along the shaft) is block-averaged by decim,
+ * and every n/2 new samples a Hann-windowed n-point FFT of the last n is
+ * taken. Its power is summed into bands placed at multiples of the shaft
+ * frequency from the encoder, and the bands of the last avg segments at
+ * the same speed are averaged. Band values are RMS accelerations in g.
+ *
+ * Per-PWM band baselines live in bands.bin, a calib.bin-format table whose
+ * four channels are the four bands, so they are scored with zscore.c.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "imu_shm.h"
+#include "calib_table.h"
+#include "fft.h"
+#include "stats.h"
+
+#define SPEC_BANDS 4
+enum { BAND_1X, BAND_2X, BAND_HARM, BAND_HIGH };
+_Static_assert(SPEC_BANDS == CALIB_CHANNELS, "bands reuse the calib table layout");
+#define SPEC_AVG_MAX    16
+/* a longer hole in the records restarts the window */
+#define SPEC_MAX_GAP_NS 50000000ULL
+/* a shaft speed change beyond this restarts the average */
+#define SPEC_RPM_TOL    0.1f
+
+typedef struct {
+    int n;                      /* FFT length in decimated samples */
+    int decim;                  /* raw records averaged into one sample */
+    int avg;                    /* segments in the Welch average */
+} spectrum_params;
+
+typedef struct {
+    spectrum_params p;
+    fft_plan plan;
+    float *win, win_power;      /* Hann window and sum of its squares */
+    float *x, *y;               /* last n decimated samples, ring at pos */
+    uint64_t *t;
+    float *re, *im;
+    int pos, fill, since;
+    int dec_n;
+    float dec_x, dec_y;
+    uint64_t last_ns;
+
+    float seg[SPEC_AVG_MAX][SPEC_BANDS];
+    int seg_n, seg_pos;
+    float seg_hz;
+
+    /* results of the last segment */
+    float fs, shaft_hz;
+    int valid;                  /* bands resolvable at this speed and rate */
+    float seg_band[SPEC_BANDS]; /* this segment alone */
+    float band[SPEC_BANDS];     /* Welch average */
+    uint64_t windows, gaps;
+    stats compute_us;           /* per analysed segment */
+} spectrum;
+
+void spectrum_default_params(spectrum_params *p);
+int spectrum_init(spectrum *s, const spectrum_params *p);
+void spectrum_free(spectrum *s);
+/* Drops buffered samples and the average. */
+void spectrum_reset(spectrum *s);
+/* Feeds records in time order; rpm is the current encoder speed. Returns
+   the number of segments analysed. */
+int spectrum_feed(spectrum *s, const imu_record *r, size_t count, float rpm);
+/* calib_table_init with the floors and thresholds of band tables. */
+void spectrum_table_init(calib_table *t);
+
+#endif
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "motor_ctx.h"
+
+/*
+ * speed_bench [--backend=<spec>] [--motor=<n>] [--targets=rpm,rpm,...]
+ *             [--hold=<s>] [--ramp=<%/s>] [--kp= --ki= --kd= --trim=]
+ *             [--tune] [--save]
+ * Step responses of the speed-setpoint mode through motor_ctx, the same
+ * code path as main --speed (start_pwm hysteresis, driver ramps, detector).
+ * Each target is held for --hold seconds; per step it reports
+ *   settle_s     last time the 3-reading mean was outside +-5 % (min 5 rpm)
+ *   overshoot    peak of that mean past the target, % of the step
+ *   sse_rpm      mean target - speed over the last 2 s of the hold
+ * for feed-forward only and for feed-forward + PID. --tune grid-searches
+ * kp/ki first; --save writes the tuning to the motor's speed_tuning.csv.
+ * Add load with e.g. --backend=sim:fault=stall@0x0.15.
+ */
+
+#define MAX_TARGETS 16
+#define SSE_WINDOW_S 2.0
+
+typedef struct {
+    double settle_s, overshoot, sse;
+} step_result;
+
+typedef struct {
+    double settle_s, overshoot, sse;    /* mean, max, mean |.| over the steps */
+} run_summary;
+
+const char *spec = "sim";
+int motor = 0, ramp_rate = 25, n_targets = 0;
+float targets[MAX_TARGETS];
+double hold_s = 8.0;
+
+static int run(const speed_tuning *t, step_result *res, run_summary *sum) {
+    static motor_ctx m;
+    detector_params p;
+    backend *be = backend_open(spec, motor);
+
+    if (be == NULL) return -1;
+    detector_default_params(&p);
+    if (motor_ctx_open(&m, motor, be, &p) < 0) {
+        backend_close(be);
+        return -1;
+    }
+    m.speed_mode = 1;
+    speed_ctl_init(&m.ctl, m.calib, m.start_pwm, t);
+    for (int i = 0; i < 10; i++) {
+        motor_ctx_ambient(&m);
+        backend_sleep_us(be, 100000);
+    }
+    motor_ctx_ambient_done(&m);
+
+    memset(sum, 0, sizeof(*sum));
+    float from = 0;
+    for (int k = 0; k < n_targets; k++) {
+        uint64_t t0 = backend_now_ns(be);
+        double last_out = 0, peak = 0, err_sum = 0;
+        float hist[3] = {0, 0, 0};
+        int n = 0, n_err = 0;
+
+        motor_ctx_set_speed(&m, targets[k]);
+        float target = m.target_rpm;
+        float step = target - from;
+        float band = fabsf(target) * 0.05f > 5 ? fabsf(target) * 0.05f : 5;
+        for (;;) {
+            motor_ctx_step(&m, ramp_rate);
+            double t = (backend_now_ns(be) - t0) * 1e-9;
+            if (t >= hold_s) break;
+            hist[n++ % 3] = m.speed;
+            if (n >= 3) {
+                float mean = (hist[0] + hist[1] + hist[2]) / 3;
+                if (fabsf(mean - target) > band) last_out = t;
+                double past = step >= 0 ? mean - target : target - mean;
+                if (past > peak) peak = past;
+            }
+            if (t >= hold_s - SSE_WINDOW_S) {
+                err_sum += target - m.speed;
+                n_err++;
+            }
+            backend_wait_data(be, 300000);
+        }
+        res[k].settle_s = last_out;
+        res[k].overshoot = fabsf(step) > 0 ? 100.0 * peak / fabsf(step) : 0;
+        res[k].sse = n_err ? err_sum / n_err : 0;
+        sum->settle_s += res[k].settle_s / n_targets;
+        if (res[k].overshoot > sum->overshoot) sum->overshoot = res[k].overshoot;
+        sum->sse += fabs(res[k].sse) / n_targets;
+        from = target;
+    }
+    backend_set_motor(be, 's', 0);
+    backend_close(be);
+    motor_ctx_close(&m);
+    return 0;
+}
+
+static double cost(const run_summary *s) {
+    return s->settle_s + 0.05 * s->overshoot + 0.5 * s->sse;
+}
+
+static void print_run(const char *mode, const step_result *res, const run_summary *sum) {
+    float from = 0;
+    for (int k = 0; k < n_targets; k++) {
+        printf("%s,%.0f,%.0f,%.2f,%.1f,%.2f\n", mode, from, targets[k], res[k].settle_s,
+               res[k].overshoot, res[k].sse);
+        from = targets[k];
+    }
+    fprintf(stderr, "%-4s: mean settle %.2f s, max overshoot %.1f %%, mean |sse| %.2f rpm\n",
+            mode, sum->settle_s, sum->overshoot, sum->sse);
+}
+
+int main(int argc, char **argv) {
+    speed_tuning t, ff_only;
+    step_result res[MAX_TARGETS];
+    run_summary sum;
+    int tune = 0, save = 0;
+    char path[MOTOR_PATH_MAX];
+    const char *list = "120,200,160,240,90,150";
+
+    for (int a = 1; a < argc; a++)
+        if (strncmp(argv[a], "--motor=", 8) == 0) motor = atoi(argv[a] + 8);
+    speed_tuning_default(&t);
+    speed_tuning_load(&t, motor_data_path(path, sizeof(path), motor, "speed_tuning.csv"));
+    for (int a = 1; a < argc; a++) {
+        if (strncmp(argv[a], "--backend=", 10) == 0) spec = argv[a] + 10;
+        else if (strncmp(argv[a], "--targets=", 10) == 0) list = argv[a] + 10;
+        else if (strncmp(argv[a], "--hold=", 7) == 0) hold_s = atof(argv[a] + 7);
+        else if (strncmp(argv[a], "--ramp=", 7) == 0) ramp_rate = atoi(argv[a] + 7);
+        else if (strncmp(argv[a], "--kp=", 5) == 0) t.kp = atof(argv[a] + 5);
+        else if (strncmp(argv[a], "--ki=", 5) == 0) t.ki = atof(argv[a] + 5);
+        else if (strncmp(argv[a], "--kd=", 5) == 0) t.kd = atof(argv[a] + 5);
+        else if (strncmp(argv[a], "--trim=", 7) == 0) t.max_trim = atof(argv[a] + 7);
+        else if (strcmp(argv[a], "--tune") == 0) tune = 1;
+        else if (strcmp(argv[a], "--save") == 0) save = 1;
+    }
+    for (const char *p = list; *p && n_targets < MAX_TARGETS; ) {
+        targets[n_targets++] = strtof(p, (char **)&p);
+        if (*p == ',') p++;
+        else break;
+    }
+    if (n_targets == 0 || hold_s <= SSE_WINDOW_S) {
+        fprintf(stderr, "Need targets and --hold > %.0f s\n", SSE_WINDOW_S);
+        return 1;
+    }
+
+    if (tune) {
+        static const float kps[] = {0.02f, 0.05f, 0.1f, 0.2f};
+        static const float kis[] = {0.1f, 0.2f, 0.4f, 0.8f, 1.6f};
+        double best = INFINITY;
+        speed_tuning cand = t, best_t = t;
+
+        for (size_t i = 0; i < sizeof(kps) / sizeof(kps[0]); i++) {
+            for (size_t j = 0; j < sizeof(kis) / sizeof(kis[0]); j++) {
+                cand.kp = kps[i];
+                cand.ki = kis[j];
+                if (run(&cand, res, &sum) < 0) return 1;
+                fprintf(stderr, "kp %.2f ki %.2f: settle %.2f s, overshoot %.1f %%, |sse| %.2f rpm\n",
+                        cand.kp, cand.ki, sum.settle_s, sum.overshoot, sum.sse);
+                if (cost(&sum) < best) {
+                    best = cost(&sum);
+                    best_t = cand;
+                }
+            }
+        }
+        t = best_t;
+        fprintf(stderr, "best: kp %g ki %g\n", t.kp, t.ki);
+    }
+
+    printf("mode,from_rpm,to_rpm,settle_s,overshoot_pct,sse_rpm\n");
+    ff_only = t;
+    ff_only.kp = ff_only.ki = ff_only.kd = 0;
+    if (run(&ff_only, res, &sum) < 0) return 1;
+    print_run("ff", res, &sum);
+    if (run(&t, res, &sum) < 0) return 1;
+    print_run("pid", res, &sum);
+
+    if (save) {
+        if (speed_tuning_save(&t, motor_data_path(path, sizeof(path), motor, "speed_tuning.csv")) < 0) return 1;
+        fprintf(stderr, "saved %s\n", motor_data_path(path, sizeof(path), motor, "speed_tuning.csv"));
+    }
+    return 0;
+}
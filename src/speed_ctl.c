@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <string.h>
+#include "speed_ctl.h"
+
+/* A missed wake-up must not turn into one huge integration step. */
+#define SPEED_CTL_MAX_DT 0.5f
+/* applied duty this far behind the command means the ramp is still running */
+#define SPEED_CTL_RAMP_LAG 1.0f
+
+void speed_tuning_default(speed_tuning *t) {
+    t->kp = 0.02f;
+    t->ki = 0.8f;
+    t->kd = 0.0f;
+    t->max_trim = 20.0f;
+    t->d_alpha = 0.2f;
+}
+
+int speed_tuning_load(speed_tuning *t, const char *path) {
+    char key[32];
+    float val;
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL) return -1;
+    while (fscanf(f, " %31[^,],%f", key, &val) == 2) {
+        if (strcmp(key, "kp") == 0) t->kp = val;
+        else if (strcmp(key, "ki") == 0) t->ki = val;
+        else if (strcmp(key, "kd") == 0) t->kd = val;
+        else if (strcmp(key, "max_trim") == 0) t->max_trim = val;
+        else if (strcmp(key, "d_alpha") == 0) t->d_alpha = val;
+    }
+    fclose(f);
+    return 0;
+}
+
+int speed_tuning_save(const speed_tuning *t, const char *path) {
+    FILE *f = fopen(path, "w");
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "kp,%g\nki,%g\nkd,%g\nmax_trim,%g\nd_alpha,%g\n",
+            t->kp, t->ki, t->kd, t->max_trim, t->d_alpha);
+    return fclose(f);
+}
+
+void speed_ctl_init(speed_ctl *c, const calib_table *calib, int start_pwm, const speed_tuning *t) {
+    memset(c, 0, sizeof(*c));
+    c->start_pwm = start_pwm < 0 ? 0 : start_pwm > 100 ? 100 : start_pwm;
+    c->t = *t;
+    for (int d = CALIB_UP; d <= CALIB_DOWN; d++) {
+        float max = 0;
+        for (int p = 0; p < CALIB_STEPS; p++) {
+            float rpm = calib->entry[d][p].mean[CAL_SPEED];
+            if (rpm > max) max = rpm;
+            c->rpm[d][p] = max;
+        }
+    }
+}
+
+void speed_ctl_reset(speed_ctl *c) {
+    c->integral = 0;
+    c->d_filt = 0;
+    c->last_out = 0;
+    c->primed = 0;
+}
+
+float speed_ctl_min_rpm(const speed_ctl *c, int dir) {
+    return c->rpm[dir][c->start_pwm];
+}
+
+float speed_ctl_max_rpm(const speed_ctl *c, int dir) {
+    return c->rpm[dir][CALIB_STEPS - 1];
+}
+
+float speed_ctl_ff(const speed_ctl *c, int dir, float rpm) {
+    const float *r = c->rpm[dir];
+    int p = c->start_pwm;
+
+    if (rpm <= r[p]) return p;
+    while (p < CALIB_STEPS - 1 && r[p + 1] < rpm) p++;
+    if (p == CALIB_STEPS - 1) return p;
+    /* r[p] < rpm <= r[p + 1] */
+    return p + (rpm - r[p]) / (r[p + 1] - r[p]);
+}
+
+float speed_ctl_update(speed_ctl *c, int dir, float target, float measured, float applied, uint64_t t_ns) {
+    float dt = c->primed ? (t_ns - c->last_ns) * 1e-9f : 0;
+
+    if (target <= 0) {
+        speed_ctl_reset(c);
+        c->ff = c->trim = 0;
+        return 0;
+    }
+    if (dt > SPEED_CTL_MAX_DT) dt = SPEED_CTL_MAX_DT;
+    if (dt > 0) {
+        float dm = (measured - c->last_meas) / dt;
+        c->d_filt += c->t.d_alpha * (dm - c->d_filt);
+    }
+    c->last_ns = t_ns;
+    c->last_meas = measured;
+    c->primed = 1;
+
+    float ff = speed_ctl_ff(c, dir, target);
+    float lo = ff - c->t.max_trim, hi = ff + c->t.max_trim;
+    if (lo < c->start_pwm) lo = c->start_pwm;
+    if (hi > 100) hi = 100;
+
+    float e = target - measured;
+    float pd = c->t.kp * e - c->t.kd * c->d_filt;
+    float integral = c->integral + c->t.ki * e * dt;
+    float out = ff + pd + integral;
+    float lag = applied >= 0 && c->last_out > 0 ? c->last_out - applied : 0;
+    /* conditional integration: hold the integral while it pushes further
+       into a limit or ahead of the ramp */
+    if (!((out > hi && e > 0) || (out < lo && e < 0) ||
+          (lag > SPEED_CTL_RAMP_LAG && e > 0) || (lag < -SPEED_CTL_RAMP_LAG && e < 0)))
+        c->integral = integral;
+    if (c->integral > c->t.max_trim) c->integral = c->t.max_trim;
+    if (c->integral < -c->t.max_trim) c->integral = -c->t.max_trim;
+
+    out = ff + pd + c->integral;
+    if (out > hi) out = hi;
+    if (out < lo) out = lo;
+    c->ff = ff;
+    c->trim = out - ff;
+    c->last_out = out;
+    return out;
+}
@@ -0,0 +1,55 @@
+#ifndef SPEED_CTL_H
+#define SPEED_CTL_H
+
+/*
+ * Speed-setpoint mode. The feed-forward PWM comes from inverting the
+ * calibrated speed_mean of the direction being travelled (calib up while
+ * accelerating, down while slowing), so a new setpoint lands close to the
+ * right duty at once; a PID on the encoder speed trims the rest. The PID
+ * only integrates while its output is inside [start_pwm, 100] and within
+ * max_trim of the feed-forward, and while the driver's ramp has caught up
+ * with the last command, so it winds up neither against those limits nor
+ * against the ramp rate.
+ * Below start_pwm the motor is not driven: the lowest speed offered is the
+ * one calibrated at start_pwm.
+ */
+
+#include <stdint.h>
+#include "calib_table.h"
+
+typedef struct {
+    float kp;           /* % per rpm */
+    float ki;           /* % per rpm*s */
+    float kd;           /* % per rpm/s, on the measurement */
+    float max_trim;     /* PID authority around the feed-forward, % */
+    float d_alpha;      /* low-pass weight of a new derivative sample */
+} speed_tuning;
+
+typedef struct {
+    float rpm[2][CALIB_STEPS];      /* speed_mean per direction, made non-decreasing */
+    int start_pwm;
+    speed_tuning t;
+    float integral, d_filt, last_meas, last_out;
+    uint64_t last_ns;
+    int primed;
+    float ff, trim;                 /* of the last update */
+} speed_ctl;
+
+void speed_tuning_default(speed_tuning *t);
+/* "key,value" lines as in motor_meta.csv; a missing file keeps t as is. */
+int speed_tuning_load(speed_tuning *t, const char *path);
+int speed_tuning_save(const speed_tuning *t, const char *path);
+
+void speed_ctl_init(speed_ctl *c, const calib_table *calib, int start_pwm, const speed_tuning *t);
+/* Forgets the integral and derivative state. */
+void speed_ctl_reset(speed_ctl *c);
+/* Feed-forward PWM for rpm in direction dir, start_pwm..100. */
+float speed_ctl_ff(const speed_ctl *c, int dir, float rpm);
+/* Speeds reachable without dropping below start_pwm. */
+float speed_ctl_min_rpm(const speed_ctl *c, int dir);
+float speed_ctl_max_rpm(const speed_ctl *c, int dir);
+/* PWM to apply now for target at measured speed, given the duty the driver
+   applies (-1 if unknown); 0 for a target of 0. */
+float speed_ctl_update(speed_ctl *c, int dir, float target, float measured, float applied, uint64_t t_ns);
+
+#endif
@@ -0,0 +1,132 @@
+#include <math.h>
+#include <string.h>
+#include "stats.h"
+
+void stats_reset(stats *s) {
+    s->n = 0;
+    s->mean = s->m2 = 0.0;
+    s->min = INFINITY;
+    s->max = -INFINITY;
+}
+
+void stats_add(stats *s, double x) {
+    s->n++;
+    double d = x - s->mean;
+    s->mean += d / s->n;
+    s->m2 += d * (x - s->mean);
+    if (x < s->min) s->min = x;
+    if (x > s->max) s->max = x;
+}
+
+void stats_merge(stats *into, const stats *from) {
+    if (from->n == 0) return;
+    if (into->n == 0) {
+        *into = *from;
+        return;
+    }
+    long n = into->n + from->n;
+    double d = from->mean - into->mean;
+    into->mean += d * from->n / n;
+    into->m2 += from->m2 + d * d * ((double)into->n * from->n / n);
+    into->n = n;
+    if (from->min < into->min) into->min = from->min;
+    if (from->max > into->max) into->max = from->max;
+}
+
+double stats_var(const stats *s) {
+    return s->n > 1 ? s->m2 / s->n : 0.0;
+}
+
+double stats_std(const stats *s) {
+    return sqrt(stats_var(s));
+}
+
+double stats_sample_var(const stats *s) {
+    return s->n > 1 ? s->m2 / (s->n - 1) : 0.0;
+}
+
+double stats_ci_mean(const stats *s, double z) {
+    if (s->n < 2) return INFINITY;
+    return z * sqrt(stats_sample_var(s) / s->n);
+}
+
+double stats_ci_std(const stats *s, double z) {
+    if (s->n < 2) return INFINITY;
+    return z * sqrt(stats_sample_var(s) / (2.0 * (s->n - 1)));
+}
+
+void p2_init(p2_quantile *q, double p) {
+    memset(q, 0, sizeof(*q));
+    q->p = p;
+}
+
+static double p2_parabolic(const p2_quantile *q, int i, double d) {
+    return q->q[i] + d / (q->pos[i + 1] - q->pos[i - 1]) *
+        ((q->pos[i] - q->pos[i - 1] + d) * (q->q[i + 1] - q->q[i]) / (q->pos[i + 1] - q->pos[i]) +
+         (q->pos[i + 1] - q->pos[i] - d) * (q->q[i] - q->q[i - 1]) / (q->pos[i] - q->pos[i - 1]));
+}
+
+void p2_add(p2_quantile *q, double x) {
+    if (q->n < 5) {
+        /* insertion sort into the first five heights */
+        int i = q->n++;
+        while (i > 0 && q->q[i - 1] > x) {
+            q->q[i] = q->q[i - 1];
+            i--;
+        }
+        q->q[i] = x;
+        if (q->n == 5) {
+            double p = q->p;
+            for (int j = 0; j < 5; j++) q->pos[j] = j + 1;
+            q->want[0] = 1;
+            q->want[1] = 1 + 2 * p;
+            q->want[2] = 1 + 4 * p;
+            q->want[3] = 3 + 2 * p;
+            q->want[4] = 5;
+        }
+        return;
+    }
+
+    int k;
+    if (x < q->q[0]) {
+        q->q[0] = x;
+        k = 0;
+    } else if (x >= q->q[4]) {
+        if (x > q->q[4]) q->q[4] = x;
+        k = 3;
+    } else {
+        for (k = 0; k < 3 && x >= q->q[k + 1]; k++)
+            ;
+    }
+    q->n++;
+    for (int j = k + 1; j < 5; j++) q->pos[j] += 1;
+    q->want[1] += q->p / 2;
+    q->want[2] += q->p;
+    q->want[3] += (1 + q->p) / 2;
+    q->want[4] += 1;
+
+    for (int i = 1; i <= 3; i++) {
+        double d = q->want[i] - q->pos[i];
+        if ((d >= 1 && q->pos[i + 1] - q->pos[i] > 1) || (d <= -1 && q->pos[i - 1] - q->pos[i] < -1)) {
+            double s = d > 0 ? 1 : -1;
+            double h = p2_parabolic(q, i, s);
+            if (q->q[i - 1] < h && h < q->q[i + 1]) {
+                q->q[i] = h;
+            } else {
+                int j = i + (int)s;
+                q->q[i] += s * (q->q[j] - q->q[i]) / (q->pos[j] - q->pos[i]);
+            }
+            q->pos[i] += s;
+        }
+    }
+}
+
+double p2_value(const p2_quantile *q) {
+    if (q->n == 0) return 0.0;
+    if (q->n < 5) {
+        /* nearest rank over the sorted prefix */
+        int i = (int)(q->p * (q->n - 1) + 0.5);
+        return q->q[i];
+    }
+    return q->q[2];
+}
@@ -0,0 +1,43 @@
+#ifndef STATS_H
+#define STATS_H
+
+/*
+ * Streaming statistics. stats keeps count, mean, M2 (Welford), min and max
+ * in doubles and can be merged (Chan et al.), so per-window accumulators can
+ * be folded into longer ones. p2_quantile tracks one quantile in O(1) memory
+ * with the P-square algorithm (Jain & Chlamtac, 1985).
+ */
+
+typedef struct {
+    long n;
+    double mean;
+    double m2;          /* sum of squared deviations from the mean */
+    double min, max;
+} stats;
+
+typedef struct {
+    double p;           /* quantile, 0..1 */
+    long n;
+    double q[5];        /* marker heights */
+    double pos[5];      /* actual marker positions, 1-based */
+    double want[5];     /* desired marker positions */
+} p2_quantile;
+
+void stats_reset(stats *s);
+void stats_add(stats *s, double x);
+void stats_merge(stats *into, const stats *from);
+/* Population variance (divides by n); 0 with fewer than two samples. */
+double stats_var(const stats *s);
+double stats_std(const stats *s);
+/* Unbiased sample variance (divides by n - 1). */
+double stats_sample_var(const stats *s);
+/* Half-widths of the normal-approximation CIs of the mean and the std at z. */
+double stats_ci_mean(const stats *s, double z);
+double stats_ci_std(const stats *s, double z);
+
+void p2_init(p2_quantile *q, double p);
+void p2_add(p2_quantile *q, double x);
+/* Current estimate; exact while fewer than five samples were seen. */
+double p2_value(const p2_quantile *q);
+
+#endif
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <time.h>
+#include "detector.h"
+#include "trace.h"
+#include "workpool.h"
+
+/*
+ * sweep [options] calib.bin corpus.txt
+ * Evaluates detector configurations against a labelled trace corpus on all
+ * cores and prints one CSV row per configuration, Pareto-optimal ones
+ * flagged, on stdout.
+ *   <param>=<lo>:<hi>:<step>   grid over a parameter (names below)
+ *   <param>=<lo>:<hi>          range for --random
+ *   --random=<n> --seed=<n>    n uniform random configurations instead of the grid
+ *   --threads=<n>              default: all online CPUs
+ * corpus.txt: one "<telemetry file> <onset>" per line, onset being seconds
+ * from the first record at which a fault is present, or "-" if the trace
+ * is healthy. A stop before the onset is a false alarm; the first stop
+ * after it detects the fault.
+ */
+
+#define MAX_DIMS 16
+
+typedef struct {
+    const char *name;
+    size_t off;
+    int is_int;
+} param_def;
+
+static const param_def params[] = {
+    {"warn_speed", offsetof(detector_params, warn_z[0]), 0},
+    {"warn_acc", offsetof(detector_params, warn_z[1]), 0},
+    {"warn_gyro", offsetof(detector_params, warn_z[2]), 0},
+    {"err_speed", offsetof(detector_params, err_z[0]), 0},
+    {"err_acc", offsetof(detector_params, err_z[1]), 0},
+    {"err_gyro", offsetof(detector_params, err_z[2]), 0},
+    {"limit_speed", offsetof(detector_params, err_s[0]), 0},
+    {"limit_acc", offsetof(detector_params, err_s[1]), 0},
+    {"limit_gyro", offsetof(detector_params, err_s[2]), 0},
+    {"limit_temp", offsetof(detector_params, err_s[3]), 0},
+    {"limit_joint", offsetof(detector_params, joint_err_s), 0},
+    {"tau", offsetof(detector_params, tau_s), 0},
+    {"grace", offsetof(detector_params, grace_s), 0},
+    {"startup_grace", offsetof(detector_params, startup_grace_s), 0},
+    {"temp_err_lo", offsetof(detector_params, temp_err_lo), 0},
+    {"temp_warn_lo", offsetof(detector_params, temp_warn_lo), 0},
+    {"temp_warn_hi", offsetof(detector_params, temp_warn_hi), 0},
+    {"temp_err_hi", offsetof(detector_params, temp_err_hi), 0},
+};
+#define N_PARAMS (sizeof(params) / sizeof(params[0]))
+
+typedef struct {
+    int param;
+    double lo, hi, step;
+    long count;             /* grid points */
+} dim;
+
+typedef struct {
+    trace tr;
+    uint64_t onset_ns;      /* UINT64_MAX when healthy */
+} labelled_trace;
+
+typedef struct {
+    unsigned long false_stops, detected, missed;
+    double far_per_h;       /* false stops per hour of healthy running */
+    double lat_mean_s, lat_max_s;
+    int pareto;
+} result;
+
+typedef struct {
+    const calib_table *calib;
+    const labelled_trace *corpus;
+    int n_traces;
+    double healthy_h;
+    detector_params *configs;
+    result *results;
+    detector *dets;         /* one per worker */
+} sweep;
+
+static void set_param(detector_params *p, int k, double v) {
+    char *base = (char *)p + params[k].off;
+    if (params[k].is_int) *(int *)base = (int)lround(v);
+    else *(float *)base = (float)v;
+}
+
+static double get_param(const detector_params *p, int k) {
+    const char *base = (const char *)p + params[k].off;
+    return params[k].is_int ? *(const int *)base : *(const float *)base;
+}
+
+static int parse_dim(dim *d, const char *arg) {
+    const char *eq = strchr(arg, '=');
+    if (eq == NULL) return -1;
+    d->param = -1;
+    for (size_t k = 0; k < N_PARAMS; k++)
+        if (strlen(params[k].name) == (size_t)(eq - arg) && strncmp(arg, params[k].name, eq - arg) == 0)
+            d->param = k;
+    if (d->param < 0) return -1;
+    d->step = 0;
+    int n = sscanf(eq + 1, "%lf:%lf:%lf", &d->lo, &d->hi, &d->step);
+    if (n < 2 || d->hi < d->lo) return -1;
+    d->count = d->step > 0 ? (long)floor((d->hi - d->lo) / d->step + 1e-9) + 1 : 1;
+    return 0;
+}
+
+static int load_corpus(const char *path, labelled_trace **out) {
+    FILE *f = fopen(path, "r");
+    char line[600], file[512], onset[32];
+    int n = 0, cap = 16;
+    labelled_trace *c = malloc(cap * sizeof(*c));
+
+    if (f == NULL) {
+        perror(path);
+        free(c);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#' || sscanf(line, "%511s %31s", file, onset) != 2) continue;
+        if (n == cap) c = realloc(c, (cap *= 2) * sizeof(*c));
+        char *name = strdup(file);
+        if (trace_load(&c[n].tr, name) < 0 || c[n].tr.n == 0) {
+            free(name);
+            continue;
+        }
+        c[n].onset_ns = strcmp(onset, "-") == 0 ? UINT64_MAX
+                      : c[n].tr.s[0].t_ns + (uint64_t)(atof(onset) * 1e9);
+        n++;
+    }
+    fclose(f);
+    *out = c;
+    return n;
+}
+
+static void evaluate(size_t task, int worker, void *arg) {
+    sweep *sw = arg;
+    detector *d = &sw->dets[worker];
+    result *r = &sw->results[task];
+    detector_output out;
+    double lat_sum = 0;
+
+    memset(r, 0, sizeof(*r));
+    detector_init(d, sw->calib, &sw->configs[task]);
+    for (int k = 0; k < sw->n_traces; k++) {
+        const labelled_trace *lt = &sw->corpus[k];
+        int found = 0;
+
+        detector_reset(d);
+        for (size_t j = 0; j < lt->tr.n && !found; j++) {
+            const trace_sample *s = &lt->tr.s[j];
+            if (s->new_setpoint) detector_setpoint_changed(d);
+            if (!detector_step(d, &s->in, &out)) continue;
+            if (s->t_ns < lt->onset_ns) {
+                r->false_stops++;
+                detector_reset(d);
+            } else {
+                double lat = (s->t_ns - lt->onset_ns) / 1e9;
+                lat_sum += lat;
+                if (lat > r->lat_max_s) r->lat_max_s = lat;
+                found = 1;
+            }
+        }
+        if (lt->onset_ns != UINT64_MAX) {
+            if (found) r->detected++;
+            else r->missed++;
+        }
+    }
+    r->far_per_h = sw->healthy_h > 0 ? r->false_stops / sw->healthy_h : 0;
+    r->lat_mean_s = r->detected ? lat_sum / r->detected : INFINITY;
+    if (!r->detected) r->lat_max_s = INFINITY;
+}
+
+/* a is at least as good as b everywhere and better somewhere */
+static int dominates(const result *a, const result *b) {
+    if (a->far_per_h > b->far_per_h || a->missed > b->missed || a->lat_mean_s > b->lat_mean_s) return 0;
+    return a->far_per_h < b->far_per_h || a->missed < b->missed || a->lat_mean_s < b->lat_mean_s;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    static calib_table from_csv;
+    dim dims[MAX_DIMS];
+    int n_dims = 0, threads = workpool_cpus();
+    long n_random = 0;
+    unsigned seed = 1;
+    const char *calib_path = NULL, *corpus_path = NULL;
+    sweep sw = {0};
+
+    for (int a = 1; a < argc; a++) {
+        if (strncmp(argv[a], "--random=", 9) == 0) n_random = atol(argv[a] + 9);
+        else if (strncmp(argv[a], "--seed=", 7) == 0) seed = atoi(argv[a] + 7);
+        else if (strncmp(argv[a], "--threads=", 10) == 0) threads = atoi(argv[a] + 10);
+        else if (strchr(argv[a], '=')) {
+            if (n_dims == MAX_DIMS || parse_dim(&dims[n_dims], argv[a]) < 0) {
+                fprintf(stderr, "Bad parameter range %s\n", argv[a]);
+                return 1;
+            }
+            n_dims++;
+        } else if (calib_path == NULL) calib_path = argv[a];
+        else corpus_path = argv[a];
+    }
+    if (calib_path == NULL || corpus_path == NULL) {
+        fprintf(stderr, "Usage: %s [param=lo:hi[:step] ...] [--random=n] [--threads=n] calib.bin corpus.txt\n", argv[0]);
+        fprintf(stderr, "Parameters:");
+        for (size_t k = 0; k < N_PARAMS; k++) fprintf(stderr, " %s", params[k].name);
+        fprintf(stderr, "\n");
+        return 1;
+    }
+
+    sw.calib = calib_table_map(calib_path);
+    if (sw.calib == NULL) {
+        if (calib_table_read_csv(&from_csv, calib_path) <= 0) return 1;
+        sw.calib = &from_csv;
+    }
+    labelled_trace *corpus;
+    sw.n_traces = load_corpus(corpus_path, &corpus);
+    if (sw.n_traces <= 0) {
+        fprintf(stderr, "%s: no usable traces\n", corpus_path);
+        return 1;
+    }
+    sw.corpus = corpus;
+    unsigned long long samples = 0;
+    for (int k = 0; k < sw.n_traces; k++) {
+        const trace *tr = &corpus[k].tr;
+        uint64_t end = tr->s[tr->n - 1].t_ns;
+        if (corpus[k].onset_ns < end) end = corpus[k].onset_ns;
+        if (end > tr->s[0].t_ns) sw.healthy_h += (end - tr->s[0].t_ns) / 3600e9;
+        samples += tr->n;
+    }
+
+    /* configurations: grid (mixed radix over the dims) or random draws */
+    size_t n_configs = 1;
+    if (n_random > 0) n_configs = n_random;
+    else for (int k = 0; k < n_dims; k++) n_configs *= dims[k].count;
+    sw.configs = malloc(n_configs * sizeof(detector_params));
+    sw.results = malloc(n_configs * sizeof(result));
+    sw.dets = malloc((threads > 0 ? threads : 1) * sizeof(detector));
+    if (!sw.configs || !sw.results || !sw.dets) {
+        perror("sweep");
+        return 1;
+    }
+    srand(seed);
+    for (size_t c = 0; c < n_configs; c++) {
+        size_t idx = c;
+        detector_default_params(&sw.configs[c]);
+        for (int k = 0; k < n_dims; k++) {
+            double v;
+            if (n_random > 0) {
+                v = dims[k].lo + (dims[k].hi - dims[k].lo) * (rand() / (double)RAND_MAX);
+            } else {
+                v = dims[k].lo + dims[k].step * (idx % dims[k].count);
+                idx /= dims[k].count;
+            }
+            set_param(&sw.configs[c], dims[k].param, v);
+        }
+    }
+
+    double t0 = now_s();
+    workpool_run(threads, n_configs, evaluate, &sw);
+    double dt = now_s() - t0;
+
+    /* O(n^2), fine for the few thousand configurations a sweep produces */
+    size_t front = 0;
+    for (size_t a = 0; a < n_configs; a++) {
+        sw.results[a].pareto = 1;
+        for (size_t b = 0; b < n_configs && sw.results[a].pareto; b++)
+            if (b != a && dominates(&sw.results[b], &sw.results[a])) sw.results[a].pareto = 0;
+        front += sw.results[a].pareto;
+    }
+
+    for (size_t k = 0; k < N_PARAMS; k++) printf("%s,", params[k].name);
+    printf("far_per_h,false_stops,detected,missed,latency_mean_s,latency_max_s,pareto\n");
+    for (size_t c = 0; c < n_configs; c++) {
+        const result *r = &sw.results[c];
+        for (size_t k = 0; k < N_PARAMS; k++) printf("%g,", get_param(&sw.configs[c], k));
+        printf("%.3f,%lu,%lu,%lu,%.3f,%.3f,%d\n", r->far_per_h, r->false_stops, r->detected,
+               r->missed, r->lat_mean_s, r->lat_max_s, r->pareto);
+    }
+    fprintf(stderr, "%zu configurations x %d traces (%llu samples, %.2f h healthy) on %d threads in %.2f s: "
+            "%.0f configs/s, %.3g samples/s; %zu on the Pareto front\n",
+            n_configs, sw.n_traces, samples, sw.healthy_h, threads, dt, n_configs / dt,
+            (double)samples * n_configs / dt, front);
+
+    for (int k = 0; k < sw.n_traces; k++) {
+        free((char *)corpus[k].tr.name);
+        trace_free(&corpus[k].tr);
+    }
+    free(corpus);
+    free(sw.configs);
+    free(sw.results);
+    free(sw.dets);
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "telemetry.h"
+#include "tracepoint.h"
+
+#define TELEMETRY_BATCH 256
+#define TELEMETRY_IDLE_US 20000
+
+static int file_write(telemetry *t, const void *buf, size_t len) {
+#ifdef HAVE_ZLIB
+    if (t->compress) return gzwrite((gzFile)t->file, buf, len) == (int)len ? 0 : -1;
+#endif
+    return fwrite(buf, 1, len, (FILE *)t->file) == len ? 0 : -1;
+}
+
+static void file_close(telemetry *t) {
+    if (t->file == NULL) return;
+#ifdef HAVE_ZLIB
+    if (t->compress) gzclose((gzFile)t->file);
+    else
+#endif
+    fclose((FILE *)t->file);
+    t->file = NULL;
+}
+
+static int file_open(telemetry *t, uint64_t t_ns) {
+    char path[512], stamp[32];
+    time_t now = time(NULL);
+    telemetry_file_header h = {
+        .magic = TELEMETRY_MAGIC, .version = TELEMETRY_VERSION,
+        .record_size = sizeof(telemetry_record), .wall_start = now, .t_start_ns = t_ns,
+    };
+
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+    snprintf(path, sizeof(path), "%s/telemetry-%s-%llu.bin%s", t->dir, stamp,
+             (unsigned long long)t->files, t->compress ? ".gz" : "");
+#ifdef HAVE_ZLIB
+    if (t->compress) t->file = gzopen(path, "wb1");
+    else
+#endif
+    t->file = fopen(path, "wb");
+    if (t->file == NULL) {
+        perror("File Error telemetry");
+        return -1;
+    }
+    t->files++;
+    t->file_bytes = 0;
+    t->file_opened = now;
+    return file_write(t, &h, sizeof(h));
+}
+
+static void *telemetry_writer(void *arg) {
+    telemetry *t = arg;
+    telemetry_record batch[TELEMETRY_BATCH];
+
+    TP_THREAD("telemetry");
+    for (;;) {
+        uint64_t tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+        size_t n = head - tail;
+
+        if (n == 0) {
+            if (atomic_load(&t->stop)) break;
+            usleep(TELEMETRY_IDLE_US);
+            continue;
+        }
+        if (n > TELEMETRY_BATCH) n = TELEMETRY_BATCH;
+        for (size_t k = 0; k < n; k++) batch[k] = t->ring[(tail + k) & (TELEMETRY_RING - 1)];
+        atomic_store_explicit(&t->tail, tail + n, memory_order_release);
+
+        int too_big = t->max_bytes && t->file_bytes >= t->max_bytes;
+        int too_old = t->max_age_s && time(NULL) - t->file_opened >= (int64_t)t->max_age_s;
+        if (t->file && (too_big || too_old)) file_close(t);
+        if (t->file == NULL && file_open(t, batch[0].t_ns) < 0) {
+            /* keep draining so the loop is unaffected, retry once a second */
+            atomic_fetch_add_explicit(&t->dropped, n, memory_order_relaxed);
+            file_close(t);
+            sleep(1);
+            continue;
+        }
+
+        TP_BEGIN("log_write");
+        if (file_write(t, batch, n * sizeof(batch[0])) == 0) {
+            t->file_bytes += n * sizeof(batch[0]);
+            t->written += n;
+        }
+        TP_END("log_write");
+        /* the page cache absorbs the writes; only a full batch is worth hurrying for */
+        if (n < TELEMETRY_BATCH) usleep(TELEMETRY_IDLE_US);
+    }
+    file_close(t);
+    return NULL;
+}
+
+int telemetry_start(telemetry *t, const char *dir, uint64_t max_bytes, unsigned max_age_s, int compress) {
+    memset(t, 0, sizeof(*t));
+    t->dir = dir;
+    t->max_bytes = max_bytes;
+    t->max_age_s = max_age_s;
+#ifdef HAVE_ZLIB
+    t->compress = compress;
+#else
+    if (compress) fprintf(stderr, "telemetry: built without zlib, writing uncompressed\n");
+#endif
+    if (pthread_create(&t->thread, NULL, telemetry_writer, t) != 0) {
+        perror("telemetry thread");
+        return -1;
+    }
+    return 0;
+}
+
+int telemetry_push(telemetry *t, telemetry_record *rec) {
+    uint64_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&t->tail, memory_order_acquire);
+
+    rec->seq = t->seq++;
+    if (head - tail >= TELEMETRY_RING) {
+        atomic_fetch_add_explicit(&t->dropped, 1, memory_order_relaxed);
+        return -1;
+    }
+    t->ring[head & (TELEMETRY_RING - 1)] = *rec;
+    atomic_store_explicit(&t->head, head + 1, memory_order_release);
+    return 0;
+}
+
+void telemetry_stop(telemetry *t) {
+    atomic_store(&t->stop, 1);
+    pthread_join(t->thread, NULL);
+}
@@ -0,0 +1,71 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+/*
+ * Binary telemetry log. The control loop pushes fixed-size records into a
+ * single-producer/single-consumer ring and never waits: when the ring is
+ * full the record is dropped and counted. A writer thread drains the ring
+ * in batches into telemetry-<date>-<time>.bin files, rotated by size and
+ * age, gzip-compressed when built with -DHAVE_ZLIB and asked to.
+ * log2csv turns the files back into CSV.
+ */
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define TELEMETRY_MAGIC   0x314D4C54u   /* "TLM1" */
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_RING    8192          /* records, power of two */
+
+typedef struct {
+    uint64_t t_ns;          /* backend clock */
+    uint32_t seq;           /* records pushed before this one; gaps are drops */
+    int16_t pwm;            /* setpoint, % */
+    uint8_t status;         /* MotorStatus */
+    uint8_t dir;
+    float duty;             /* applied duty, % */
+    int32_t speed;          /* rpm */
+    float acc, gyro, temp;  /* IMU readings, ambient removed from acc/gyro */
+    float z[4];             /* speed, acc, gyro, temp indices */
+    float period_us;        /* loop period */
+    float late_us;          /* deadline lateness, fixed-rate loops only */
+    float target_rpm;       /* speed-setpoint mode, 0 otherwise */
+} telemetry_record;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+    int64_t wall_start;     /* time(NULL) when the file was opened */
+    uint64_t t_start_ns;    /* backend clock of the first record */
+} telemetry_file_header;
+
+typedef struct {
+    const char *dir;
+    uint64_t max_bytes;     /* rotate after this many record bytes, 0 = never */
+    unsigned max_age_s;     /* rotate after this many seconds, 0 = never */
+    int compress;
+
+    _Atomic uint64_t head, tail;
+    telemetry_record ring[TELEMETRY_RING];
+    _Atomic uint64_t dropped;
+    uint32_t seq;
+
+    pthread_t thread;
+    atomic_bool stop;
+    void *file;             /* FILE* or gzFile */
+    uint64_t file_bytes;
+    int64_t file_opened;
+    uint64_t written, files;
+} telemetry;
+
+/* Starts the writer thread. Returns -1 if it cannot. */
+int telemetry_start(telemetry *t, const char *dir, uint64_t max_bytes, unsigned max_age_s, int compress);
+/* Control-loop side: never blocks. Returns -1 if the record was dropped. */
+int telemetry_push(telemetry *t, telemetry_record *rec);
+/* Drains what is left, closes the file and joins the writer. */
+void telemetry_stop(telemetry *t);
+
+#endif
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "trace.h"
+#include "telemetry.h"
+
+#ifdef HAVE_ZLIB
+typedef gzFile log_file;
+#define log_open(p)        gzopen(p, "rb")
+#define log_read(f, b, n)  gzread(f, b, n)
+#define log_close(f)       gzclose(f)
+#else
+typedef FILE *log_file;
+#define log_open(p)        fopen(p, "rb")
+#define log_read(f, b, n)  (int)fread(b, 1, n, f)
+#define log_close(f)       fclose(f)
+#endif
+
+int trace_load(trace *t, const char *path) {
+    telemetry_file_header h;
+    telemetry_record r;
+    size_t cap = 4096;
+    int going_up = 1, last_pwm = 0;
+
+    t->name = path;
+    t->n = 0;
+    t->s = malloc(cap * sizeof(*t->s));
+    log_file f = log_open(path);
+    if (f == NULL || t->s == NULL) {
+        perror(path);
+        if (f) log_close(f);
+        trace_free(t);
+        return -1;
+    }
+    if (log_read(f, &h, sizeof(h)) != sizeof(h) || h.magic != TELEMETRY_MAGIC ||
+        h.version != TELEMETRY_VERSION || h.record_size != sizeof(r)) {
+        fprintf(stderr, "%s: not a telemetry v%d file\n", path, TELEMETRY_VERSION);
+        log_close(f);
+        trace_free(t);
+        return -1;
+    }
+    while (log_read(f, &r, sizeof(r)) == sizeof(r)) {
+        if (t->n == cap) {
+            trace_sample *grown = realloc(t->s, 2 * cap * sizeof(*t->s));
+            if (grown == NULL) break;
+            t->s = grown;
+            cap *= 2;
+        }
+        trace_sample *s = &t->s[t->n];
+        s->t_ns = r.t_ns;
+        s->pwm = r.pwm;
+        s->status = r.status;
+        s->new_setpoint = t->n > 0 && r.pwm != last_pwm;
+        if (r.pwm > last_pwm) going_up = 1;
+        else if (r.pwm < last_pwm) going_up = 0;
+        last_pwm = r.pwm;
+        s->in = (detector_input){
+            .duty = r.duty, .dir = going_up ? CALIB_UP : CALIB_DOWN,
+            .dt = t->n > 0 ? (r.t_ns - t->s[t->n - 1].t_ns) / 1e9f : 0,
+            .speed = r.speed, .acc = r.acc, .gyro = r.gyro, .temp = r.temp,
+        };
+        t->n++;
+    }
+    log_close(f);
+    return 0;
+}
+
+void trace_free(trace *t) {
+    free(t->s);
+    t->s = NULL;
+    t->n = 0;
+}
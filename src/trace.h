@@ -0,0 +1,33 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * A telemetry file loaded into memory as detector inputs, for replaying
+ * the detector offline. The calibration direction and the setpoint changes
+ * (which start a grace period in main) are recovered from the logged
+ * setpoint, the same way main derives them from the arrow keys.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "detector.h"
+
+typedef struct {
+    uint64_t t_ns;
+    detector_input in;
+    int16_t pwm;            /* setpoint */
+    uint8_t new_setpoint;   /* setpoint differs from the previous record */
+    uint8_t status;         /* what main reported live */
+} trace_sample;
+
+typedef struct {
+    const char *name;
+    trace_sample *s;
+    size_t n;
+} trace;
+
+/* Reads a telemetry-*.bin (or .gz with HAVE_ZLIB). Returns -1 on error. */
+int trace_load(trace *t, const char *path);
+void trace_free(trace *t);
+
+#endif
@@ -0,0 +1,101 @@
+#ifdef TRACEPOINTS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "tracepoint.h"
+
+_Thread_local tp_buf *tp_self;
+
+static _Atomic(tp_buf *) tp_list;
+static char tp_prefix[64];
+static int tp_pipe[2] = {-1, -1};
+
+void tp_thread(const char *name) {
+    tp_buf *b = calloc(1, sizeof(*b));
+    if (b == NULL) return;
+    b->tid = (int)syscall(SYS_gettid);
+    snprintf(b->name, sizeof(b->name), "%s", name);
+    b->next = atomic_load(&tp_list);
+    while (!atomic_compare_exchange_weak(&tp_list, &b->next, b))
+        ;
+    tp_self = b;
+}
+
+/* Rings are read while their threads keep writing: only the newest three
+   quarters are taken, so a writer is a quarter ring away from wrapping
+   onto the slots being read. */
+int tp_dump(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror("trace dump");
+        return -1;
+    }
+    int pid = getpid(), first = 1;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (tp_buf *b = atomic_load(&tp_list); b; b = b->next) {
+        uint64_t head = atomic_load_explicit(&b->head, memory_order_acquire);
+        uint64_t from = head > TP_RING * 3 / 4 ? head - TP_RING * 3 / 4 : 0;
+
+        fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", pid, b->tid, b->name);
+        first = 0;
+        for (uint64_t i = from; i < head; i++) {
+            const tp_event *e = &b->ev[i & (TP_RING - 1)];
+            fprintf(f, ",\n{\"ph\":\"%c\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f%s}", e->ph, e->name,
+                    pid, b->tid, e->t_ns / 1e3, e->ph == 'i' ? ",\"s\":\"t\"" : "");
+        }
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static void tp_on_signal(int sig) {
+    char c = 1;
+    (void)sig;
+    if (write(tp_pipe[1], &c, 1) < 0) {
+        /* a dump is already pending */
+    }
+}
+
+static void *tp_dumper(void *arg) {
+    char c, path[96];
+    int n = 0;
+    (void)arg;
+
+    while (read(tp_pipe[0], &c, 1) == 1) {
+        snprintf(path, sizeof(path), "%s-%d-%d.json", tp_prefix, getpid(), n++);
+        if (tp_dump(path) == 0) fprintf(stderr, "trace: %s\n", path);
+    }
+    return NULL;
+}
+
+static void tp_at_exit(void) {
+    char path[96];
+    snprintf(path, sizeof(path), "%s-%d.json", tp_prefix, getpid());
+    tp_dump(path);
+}
+
+void tp_start(const char *prefix) {
+    pthread_t t;
+    struct sigaction sa = { .sa_handler = tp_on_signal, .sa_flags = SA_RESTART };
+
+    snprintf(tp_prefix, sizeof(tp_prefix), "%s", prefix);
+    atexit(tp_at_exit);
+    if (pipe(tp_pipe) < 0) return;
+    /* the dumper blocks on the read end, the handler must never block */
+    fcntl(tp_pipe[1], F_SETFL, O_NONBLOCK);
+    if (pthread_create(&t, NULL, tp_dumper, NULL) != 0) return;
+    pthread_detach(t);
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+#endif
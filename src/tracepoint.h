@@ -0,0 +1,79 @@
+#ifndef TRACEPOINT_H
+#define TRACEPOINT_H
+
+/*
+ * Hot-path trace points, built only with -DTRACEPOINTS; otherwise every
+ * macro below is empty and nothing is linked in.
+ *
+ * A thread that records calls TP_THREAD("name") once and gets its own ring
+ * of TP_RING events. TP_BEGIN/TP_END bracket a stage, TP_INSTANT marks a
+ * moment; each is a clock read and one slot written by that thread alone,
+ * so there are no locks and no shared cache lines. A full ring keeps the
+ * newest events.
+ *
+ * TP_START(prefix) dumps every ring as Chrome trace-event JSON (open it in
+ * Perfetto or chrome://tracing): to <prefix>-<pid>-<n>.json on each
+ * SIGUSR1, from a thread of its own, and to <prefix>-<pid>.json at exit.
+ * Stage names must be string literals.
+ */
+
+#ifdef TRACEPOINTS
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define TP_RING 65536               /* events per thread, power of two */
+
+typedef struct {
+    uint64_t t_ns;                  /* CLOCK_MONOTONIC */
+    const char *name;
+    char ph;                        /* 'B', 'E' or 'i' */
+} tp_event;
+
+typedef struct tp_buf {
+    _Atomic uint64_t head;          /* events ever written */
+    int tid;
+    char name[16];
+    struct tp_buf *next;
+    tp_event ev[TP_RING];
+} tp_buf;
+
+extern _Thread_local tp_buf *tp_self;
+
+void tp_thread(const char *name);
+void tp_start(const char *prefix);
+/* Writes every ring to path now. Returns -1 if it cannot. */
+int tp_dump(const char *path);
+
+static inline void tp_emit(const char *name, char ph) {
+    tp_buf *b = tp_self;
+    struct timespec ts;
+
+    if (b == NULL) return;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t h = atomic_load_explicit(&b->head, memory_order_relaxed);
+    tp_event *e = &b->ev[h & (TP_RING - 1)];
+    e->t_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    e->name = name;
+    e->ph = ph;
+    atomic_store_explicit(&b->head, h + 1, memory_order_release);
+}
+
+#define TP_THREAD(name)   tp_thread(name)
+#define TP_START(prefix)  tp_start(prefix)
+#define TP_BEGIN(name)    tp_emit(name, 'B')
+#define TP_END(name)      tp_emit(name, 'E')
+#define TP_INSTANT(name)  tp_emit(name, 'i')
+
+#else
+
+#define TP_THREAD(name)   ((void)0)
+#define TP_START(prefix)  ((void)0)
+#define TP_BEGIN(name)    ((void)0)
+#define TP_END(name)      ((void)0)
+#define TP_INSTANT(name)  ((void)0)
+
+#endif
+
+#endif
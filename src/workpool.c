@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "workpool.h"
+
+typedef struct {
+    pthread_mutex_t lock;
+    size_t lo, hi;          /* tasks [lo, hi) still queued */
+} slice;
+
+typedef struct {
+    slice *slices;
+    int n;
+    workpool_fn fn;
+    void *arg;
+} pool;
+
+typedef struct {
+    pool *p;
+    int id;
+} worker;
+
+static int take(slice *s, size_t *task) {
+    int ok = 0;
+    pthread_mutex_lock(&s->lock);
+    if (s->lo < s->hi) {
+        *task = s->lo++;
+        ok = 1;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return ok;
+}
+
+/* Moves the back half of the fullest other slice into ours. */
+static int steal(pool *p, int self) {
+    for (;;) {
+        int victim = -1;
+        size_t most = 0;
+        for (int k = 0; k < p->n; k++) {
+            if (k == self) continue;
+            pthread_mutex_lock(&p->slices[k].lock);
+            size_t left = p->slices[k].hi - p->slices[k].lo;
+            pthread_mutex_unlock(&p->slices[k].lock);
+            if (left > most) {
+                most = left;
+                victim = k;
+            }
+        }
+        if (victim < 0) return 0;
+
+        slice *v = &p->slices[victim], *me = &p->slices[self];
+        size_t lo = 0, hi = 0;
+        pthread_mutex_lock(&v->lock);
+        if (v->lo < v->hi) {
+            size_t mid = v->hi - (v->hi - v->lo + 1) / 2;
+            lo = mid;
+            hi = v->hi;
+            v->hi = mid;
+        }
+        pthread_mutex_unlock(&v->lock);
+        if (lo == hi) continue;     /* raced with its owner, look again */
+
+        pthread_mutex_lock(&me->lock);
+        me->lo = lo;
+        me->hi = hi;
+        pthread_mutex_unlock(&me->lock);
+        return 1;
+    }
+}
+
+static void *worker_main(void *arg) {
+    worker *w = arg;
+    size_t task;
+
+    for (;;) {
+        while (take(&w->p->slices[w->id], &task)) w->p->fn(task, w->id, w->p->arg);
+        if (!steal(w->p, w->id)) break;
+    }
+    return NULL;
+}
+
+int workpool_run(int nthreads, size_t ntasks, workpool_fn fn, void *arg) {
+    if (nthreads < 1) nthreads = 1;
+    pool p = { .slices = calloc(nthreads, sizeof(slice)), .n = nthreads, .fn = fn, .arg = arg };
+    worker *w = calloc(nthreads, sizeof(worker));
+    pthread_t *tid = calloc(nthreads, sizeof(pthread_t));
+    int rc = 0;
+
+    if (!p.slices || !w || !tid) {
+        free(p.slices);
+        free(w);
+        free(tid);
+        return -1;
+    }
+    for (int k = 0; k < nthreads; k++) {
+        pthread_mutex_init(&p.slices[k].lock, NULL);
+        p.slices[k].lo = ntasks * k / nthreads;
+        p.slices[k].hi = ntasks * (k + 1) / nthreads;
+        w[k].p = &p;
+        w[k].id = k;
+    }
+    /* worker 0 runs on the calling thread */
+    for (int k = 1; k < nthreads; k++) {
+        if (pthread_create(&tid[k], NULL, worker_main, &w[k]) != 0) {
+            perror("workpool thread");
+            rc = -1;
+            tid[k] = 0;
+        }
+    }
+    worker_main(&w[0]);
+    for (int k = 1; k < nthreads; k++)
+        if (tid[k]) pthread_join(tid[k], NULL);
+    for (int k = 0; k < nthreads; k++) pthread_mutex_destroy(&p.slices[k].lock);
+    free(p.slices);
+    free(w);
+    free(tid);
+    return rc;
+}
+
+int workpool_cpus(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
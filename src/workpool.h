@@ -0,0 +1,21 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+/*
+ * Work-stealing pool for n independent tasks. Every worker starts with an
+ * equal slice of the task indices, takes tasks from the front of its own
+ * slice and, once it runs dry, steals the back half of the fullest other
+ * slice. Tasks of very different cost still keep all cores busy.
+ */
+
+#include <stddef.h>
+
+/* Called once per task index, worker is 0..nthreads-1. */
+typedef void (*workpool_fn)(size_t task, int worker, void *arg);
+
+/* Runs tasks 0..ntasks-1 on nthreads threads; returns once all are done. */
+int workpool_run(int nthreads, size_t ntasks, workpool_fn fn, void *arg);
+/* Online CPUs, at least 1. */
+int workpool_cpus(void);
+
+#endif
@@ -0,0 +1,50 @@
+#include <string.h>
+#include "zscore.h"
+#include "simd4.h"
+
+void zscore_load_entry(calib_soa *soa, const calib_table *t, int d, int p) {
+    const calib_entry *e = &t->entry[d][p];
+    memcpy(soa->mean[d][p], e->mean, sizeof(e->mean));
+    memcpy(soa->inv_std[d][p], e->inv_std, sizeof(e->inv_std));
+    memcpy(soa->warn_lo[d][p], e->warn_lo, sizeof(e->warn_lo));
+    memcpy(soa->warn_hi[d][p], e->warn_hi, sizeof(e->warn_hi));
+    memcpy(soa->err_lo[d][p], e->err_lo, sizeof(e->err_lo));
+    memcpy(soa->err_hi[d][p], e->err_hi, sizeof(e->err_hi));
+}
+
+void zscore_load(calib_soa *soa, const calib_table *t) {
+    for (int d = 0; d < 2; d++)
+        for (int p = 0; p < CALIB_STEPS; p++) zscore_load_entry(soa, t, d, p);
+}
+
+/*
+ * Bounds are linear in mean and std, so blending them is exact; the blended
+ * reciprocal std is an approximation that only affects the logged z-scores.
+ */
+void zscore_batch(const calib_soa *soa, const zscore_sample *in, zscore_result *out, size_t n) {
+    for (size_t k = 0; k < n; k++) {
+        float pwm = in[k].pwm;
+        if (pwm < 0) pwm = 0;
+        if (pwm > CALIB_STEPS - 1) pwm = CALIB_STEPS - 1;
+        int i = (int)pwm;
+        if (i > CALIB_STEPS - 2) i = CALIB_STEPS - 2;
+        int d = in[k].dir == CALIB_DOWN ? CALIB_DOWN : CALIB_UP;
+        v4f t = v4_set1(pwm - i);
+        v4f x = v4_load(in[k].x);
+
+#define BLEND(field) v4_lerp(v4_load(soa->field[d][i]), v4_load(soa->field[d][i + 1]), t)
+        v4f mean = BLEND(mean);
+        v4f inv_std = BLEND(inv_std);
+        v4m warn = v4_or(v4_le(x, BLEND(warn_lo)), v4_ge(x, BLEND(warn_hi)));
+        v4m err = v4_or(v4_le(x, BLEND(err_lo)), v4_ge(x, BLEND(err_hi)));
+#undef BLEND
+
+        v4_store(out[k].z, v4_mul(v4_sub(x, mean), inv_std));
+        out[k].warn = (uint8_t)v4_mask(warn);
+        out[k].err = (uint8_t)v4_mask(err);
+    }
+}
+
+const char *zscore_impl(void) {
+    return SIMD4_IMPL;
+}
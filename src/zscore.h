@@ -0,0 +1,48 @@
+#ifndef ZSCORE_H
+#define ZSCORE_H
+
+/*
+ * Four-channel anomaly scoring against the calibration table. calib_soa
+ * keeps each calib_entry field in its own aligned array of per-PWM
+ * 4-channel vectors, so a lookup is one vector load per field and
+ * neighbouring PWM steps can be blended for fractional duty cycles.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "calib_table.h"
+
+typedef struct {
+    _Alignas(16) float mean[2][CALIB_STEPS][CALIB_CHANNELS];
+    float inv_std[2][CALIB_STEPS][CALIB_CHANNELS];
+    float warn_lo[2][CALIB_STEPS][CALIB_CHANNELS];
+    float warn_hi[2][CALIB_STEPS][CALIB_CHANNELS];
+    float err_lo[2][CALIB_STEPS][CALIB_CHANNELS];
+    float err_hi[2][CALIB_STEPS][CALIB_CHANNELS];
+} calib_soa;
+
+typedef struct {
+    _Alignas(16) float x[CALIB_CHANNELS];   /* speed, acc, gyro, temp */
+    float pwm;                              /* duty in %, may be fractional */
+    int dir;                                /* CALIB_UP / CALIB_DOWN */
+} zscore_sample;
+
+typedef struct {
+    _Alignas(16) float z[CALIB_CHANNELS];
+    uint8_t warn;                           /* bit per channel outside warn bounds */
+    uint8_t err;                            /* bit per channel outside error bounds */
+} zscore_result;
+
+void zscore_load(calib_soa *soa, const calib_table *t);
+/* Reloads one step, e.g. after adapt.c moved it. */
+void zscore_load_entry(calib_soa *soa, const calib_table *t, int dir, int pwm);
+/* Scores n samples, each against the table blended at its own duty. */
+void zscore_batch(const calib_soa *soa, const zscore_sample *in, zscore_result *out, size_t n);
+const char *zscore_impl(void);
+
+/* 2 = error, 1 = warning, 0 = ok */
+static inline int zscore_level(const zscore_result *r, int ch) {
+    return (r->err >> ch & 1) ? 2 : (r->warn >> ch & 1);
+}
+
+#endif
@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "check.h"
+#include "../src/adapt.h"
+
+/*
+ * The exponentially weighted step update, its clamp against calib.bin,
+ * and that adapt.bin plus the journal bring the same table back after a
+ * clean close and after a crash.
+ */
+
+#define PWM 50
+#define MS 1000000ULL
+
+static const float mean0[CALIB_CHANNELS] = {1000, 0.2f, 3, 30};
+static const float std0[CALIB_CHANNELS] = {10, 0.05f, 0.5f, 1};
+static const float warn_z[3] = {2, 2.5f, 2.5f}, err_z[3] = {3, 4, 4};
+
+static char table_path[64], journal_path[64];
+
+static void make_base(calib_table *t) {
+    calib_table_init(t);
+    for (int d = 0; d < 2; d++) {
+        for (int p = 0; p < CALIB_STEPS; p++) {
+            memcpy(t->entry[d][p].mean, mean0, sizeof(mean0));
+            memcpy(t->entry[d][p].std, std0, sizeof(std0));
+        }
+    }
+    calib_table_finish(t);
+}
+
+static int same_entry(const calib_entry *a, const calib_entry *b) {
+    return memcmp(a->mean, b->mean, sizeof(a->mean)) == 0 && memcmp(a->std, b->std, sizeof(a->std)) == 0;
+}
+
+int main(void) {
+    static calib_table base;
+    adapt a;
+    float x[CALIB_CHANNELS];
+    char dir[] = "/tmp/adapt_testXXXXXX";
+    uint64_t t = 1000 * MS;
+
+    CHECK(mkdtemp(dir) != NULL);
+    snprintf(table_path, sizeof(table_path), "%s/adapt.bin", dir);
+    snprintf(journal_path, sizeof(journal_path), "%s/adapt.journal", dir);
+    make_base(&base);
+
+    CHECK(adapt_open(&a, &base, warn_z, err_z, table_path, journal_path) == 0);
+    CHECK(same_entry(&a.cur->entry[CALIB_UP][PWM], &base.entry[CALIB_UP][PWM]));
+
+    /* the first sample only starts the clock; the next moves the mean by dt/tau */
+    for (int c = 0; c < CALIB_CHANNELS; c++) x[c] = mean0[c] + std0[c];
+    CHECK(adapt_sample(&a, x, CALIB_UP, PWM, t) == 0);
+    CHECK(adapt_sample(&a, x, CALIB_UP, PWM, t += 100 * MS) == 1);
+    const calib_entry *e = &a.cur->entry[CALIB_UP][PWM];
+    for (int c = 0; c < CALIB_CHANNELS; c++) {
+        double alpha = 0.1 / ADAPT_TAU_S;
+        CHECK_NEAR(e->mean[c], mean0[c] + alpha * std0[c], 1e-5 * mean0[c]);
+        CHECK_NEAR(e->std[c], sqrt((1 - alpha) * (std0[c] * std0[c] + alpha * std0[c] * std0[c])),
+                   1e-5 * std0[c]);
+    }
+    CHECK(a.clamped == 0);
+
+    /* a long gap counts as one second */
+    float before = e->mean[CAL_SPEED];
+    adapt_sample(&a, x, CALIB_UP, PWM, t += 3600000 * MS);
+    CHECK_NEAR(e->mean[CAL_SPEED] - before, (x[CAL_SPEED] - before) / ADAPT_TAU_S, 1e-3);
+
+    /* a fault far off pulls the step only to the clamp */
+    for (int c = 0; c < CALIB_CHANNELS; c++) x[c] = mean0[c] + 100 * std0[c];
+    for (int i = 0; i < 20000; i++) adapt_sample(&a, x, CALIB_UP, PWM, t += 1000 * MS);
+    CHECK(a.clamped > 0);
+    for (int c = 0; c < CALIB_CHANNELS; c++) {
+        CHECK_NEAR(e->mean[c], mean0[c] + ADAPT_MAX_SHIFT * std0[c], 1e-4 * mean0[c]);
+        CHECK(e->std[c] <= ADAPT_STD_MAX * std0[c] * 1.0001f);
+        CHECK(e->std[c] >= ADAPT_STD_MIN * std0[c] * 0.9999f);
+    }
+    /* the detector bounds follow the adapted step */
+    CHECK_NEAR(e->err_hi[CAL_SPEED], e->mean[CAL_SPEED] + err_z[CAL_SPEED] * e->std[CAL_SPEED], 1e-2);
+    /* other steps are untouched */
+    CHECK(same_entry(&a.cur->entry[CALIB_DOWN][PWM], &base.entry[CALIB_DOWN][PWM]));
+    calib_entry saved = *e;
+    adapt_close(&a);
+
+    /* clean close: everything is in adapt.bin */
+    CHECK(adapt_open(&a, &base, warn_z, err_z, table_path, journal_path) == 0);
+    CHECK(a.replayed == 0);
+    CHECK(same_entry(&a.cur->entry[CALIB_UP][PWM], &saved));
+
+    /* crash after a flush: the journal carries the change */
+    for (int c = 0; c < CALIB_CHANNELS; c++) x[c] = mean0[c];
+    adapt_sample(&a, x, CALIB_DOWN, PWM + 1, t += 10 * MS);
+    adapt_sample(&a, x, CALIB_DOWN, PWM + 1, t += 10 * MS);
+    adapt_flush(&a, t, 1);
+    CHECK(a.flushed == 1);
+    saved = a.cur->entry[CALIB_DOWN][PWM + 1];
+    atomic_store(&a.stop, 1);
+    pthread_join(a.thread, NULL);
+    close(a.fd);
+    free(a.cur);
+    free(a.disk);
+
+    CHECK(adapt_open(&a, &base, warn_z, err_z, table_path, journal_path) == 0);
+    CHECK(a.replayed == 1);
+    CHECK(same_entry(&a.cur->entry[CALIB_DOWN][PWM + 1], &saved));
+    adapt_close(&a);
+
+    /* a new calibration starts over */
+    base.entry[CALIB_UP][0].mean[CAL_SPEED] += 1;
+    calib_table_finish(&base);
+    fprintf(stderr, "(starting over is expected here)\n");
+    CHECK(adapt_open(&a, &base, warn_z, err_z, table_path, journal_path) == 0);
+    CHECK(same_entry(&a.cur->entry[CALIB_UP][PWM], &base.entry[CALIB_UP][PWM]));
+    adapt_close(&a);
+
+    unlink(table_path);
+    unlink(journal_path);
+    rmdir(dir);
+    return check_done("adapt_test");
+}
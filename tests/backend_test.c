@@ -0,0 +1,48 @@
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "../src/backend.h"
+
+/* The daemon's text IMU file as pread sees it, and the path helpers. */
+
+static int parse(const char *text, imu_sample *s) {
+    char buf[128];
+
+    snprintf(buf, sizeof(buf), "%s", text);
+    memset(s, 0xff, sizeof(*s));    /* stale garbage */
+    return imu_parse_text(buf, s);
+}
+
+int main(void) {
+    imu_sample s;
+    char path[MOTOR_PATH_MAX];
+
+    CHECK(parse("0.125|12.5|31.25\n", &s) == 0);
+    CHECK(s.acc == 0.125f && s.gyro == 12.5f && s.temp == 31.25f && s.t_ns == 0);
+    /* the newest full line wins */
+    CHECK(parse("0.1|1|20\n0.2|2|21\n", &s) == 0);
+    CHECK(s.acc == 0.2f && s.gyro == 2 && s.temp == 21);
+    /* a half-written last line is skipped */
+    CHECK(parse("0.1|1|20\n0.2|", &s) == 0);
+    CHECK(s.acc == 0.1f && s.gyro == 1 && s.temp == 20);
+    /* torn or empty: zeroed and -1 */
+    CHECK(parse("0.1|1\n", &s) == -1);
+    CHECK(s.acc == 0 && s.gyro == 0 && s.temp == 0 && s.t_ns == 0);
+    CHECK(parse("", &s) == -1);
+    CHECK(s.acc == 0 && s.gyro == 0 && s.temp == 0);
+    CHECK(parse("x|y|z\n", &s) == -1);
+    CHECK(s.acc == 0 && s.gyro == 0 && s.temp == 0);
+
+    setenv("MOTOR_DATA_DIR", "/tmp/rd", 1);
+    CHECK(strcmp(data_path(path, sizeof(path), "calib.bin"), "/tmp/rd/calib.bin") == 0);
+    CHECK(strcmp(motor_data_path(path, sizeof(path), 0, "imu"), "/tmp/rd/imu") == 0);
+    CHECK(strcmp(motor_data_path(path, sizeof(path), 2, "imu"), "/tmp/rd/motor2/imu") == 0);
+    unsetenv("MOTOR_DATA_DIR");
+    CHECK(strcmp(data_path(path, sizeof(path), "calib.bin"), ROBOT_DATA_DIR "/calib.bin") == 0);
+    CHECK(strcmp(motor_dev_path(path, sizeof(path), "/dev/motor", 0), "/dev/motor") == 0);
+    CHECK(strcmp(motor_dev_path(path, sizeof(path), "/dev/motor", 3), "/dev/motor3") == 0);
+    /* a short buffer truncates, never overflows */
+    char small[8];
+    CHECK(strcmp(motor_dev_path(small, sizeof(small), "/dev/motor", 3), "/dev/mo") == 0);
+    return check_done("backend_test");
+}
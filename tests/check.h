@@ -0,0 +1,45 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+/*
+ * Assertions for the programs in tests/: a failed check prints where and
+ * what and the program carries on, check_done() turns the failures into
+ * the exit status. `make test` builds and runs them all.
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+static int check_failures;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            check_failures++;                                                \
+        }                                                                    \
+    } while (0)
+
+#define CHECK_NEAR(got, want, tol)                                           \
+    do {                                                                     \
+        double g_ = (got), w_ = (want);                                      \
+        if (!(fabs(g_ - w_) <= (tol))) {                                     \
+            fprintf(stderr, "%s:%d: %s = %.9g, want %.9g +- %g\n", __FILE__, __LINE__, #got, g_, w_, \
+                    (double)(tol));                                          \
+            check_failures++;                                                \
+        }                                                                    \
+    } while (0)
+
+static inline int check_done(const char *name) {
+    if (check_failures) fprintf(stderr, "%s: %d check(s) failed\n", name, check_failures);
+    else printf("%s: ok\n", name);
+    return check_failures != 0;
+}
+
+/* Reproducible uniform (0, 1) without touching rand()'s state. */
+static inline double check_uniform(unsigned long long *state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return ((*state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+#endif
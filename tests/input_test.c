@@ -0,0 +1,66 @@
+#include <string.h>
+#include <unistd.h>
+#include "check.h"
+#include "../src/input.h"
+
+/* Keys and escape sequences through a pipe, as the terminal would send them. */
+
+static int stops;
+
+static void on_stop(void *arg, uint64_t t_ns) {
+    (void)arg;
+    (void)t_ns;
+    stops++;
+}
+
+int main(void) {
+    static const struct { const char *bytes; int pause_ms; } chunks[] = {
+        { "\x1b[A", 0 },                /* CSI up */
+        { "\x1bOB", 0 },                /* SS3 down */
+        { "\x1b[1;5A", 0 },             /* Ctrl+up, with parameters */
+        { "\x1b[15~", 0 },              /* F5: consumed and dropped */
+        { "3\t", 0 },
+        { "\x1b\x1b[B", 0 },            /* ESC ESC: the first is a lone key */
+        { "\x1b[", 10 },                /* split within the escape timeout */
+        { "B", 0 },
+        { "\x1b", INPUT_ESC_TIMEOUT_MS * 3 },   /* a lone Esc that goes quiet */
+        { "[A", 0 },                    /* now plain '[' and 'A', ignored */
+        { "\x1b" "7", 0 },              /* Alt+7 selects like 7 */
+        { "s", 0 },
+    };
+    static const int want[][2] = {
+        { INPUT_UP, 0 }, { INPUT_DOWN, 0 }, { INPUT_UP, 0 }, { INPUT_SELECT, 3 },
+        { INPUT_NEXT, 0 }, { INPUT_DOWN, 0 }, { INPUT_DOWN, 0 }, { INPUT_SELECT, 7 },
+        { INPUT_STOP, 0 },
+    };
+    const int nwant = sizeof(want) / sizeof(want[0]);
+    input in;
+    input_cmd cmd;
+    int fds[2], n = 0;
+
+    CHECK(pipe(fds) == 0);
+    CHECK(input_start(&in, fds[0], on_stop, NULL) == 0);
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        CHECK(write(fds[1], chunks[i].bytes, strlen(chunks[i].bytes)) == (ssize_t)strlen(chunks[i].bytes));
+        /* let the reader take each chunk on its own */
+        usleep((chunks[i].pause_ms ? chunks[i].pause_ms : 5) * 1000);
+    }
+    close(fds[1]);                  /* EOF ends the reader */
+    input_stop(&in);
+
+    while (input_pop(&in, &cmd)) {
+        if (n < nwant) {
+            if (cmd.type != want[n][0] || cmd.arg != want[n][1])
+                fprintf(stderr, "command %d: got %d/%d, want %d/%d\n", n, cmd.type, cmd.arg,
+                        want[n][0], want[n][1]);
+            CHECK(cmd.type == want[n][0] && cmd.arg == want[n][1]);
+            CHECK(cmd.t_ns > 0);
+        }
+        n++;
+    }
+    CHECK(n == nwant);
+    CHECK(stops == 1);
+    CHECK(atomic_load(&in.dropped) == 0);
+    close(fds[0]);
+    return check_done("input_test");
+}
@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "check.h"
+#include "../src/mahal.h"
+
+/*
+ * Co-moment accumulation against a two-pass covariance, and d2 from the
+ * stored inverse Cholesky factor against r^T C^-1 r solved directly, for a
+ * diagonal, a correlated and a rank-deficient covariance.
+ */
+
+#define TRI(i, j) ((i) * ((i) + 1) / 2 + (j))
+#define N 4
+
+static const float floors[N] = {0.01f, 0.01f, 0.01f, 0.01f};
+
+static void set_cov(mahal_entry *e, const double c[N][N]) {
+    for (int i = 0; i < N; i++)
+        for (int j = 0; j <= i; j++) e->cov[TRI(i, j)] = c[i][j];
+}
+
+/* r^T C^-1 r by Gauss-Jordan on [C | r] */
+static double direct_d2(const double c[N][N], const double r[N]) {
+    double a[N][N + 1];
+
+    for (int i = 0; i < N; i++) {
+        memcpy(a[i], c[i], sizeof(c[i]));
+        a[i][N] = r[i];
+    }
+    for (int p = 0; p < N; p++) {
+        for (int i = 0; i < N; i++) {
+            if (i == p) continue;
+            double f = a[i][p] / a[p][p];
+            for (int j = p; j <= N; j++) a[i][j] -= f * a[p][j];
+        }
+    }
+    double d2 = 0;
+    for (int i = 0; i < N; i++) d2 += r[i] * a[i][N] / a[i][i];
+    return d2;
+}
+
+static void check_d2(const double c[N][N], int want_diag) {
+    static mahal_table t;
+    const float mean[N] = {100, 0.2f, 3, 30};
+    const double r[N] = {1.5, -0.3, 2, -4};
+    float x[N];
+
+    mahal_table_init(&t, floors);
+    mahal_entry *e = &t.entry[CALIB_UP][10];
+    memcpy(e->mean, mean, sizeof(mean));
+    set_cov(e, c);
+    mahal_table_finish(&t);
+    CHECK(e->diag == (uint32_t)want_diag);
+    for (int i = 0; i < N; i++) x[i] = mean[i] + r[i];
+
+    double want;
+    if (want_diag) {
+        double d[N][N] = {{0}};
+        for (int i = 0; i < N; i++) d[i][i] = c[i][i];
+        want = direct_d2(d, r);
+    } else {
+        want = direct_d2(c, r);
+    }
+    CHECK_NEAR(mahal_entry_d2(e, x), want, 1e-4 * want);
+    CHECK_NEAR(mahal_d2(&t, x, 10, CALIB_UP), want, 1e-4 * want);
+    CHECK_NEAR(mahal_entry_d2(e, mean), 0, 1e-6);
+}
+
+static void check_acc(void) {
+    mahal_acc a;
+    mahal_entry e;
+    enum { SAMPLES = 5000 };
+    static float xs[SAMPLES][N];
+    unsigned long long rng = 3;
+    double mean[N] = {0};
+
+    mahal_acc_reset(&a);
+    for (int s = 0; s < SAMPLES; s++) {
+        double u = check_uniform(&rng), v = check_uniform(&rng), w = check_uniform(&rng);
+        xs[s][0] = 1000 + 10 * u;
+        xs[s][1] = 0.5 + 0.1 * u + 0.02 * v;   /* follows speed */
+        xs[s][2] = 5 - 2 * v;
+        xs[s][3] = 25 + w;
+        mahal_acc_add(&a, xs[s]);
+        for (int i = 0; i < N; i++) mean[i] += xs[s][i] / SAMPLES;
+    }
+    mahal_acc_store(&a, &e);
+    CHECK(e.samples == SAMPLES);
+    for (int i = 0; i < N; i++) {
+        CHECK_NEAR(e.mean[i], mean[i], 1e-5 * fabs(mean[i]));
+        for (int j = 0; j <= i; j++) {
+            double c = 0;
+            for (int s = 0; s < SAMPLES; s++) c += (xs[s][i] - mean[i]) * (xs[s][j] - mean[j]);
+            c /= SAMPLES - 1;
+            CHECK_NEAR(e.cov[TRI(i, j)], c, 1e-4 * fabs(c) + 1e-9);
+        }
+    }
+}
+
+int main(void) {
+    static const double diagonal[N][N] = {
+        {4, 0, 0, 0}, {0, 0.01, 0, 0}, {0, 0, 2, 0}, {0, 0, 0, 36},
+    };
+    static const double correlated[N][N] = {
+        {4, 0.15, 1, 2}, {0.15, 0.01, 0.05, 0.1}, {1, 0.05, 2, 1}, {2, 0.1, 1, 36},
+    };
+    /* acc exactly follows speed */
+    static const double singular[N][N] = {
+        {4, 0.2, 0, 0}, {0.2, 0.01, 0, 0}, {0, 0, 2, 0}, {0, 0, 0, 36},
+    };
+    static mahal_table t;
+    char path[] = "/tmp/mahal_testXXXXXX";
+
+    check_acc();
+    check_d2(diagonal, 0);
+    check_d2(correlated, 0);
+    check_d2(singular, 1);
+
+    /* halfway between two steps: halfway between their means */
+    mahal_table_init(&t, floors);
+    for (int p = 0; p < 2; p++) {
+        mahal_entry *e = &t.entry[CALIB_DOWN][p];
+        set_cov(e, diagonal);
+        for (int i = 0; i < N; i++) e->mean[i] = 10 * p;
+    }
+    mahal_table_finish(&t);
+    const float mid[N] = {5, 5, 5, 5};
+    CHECK_NEAR(mahal_d2(&t, mid, 0.5f, CALIB_DOWN), 0, 1e-6);
+
+    /* round trip, then a flipped bit */
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+    CHECK(mahal_table_write(&t, path) == 0);
+    const mahal_table *m = mahal_table_map(path);
+    CHECK(m != NULL && memcmp(m, &t, sizeof(t)) == 0);
+    if (m) mahal_table_unmap(m);
+    t.entry[CALIB_DOWN][1].mean[0] = 11;
+    FILE *f = fopen(path, "wb");
+    CHECK(f && fwrite(&t, sizeof(t), 1, f) == 1);
+    if (f) fclose(f);
+    fprintf(stderr, "(a checksum mismatch is expected here)\n");
+    CHECK(mahal_table_map(path) == NULL);
+    unlink(path);
+    return check_done("mahal_test");
+}
@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "check.h"
+#include "../src/metrics.h"
+
+/*
+ * The text exposition of a counter summed over shards, a labelled gauge
+ * pair under one HELP/TYPE header and a histogram's cumulative buckets,
+ * then one HTTP scrape over a Unix socket.
+ */
+
+static metrics m;
+
+static int has(const char *text, const char *line) {
+    if (strstr(text, line)) return 1;
+    fprintf(stderr, "missing: %s", line);
+    return 0;
+}
+
+static int count(const char *text, const char *s) {
+    int n = 0;
+    for (const char *p = text; (p = strstr(p, s)) != NULL; p++) n++;
+    return n;
+}
+
+static char *scrape(const char *path, const char *request) {
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    static char buf[65536];
+    size_t got = 0;
+    ssize_t n;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    snprintf(sa.sun_path, sizeof(sa.sun_path), "%s", path);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) return NULL;
+    if (write(fd, request, strlen(request)) < 0) return NULL;
+    while (got < sizeof(buf) - 1 && (n = read(fd, buf + got, sizeof(buf) - 1 - got)) > 0) got += n;
+    buf[got] = '\0';
+    close(fd);
+    return buf;
+}
+
+int main(void) {
+    char *text = NULL, *resp;
+    size_t len = 0;
+    char path[64];
+
+    metrics_init(&m);
+    int keys = metrics_counter(&m, "test_keys_total", "Keys read.", NULL);
+    int rpm0 = metrics_gauge(&m, "test_rpm", "Shaft speed.", "motor=\"0\"");
+    int lat = metrics_histogram(&m, "test_latency_seconds", "Loop latency.", NULL);
+    int rpm1 = metrics_gauge(&m, "test_rpm", "Shaft speed.", "motor=\"1\"");
+    CHECK(keys >= 0 && rpm0 >= 0 && lat >= 0 && rpm1 >= 0);
+
+    metrics_shard *a = metrics_thread(&m), *b = metrics_thread(&m);
+    CHECK(a != NULL && b != NULL && a != b);
+    metrics_add(a, keys, 2);
+    metrics_add(b, keys, 3);
+    metrics_set(a, rpm0, 1200.5);
+    metrics_set(b, rpm1, -1);
+    metrics_observe_ns(a, lat, 0);                  /* le 1e-06 */
+    metrics_observe_ns(b, lat, 1500);               /* 2 us: le 2e-06 */
+    metrics_observe_ns(a, lat, 10000000000ULL);     /* past the last bucket */
+    metrics_add(NULL, keys, 100);                   /* dropped */
+
+    FILE *f = open_memstream(&text, &len);
+    metrics_render(&m, f);
+    fclose(f);
+    CHECK(has(text, "# HELP test_keys_total Keys read.\n# TYPE test_keys_total counter\ntest_keys_total 5\n"));
+    CHECK(has(text, "# TYPE test_rpm gauge\ntest_rpm{motor=\"0\"} 1200.5\ntest_rpm{motor=\"1\"} -1\n"));
+    CHECK(count(text, "# HELP test_rpm ") == 1);
+    CHECK(has(text, "# TYPE test_latency_seconds histogram\n"));
+    CHECK(has(text, "test_latency_seconds_bucket{le=\"1e-06\"} 1\n"));
+    CHECK(has(text, "test_latency_seconds_bucket{le=\"2e-06\"} 2\n"));
+    CHECK(has(text, "test_latency_seconds_bucket{le=\"8.388608\"} 2\n"));
+    CHECK(has(text, "test_latency_seconds_bucket{le=\"+Inf\"} 3\n"));
+    CHECK(has(text, "test_latency_seconds_sum 10.0000015\n"));
+    CHECK(has(text, "test_latency_seconds_count 3\n"));
+    CHECK(count(text, "test_latency_seconds_bucket") == METRICS_HIST_BINS + 1);
+
+    snprintf(path, sizeof(path), "/tmp/metrics_test.%d", (int)getpid());
+    CHECK(metrics_serve(&m, path) == 0);
+    resp = scrape(path, "GET /metrics HTTP/1.1\r\nHost: x\r\n\r\n");
+    CHECK(resp != NULL && strncmp(resp, "HTTP/1.0 200 OK\r\n", 17) == 0);
+    CHECK(resp != NULL && strstr(resp, "\r\n\r\n") && strcmp(strstr(resp, "\r\n\r\n") + 4, text) == 0);
+    resp = scrape(path, "GET /other HTTP/1.1\r\n\r\n");
+    CHECK(resp != NULL && strncmp(resp, "HTTP/1.0 404", 12) == 0);
+    metrics_stop(&m);
+    CHECK(access(path, F_OK) < 0);
+    free(text);
+    return check_done("metrics_test");
+}
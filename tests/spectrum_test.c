@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "../src/spectrum.h"
+
+/*
+ * fft_forward against a direct DFT, then the spectrum bands of a rotating
+ * 1x vector plus a 2x one: each lands in its own band at its amplitude.
+ */
+
+#define RAW_HZ 1000.0
+#define RPM 240.0f
+#define AMP_1X 0.05
+#define AMP_2X 0.02
+
+static void check_fft(int n) {
+    fft_plan plan;
+    float *re = aligned_alloc(16, n * sizeof(float)), *im = aligned_alloc(16, n * sizeof(float));
+    double *xr = malloc(n * sizeof(double)), *xi = malloc(n * sizeof(double));
+    double worst = 0;
+    unsigned long long rng = 7;
+
+    CHECK(fft_plan_init(&plan, n) == 0);
+    for (int j = 0; j < n; j++) {
+        re[j] = xr[j] = check_uniform(&rng) - 0.5;
+        im[j] = xi[j] = check_uniform(&rng) - 0.5;
+    }
+    fft_forward(&plan, re, im);
+    for (int k = 0; k < n; k++) {
+        double sr = 0, si = 0;
+        for (int j = 0; j < n; j++) {
+            double a = -2 * M_PI * (double)j * k / n;
+            sr += xr[j] * cos(a) - xi[j] * sin(a);
+            si += xr[j] * sin(a) + xi[j] * cos(a);
+        }
+        worst = fmax(worst, fmax(fabs(re[k] - sr), fabs(im[k] - si)));
+    }
+    if (worst > 1e-3) fprintf(stderr, "fft n=%d: error %g\n", n, worst);
+    CHECK(worst <= 1e-3);
+    fft_plan_free(&plan);
+    free(re);
+    free(im);
+    free(xr);
+    free(xi);
+}
+
+static void make_records(imu_record *r, size_t count, double rpm) {
+    double w = 2 * M_PI * rpm / 60.0;
+
+    for (size_t i = 0; i < count; i++) {
+        double t = i / RAW_HZ;
+        double ax = AMP_1X * cos(w * t) + AMP_2X * cos(2 * w * t);
+        double ay = AMP_1X * sin(w * t) + AMP_2X * sin(2 * w * t);
+        memset(&r[i], 0, sizeof(r[i]));
+        r[i].t_ns = (uint64_t)(t * 1e9);
+        r[i].raw[0] = (int16_t)lrint(ax * 16384);
+        r[i].raw[1] = (int16_t)lrint(ay * 16384);
+        r[i].raw[2] = 16384;
+    }
+}
+
+int main(void) {
+    spectrum_params sp;
+    spectrum s;
+    size_t count = 20000;
+    imu_record *rec = malloc(count * sizeof(*rec));
+
+    check_fft(8);
+    check_fft(64);
+    check_fft(1024);
+
+    spectrum_default_params(&sp);
+    CHECK(spectrum_init(&s, &sp) == 0);
+    make_records(rec, count, RPM);
+    CHECK(spectrum_feed(&s, rec, count, RPM) > sp.avg);
+    CHECK(s.valid);
+    CHECK_NEAR(s.fs, RAW_HZ / sp.decim, 0.01);
+    CHECK_NEAR(s.shaft_hz, RPM / 60, 1e-4);
+    CHECK_NEAR(s.band[BAND_1X], AMP_1X, 0.05 * AMP_1X);
+    CHECK_NEAR(s.band[BAND_2X], AMP_2X, 0.05 * AMP_2X);
+    CHECK(s.band[BAND_HARM] < 0.05 * AMP_2X);
+    CHECK(s.band[BAND_HIGH] < 0.05 * AMP_2X);
+
+    /* too slow for the bins to separate the bands */
+    spectrum_reset(&s);
+    make_records(rec, count, 20);
+    spectrum_feed(&s, rec, count, 20);
+    CHECK(!s.valid);
+
+    /* a hole in the records restarts the window */
+    spectrum_reset(&s);
+    make_records(rec, count, RPM);
+    for (size_t i = count / 2; i < count; i++) rec[i].t_ns += 2 * SPEC_MAX_GAP_NS;
+    spectrum_feed(&s, rec, count, RPM);
+    CHECK(s.gaps == 1);
+
+    spectrum_free(&s);
+    free(rec);
+    return check_done("spectrum_test");
+}
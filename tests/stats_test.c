@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include "check.h"
+#include "../src/stats.h"
+
+/* stats.c against hand-computed values, a single pass and sorted data. */
+
+#define N 20000
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void test_welford(void) {
+    static const double x[] = {2, 4, 4, 4, 5, 5, 7, 9};
+    stats s;
+
+    stats_reset(&s);
+    CHECK(stats_var(&s) == 0);
+    for (int i = 0; i < 8; i++) stats_add(&s, x[i]);
+    CHECK(s.n == 8);
+    CHECK_NEAR(s.mean, 5.0, 1e-12);
+    CHECK_NEAR(stats_var(&s), 4.0, 1e-12);
+    CHECK_NEAR(stats_std(&s), 2.0, 1e-12);
+    CHECK_NEAR(stats_sample_var(&s), 32.0 / 7, 1e-12);
+    CHECK(s.min == 2 && s.max == 9);
+
+    /* a large offset is where the textbook sum-of-squares formula fails */
+    stats_reset(&s);
+    for (int i = 0; i < 4; i++) stats_add(&s, 1e9 + (double[]){4, 7, 13, 16}[i]);
+    CHECK_NEAR(s.mean, 1e9 + 10, 1e-6);
+    CHECK_NEAR(stats_sample_var(&s), 30.0, 1e-6);
+}
+
+static void test_merge(void) {
+    unsigned long long rng = 1;
+    stats all, part[3], merged, empty;
+
+    stats_reset(&all);
+    stats_reset(&empty);
+    for (int k = 0; k < 3; k++) stats_reset(&part[k]);
+    for (int i = 0; i < N; i++) {
+        double x = 100 + 15 * (check_uniform(&rng) - 0.5) + (i < N / 3 ? 5 : 0);
+        stats_add(&all, x);
+        /* uneven parts with different means */
+        stats_add(&part[i < N / 3 ? 0 : i < N - 7 ? 1 : 2], x);
+    }
+    stats_reset(&merged);
+    for (int k = 0; k < 3; k++) stats_merge(&merged, &part[k]);
+    stats_merge(&merged, &empty);
+    CHECK(merged.n == all.n);
+    CHECK_NEAR(merged.mean, all.mean, 1e-9 * fabs(all.mean));
+    CHECK_NEAR(merged.m2, all.m2, 1e-9 * all.m2);
+    CHECK(merged.min == all.min && merged.max == all.max);
+}
+
+/* P² against the nearest rank of the sorted data, within 1 % of the range. */
+static void check_quantiles(const char *what, double *x, int n) {
+    static const double ps[] = {0.5, 0.9, 0.99};
+    p2_quantile q[3];
+
+    for (int k = 0; k < 3; k++) p2_init(&q[k], ps[k]);
+    for (int i = 0; i < n; i++)
+        for (int k = 0; k < 3; k++) p2_add(&q[k], x[i]);
+    qsort(x, n, sizeof(*x), cmp_double);
+    for (int k = 0; k < 3; k++) {
+        double want = x[(int)(ps[k] * (n - 1) + 0.5)];
+        double got = p2_value(&q[k]);
+        if (fabs(got - want) > 0.01 * (x[n - 1] - x[0])) {
+            fprintf(stderr, "%s p%.0f: %g, sorted %g\n", what, ps[k] * 100, got, want);
+            check_failures++;
+        }
+    }
+}
+
+static void test_p2(void) {
+    static double x[N];
+    unsigned long long rng = 7;
+    p2_quantile q;
+
+    /* exact below five samples */
+    p2_init(&q, 0.5);
+    CHECK(p2_value(&q) == 0);
+    p2_add(&q, 3);
+    p2_add(&q, 1);
+    p2_add(&q, 2);
+    CHECK(p2_value(&q) == 2);
+
+    for (int i = 0; i < N; i++) x[i] = check_uniform(&rng);
+    check_quantiles("uniform", x, N);
+    for (int i = 0; i < N; i++) x[i] = -log(check_uniform(&rng));
+    check_quantiles("exponential", x, N);
+}
+
+int main(void) {
+    test_welford();
+    test_merge();
+    test_p2();
+    return check_done("stats_test");
+}
@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "check.h"
+#include "../src/tracepoint.h"
+
+/*
+ * Built with -DTRACEPOINTS. Events of two threads land in their own rings
+ * and come out of tp_dump as trace-event JSON in time order; a wrapped
+ * ring dumps its newest three quarters; SIGUSR1 and exit dump on their own.
+ */
+
+#define WRAP_EVENTS (TP_RING + 100)
+
+static char prefix[64], exit_path[96];
+
+static char *slurp(const char *path) {
+    FILE *f = fopen(path, "r");
+    char *text = NULL;
+    size_t len = 0;
+
+    if (f == NULL) return NULL;
+    FILE *out = open_memstream(&text, &len);
+    for (int c; (c = fgetc(f)) != EOF;) fputc(c, out);
+    fclose(out);
+    fclose(f);
+    return text;
+}
+
+static int count(const char *text, const char *s) {
+    int n = 0;
+    for (const char *p = text; (p = strstr(p, s)) != NULL; p++) n++;
+    return n;
+}
+
+/* the events of tid in the order dumped have non-decreasing ts */
+static int in_order(const char *text, int tid) {
+    char key[32];
+    double last = 0;
+
+    snprintf(key, sizeof(key), "\"tid\":%d,\"ts\":", tid);
+    for (const char *p = text; (p = strstr(p, key)) != NULL; p++) {
+        double ts = atof(p + strlen(key));
+        if (ts < last) return 0;
+        last = ts;
+    }
+    return 1;
+}
+
+static void *worker(void *arg) {
+    TP_THREAD("worker");
+    for (int i = 0; i < 10; i++) {
+        TP_BEGIN("step");
+        TP_INSTANT("tick");
+        TP_END("step");
+    }
+    *(int *)arg = tp_self->tid;
+    return NULL;
+}
+
+static void *wrapper(void *arg) {
+    TP_THREAD("wrapper");
+    for (int i = 0; i < WRAP_EVENTS; i++) TP_INSTANT("spin");
+    *(int *)arg = tp_self->tid;
+    return NULL;
+}
+
+/* registered before tp_start, so it runs after the exit dump */
+static void check_exit_dump(void) {
+    char *text = slurp(exit_path);
+    int ok = text != NULL && strstr(text, "\"name\":\"main\"") != NULL;
+
+    free(text);
+    unlink(exit_path);
+    if (!ok) {
+        fprintf(stderr, "%s: no exit dump\n", exit_path);
+        _exit(1);
+    }
+}
+
+int main(void) {
+    pthread_t t;
+    int worker_tid = 0, wrapper_tid = 0;
+    char path[96], *text;
+
+    TP_INSTANT("before");           /* no ring yet: dropped */
+    TP_THREAD("main");
+    TP_BEGIN("main_stage");
+    CHECK(pthread_create(&t, NULL, worker, &worker_tid) == 0);
+    pthread_join(t, NULL);
+    CHECK(pthread_create(&t, NULL, wrapper, &wrapper_tid) == 0);
+    pthread_join(t, NULL);
+    TP_END("main_stage");
+
+    snprintf(path, sizeof(path), "/tmp/tracepoint_test.%d.json", (int)getpid());
+    CHECK(tp_dump(path) == 0);
+    text = slurp(path);
+    CHECK(text != NULL);
+    if (text) {
+        CHECK(strncmp(text, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", 40) == 0);
+        CHECK(strcmp(text + strlen(text) - 4, "\n]}\n") == 0);
+        CHECK(count(text, "\"name\":\"thread_name\"") == 3);
+        CHECK(count(text, "\"args\":{\"name\":\"worker\"}") == 1);
+        CHECK(count(text, "\"name\":\"before\"") == 0);
+        CHECK(count(text, "\"ph\":\"B\",\"name\":\"step\"") == 10);
+        CHECK(count(text, "\"ph\":\"E\",\"name\":\"step\"") == 10);
+        CHECK(count(text, "\"ph\":\"i\",\"name\":\"tick\"") == 10);
+        CHECK(count(text, ",\"s\":\"t\"}") == 10 + TP_RING * 3 / 4);    /* instants only */
+        CHECK(count(text, "\"name\":\"main_stage\"") == 2);
+        CHECK(count(text, "\"name\":\"spin\"") == TP_RING * 3 / 4);
+        CHECK(in_order(text, worker_tid));
+        CHECK(in_order(text, wrapper_tid));
+    }
+    free(text);
+    unlink(path);
+
+    snprintf(prefix, sizeof(prefix), "/tmp/tracepoint_test");
+    snprintf(exit_path, sizeof(exit_path), "%s-%d.json", prefix, (int)getpid());
+    atexit(check_exit_dump);
+    TP_START(prefix);
+    raise(SIGUSR1);
+    snprintf(path, sizeof(path), "%s-%d-0.json", prefix, (int)getpid());
+    text = NULL;
+    for (int i = 0; i < 200 && (text == NULL || strstr(text, "\n]}\n") == NULL); i++) {
+        free(text);
+        usleep(10000);
+        text = slurp(path);
+    }
+    CHECK(text != NULL && count(text, "\"name\":\"thread_name\"") == 3);
+    free(text);
+    unlink(path);
+    return check_done("tracepoint_test");
+}
@@ -0,0 +1,48 @@
+#include <stdatomic.h>
+#include "check.h"
+#include "../src/workpool.h"
+
+/* Every task runs exactly once, on a valid worker, whatever the split. */
+
+#define MAX_TASKS 5000
+#define MAX_THREADS 8
+
+static _Atomic int runs[MAX_TASKS];
+static _Atomic int bad_worker;
+
+typedef struct {
+    int nthreads;
+} run_arg;
+
+static void task(size_t t, int worker, void *arg) {
+    const run_arg *a = arg;
+    volatile double sink = 0;
+
+    if (worker < 0 || worker >= a->nthreads) atomic_fetch_add(&bad_worker, 1);
+    /* the first tasks are far more expensive, so the other slices steal */
+    for (size_t i = 0; i < (t < 16 ? 200000 : 100); i++) sink += i;
+    atomic_fetch_add(&runs[t], 1);
+}
+
+static void check_run(int nthreads, size_t ntasks) {
+    run_arg a = { .nthreads = nthreads };
+    int once = 1;
+
+    for (size_t t = 0; t < MAX_TASKS; t++) atomic_store(&runs[t], 0);
+    atomic_store(&bad_worker, 0);
+    CHECK(workpool_run(nthreads, ntasks, task, &a) == 0);
+    for (size_t t = 0; t < ntasks; t++) once &= atomic_load(&runs[t]) == 1;
+    if (!once) fprintf(stderr, "%d threads, %zu tasks: not every task ran once\n", nthreads, ntasks);
+    CHECK(once);
+    CHECK(atomic_load(&bad_worker) == 0);
+}
+
+int main(void) {
+    CHECK(workpool_cpus() >= 1);
+    check_run(1, 100);
+    check_run(4, MAX_TASKS);
+    check_run(MAX_THREADS, 3);      /* more workers than tasks */
+    check_run(3, 0);
+    check_run(MAX_THREADS, MAX_TASKS - 1);
+    return check_done("workpool_test");
+}